@@ -94,6 +94,7 @@ namespace oph
 		Float32 = 9,	/* Single precision floating */
 		Float64 = 10,	/* Double precision floating */
 		CmprFmt = 11,	/* Compressed Image File */
+		Float16 = 12,	/* Half precision floating */
 	};
 
 	/* Field Store Type */
@@ -101,6 +102,7 @@ namespace oph
 		Null = 0,	/* Null Data */
 		Directly = 1,	/* Field data is directly stored at the 'Field Data' region. */
 		LinkFile = 2,	/* Field data is stored at separate files and they are referred by path. 'Field Data' region stores those file paths. */
+		Frames = 3,		/* Field data is a sequence of frames sharing the headers. Frame Index Header follows the Wavelength Table. */
 	};
 
 	/* Encoding Type of Field Data Domain */
@@ -128,6 +130,7 @@ namespace oph
 		PNG = 4,	/* PNG (png, pns) */
 		GIF = 5,	/* GIF (gif) */
 		TIF = 6,	/* TIFF (tif, tiff) */
+		LZB = 7,	/* Openholo lossless block compression of the field data */
 	};
 
 
@@ -198,10 +201,53 @@ namespace oph
 			this->comprsType = CompresType::Null;
 		}
 	};
+
+	/* Stored after the Wavelength Table when 'cmplxFldType' is neither Float32 nor Float64. */
+	struct ohcCodecHeader {
+		uint32_t	codecSize;		/* Size of Codec Header(in byte) : CodecHeader + BlockTable */
+		DataType	storeType;		/* Data type of the stored values. When 'cmplxFldType' is CmprFmt, data type before compression */
+		double_t	rangeMin[2];	/* Value of each complex channel(Real or Amplitude, Imaginary or Phase) mapped to the minimum of an integer 'storeType' */
+		double_t	rangeMax[2];	/* Value of each complex channel(Real or Amplitude, Imaginary or Phase) mapped to the maximum of an integer 'storeType' */
+		uint64_t	rawSize;		/* Field data size before compression */
+		uint32_t	blockSize;		/* Size of each compression block before compression(in byte). 0 : Not compressed */
+		uint32_t	blockNum;		/* Number of compression blocks. Compressed size of each block(uint32_t) follows as BlockTable */
+
+		//basic constructor
+		ohcCodecHeader() {
+			this->codecSize = 0;
+			this->storeType = DataType::Null;
+			this->rangeMin[0] = this->rangeMin[1] = 0.0;
+			this->rangeMax[0] = this->rangeMax[1] = 0.0;
+			this->rawSize = 0;
+			this->blockSize = 0;
+			this->blockNum = 0;
+		}
+	};
+
+	/* Stored after the Wavelength Table when 'fldStore' is Frames. Each frame is a Codec Header, a Block Table and the field data. */
+	struct ohcFrameIndexHeader {
+		uint32_t	frameNum;		/* Number of frames */
+		uint64_t	indexOffBytes;	/* Address of the Frame Index(ohcFrameEntry * frameNum). 0 : Not closed, frames are found by scanning */
+
+		//basic constructor
+		ohcFrameIndexHeader() {
+			this->frameNum = 0;
+			this->indexOffBytes = 0;
+		}
+	};
+
+	struct ohcFrameEntry {
+		uint64_t	offBytes;		/* Address of the Codec Header of the frame */
+		uint64_t	size;			/* Size of the frame(in byte) : CodecHeader + BlockTable + field data */
+	};
 #pragma pack(pop)
 	struct ohcHeader {
 		ohcFileHeader			fileHeader;
 		ohcFieldInfoHeader		fieldInfo;
+		ohcCodecHeader			codecInfo;
+		std::vector<uint32_t>	blockTable;
+		ohcFrameIndexHeader		frameInfo;
+		std::vector<ohcFrameEntry>	frameTable;
 		std::vector<double_t>	wavlenTable; /* Wavelength : Scalable Data Size(8/24/8n). When 'clrType' is RGB, wavelengths of red, green, and blue are stored sequentially; When 'clrType' is MLT, size of this field is 8*n bytes, where 'n' is the 'wavlenNum'. */
 	};
 }
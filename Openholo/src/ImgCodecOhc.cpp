@@ -50,11 +50,339 @@
 #include "sys.h"
 #include <limits> // limit value of each data types
 
+#define OHC_BULK_CHUNK (1 << 22) // number of elements read at once by the bulk decode path
+#define OHC_BLOCK_SIZE (1 << 20) // bytes of a compression block before compression
+#define LZB_MIN_MATCH 4
+#define LZB_HASH_LOG 14
+
 
 //hot key for call by this pointer
 #define FHeader this->Header->fileHeader
 #define FldInfo this->Header->fieldInfo
 #define WavLeng this->Header->wavlenTable
+#define CInfo this->Header->codecInfo
+
+
+/************************ OHC Field Value Codec *****************************/
+
+/* Half precision floating stored as its bit pattern */
+struct ohcHalf { uint16_t bits; };
+
+static inline uint16_t floatToHalf(const float f)
+{
+	uint32_t x;
+	memcpy(&x, &f, sizeof(x));
+	uint32_t sign = (x >> 16) & 0x8000;
+	int32_t exp = (int32_t)((x >> 23) & 0xFF) - 127 + 15;
+	uint32_t mant = x & 0x7FFFFF;
+
+	if (((x >> 23) & 0xFF) == 0xFF) // Inf, NaN
+		return (uint16_t)(sign | 0x7C00 | (mant ? 0x200 : 0));
+	if (exp >= 31) // Overflow
+		return (uint16_t)(sign | 0x7C00);
+	if (exp <= 0) { // Subnormal
+		if (exp < -10) return (uint16_t)sign;
+		mant |= 0x800000;
+		uint32_t shift = (uint32_t)(14 - exp);
+		uint32_t h = mant >> shift;
+		uint32_t rem = mant & ((1u << shift) - 1);
+		uint32_t half = 1u << (shift - 1);
+		if (rem > half || (rem == half && (h & 1))) h++;
+		return (uint16_t)(sign | h);
+	}
+	uint32_t h = ((uint32_t)exp << 10) | (mant >> 13);
+	uint32_t rem = mant & 0x1FFF;
+	if (rem > 0x1000 || (rem == 0x1000 && (h & 1))) h++; // Round to nearest even, may carry into the exponent
+	return (uint16_t)(sign | h);
+}
+
+static inline float halfToFloat(const uint16_t h)
+{
+	uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+	uint32_t exp = (h >> 10) & 0x1F;
+	uint32_t mant = h & 0x3FF;
+	uint32_t x;
+
+	if (exp == 0) {
+		if (mant == 0)
+			x = sign;
+		else { // Subnormal
+			exp = 127 - 15 + 1;
+			while (!(mant & 0x400)) { mant <<= 1; exp--; }
+			x = sign | (exp << 23) | ((mant & 0x3FF) << 13);
+		}
+	}
+	else if (exp == 31)
+		x = sign | 0x7F800000 | (mant << 13);
+	else
+		x = sign | ((exp - 15 + 127) << 23) | (mant << 13);
+
+	float f;
+	memcpy(&f, &x, sizeof(f));
+	return f;
+}
+
+template<typename T>
+static inline Real ohcValue(const T v) { return (Real)v; }
+static inline Real ohcValue(const ohcHalf v) { return (Real)halfToFloat(v.bits); }
+
+template<typename T>
+static inline void ohcStore(T& dst, const Real v) {
+	if (std::numeric_limits<T>::is_integer) {
+		// (Real)max() rounds up to 2^63 or 2^64 for the 64-bit types, so the bounds are
+		// stored directly and only values strictly inside the range are converted (NaN stores min()).
+		Real q = floor(v + 0.5);
+		if (q >= (Real)std::numeric_limits<T>::max())
+			dst = std::numeric_limits<T>::max();
+		else if (!(q > (Real)std::numeric_limits<T>::min()))
+			dst = std::numeric_limits<T>::min();
+		else
+			dst = (T)q;
+	}
+	else
+		dst = (T)v;
+}
+static inline void ohcStore(ohcHalf& dst, const Real v) { dst.bits = floatToHalf((float)v); }
+
+static size_t ohcTypeSize(const DataType type)
+{
+	switch (type) {
+	case DataType::Int8: case DataType::Uint8: return 1;
+	case DataType::Int16: case DataType::Uint16: case DataType::Float16: return 2;
+	case DataType::Int32: case DataType::Uint32: case DataType::Float32: return 4;
+	case DataType::Int64: case DataType::Uint64: case DataType::Float64: return 8;
+	default: return 0;
+	}
+}
+
+static bool ohcIntegerRange(const DataType type, double& min_T, double& max_T)
+{
+	switch (type) {
+	case DataType::Int8: min_T = std::numeric_limits<int8_t>::min(); max_T = std::numeric_limits<int8_t>::max(); return true;
+	case DataType::Int16: min_T = std::numeric_limits<int16_t>::min(); max_T = std::numeric_limits<int16_t>::max(); return true;
+	case DataType::Int32: min_T = std::numeric_limits<int32_t>::min(); max_T = std::numeric_limits<int32_t>::max(); return true;
+	case DataType::Int64: min_T = (double)std::numeric_limits<int64_t>::min(); max_T = (double)std::numeric_limits<int64_t>::max(); return true;
+	case DataType::Uint8: min_T = 0; max_T = std::numeric_limits<uint8_t>::max(); return true;
+	case DataType::Uint16: min_T = 0; max_T = std::numeric_limits<uint16_t>::max(); return true;
+	case DataType::Uint32: min_T = 0; max_T = std::numeric_limits<uint32_t>::max(); return true;
+	case DataType::Uint64: min_T = 0; max_T = (double)std::numeric_limits<uint64_t>::max(); return true;
+	default: return false;
+	}
+}
+
+/* Stored value of a complex channel(0 : real or amplitude or phase-only, 1 : imaginary or phase) */
+static inline Real ohcComponent(Complex<Real> v, const FldCodeType code, const int comp)
+{
+	switch (code) {
+	case FldCodeType::RI: return v[comp];
+	case FldCodeType::AP: return (comp == 0) ? v.mag() : v.angle();
+	case FldCodeType::AE: return v.mag();
+	case FldCodeType::PE: return v.angle();
+	default: return 0;
+	}
+}
+
+/* Pixel i(x * pxNumY + y) of a wavelength, from the field data or from caller buffers in the same order */
+static inline Complex<Real> ohcSample(std::vector<OphComplexField>& field, int c, int i, int rows) { return field[c][i / rows][i % rows]; }
+static inline Complex<Real> ohcSample(Complex<Real>** field, int c, int i, int rows) { return field[c][i]; }
+
+/* Quantize a complex channel of every wavelength : stored = (value - offset) / scale */
+template<typename T, typename Src>
+static void quantizeOhcChunk(T* dst, Src& field, int comp, FldCodeType code,
+	bool bSeqt, int n_wavlens, int rows, ulonglong n_pixels, Real scale, Real offset)
+{
+	for (int c = 0; c < n_wavlens; c++) {
+		int i;
+#ifdef _OPENMP
+#pragma omp parallel for private(i)
+#endif
+		for (i = 0; i < (int)n_pixels; i++) {
+			ulonglong j = bSeqt ? (ulonglong)n_wavlens * i + c : c * n_pixels + i;
+			Real v = ohcComponent(ohcSample(field, c, i, rows), code, comp);
+			ohcStore(dst[j], (scale != 0) ? (v - offset) / scale : 0);
+		}
+	}
+}
+
+template<typename Src>
+static void quantizeOhcValues(const DataType type, uchar* dst, Src& field, int comp, FldCodeType code,
+	bool bSeqt, int n_wavlens, int rows, ulonglong n_pixels, Real scale, Real offset)
+{
+	switch (type) {
+	case DataType::Int8: quantizeOhcChunk((int8_t*)dst, field, comp, code, bSeqt, n_wavlens, rows, n_pixels, scale, offset); break;
+	case DataType::Int16: quantizeOhcChunk((int16_t*)dst, field, comp, code, bSeqt, n_wavlens, rows, n_pixels, scale, offset); break;
+	case DataType::Int32: quantizeOhcChunk((int32_t*)dst, field, comp, code, bSeqt, n_wavlens, rows, n_pixels, scale, offset); break;
+	case DataType::Int64: quantizeOhcChunk((int64_t*)dst, field, comp, code, bSeqt, n_wavlens, rows, n_pixels, scale, offset); break;
+	case DataType::Uint8: quantizeOhcChunk((uint8_t*)dst, field, comp, code, bSeqt, n_wavlens, rows, n_pixels, scale, offset); break;
+	case DataType::Uint16: quantizeOhcChunk((uint16_t*)dst, field, comp, code, bSeqt, n_wavlens, rows, n_pixels, scale, offset); break;
+	case DataType::Uint32: quantizeOhcChunk((uint32_t*)dst, field, comp, code, bSeqt, n_wavlens, rows, n_pixels, scale, offset); break;
+	case DataType::Uint64: quantizeOhcChunk((uint64_t*)dst, field, comp, code, bSeqt, n_wavlens, rows, n_pixels, scale, offset); break;
+	case DataType::Float16: quantizeOhcChunk((ohcHalf*)dst, field, comp, code, bSeqt, n_wavlens, rows, n_pixels, scale, offset); break;
+	case DataType::Float32: quantizeOhcChunk((float*)dst, field, comp, code, bSeqt, n_wavlens, rows, n_pixels, scale, offset); break;
+	case DataType::Float64: quantizeOhcChunk((double*)dst, field, comp, code, bSeqt, n_wavlens, rows, n_pixels, scale, offset); break;
+	default: break;
+	}
+}
+
+/* Range of a complex channel over every wavelength */
+template<typename Src>
+static void ohcComponentRange(Src& field, int comp, FldCodeType code,
+	int n_wavlens, int rows, ulonglong n_pixels, Real& vMin, Real& vMax)
+{
+	vMin = std::numeric_limits<Real>::max();
+	vMax = -std::numeric_limits<Real>::max();
+
+	for (int c = 0; c < n_wavlens; c++) {
+#ifdef _OPENMP
+#pragma omp parallel
+		{
+#endif
+			Real tMin = std::numeric_limits<Real>::max();
+			Real tMax = -std::numeric_limits<Real>::max();
+			int i;
+#ifdef _OPENMP
+#pragma omp for private(i)
+#endif
+			for (i = 0; i < (int)n_pixels; i++) {
+				Real v = ohcComponent(ohcSample(field, c, i, rows), code, comp);
+				if (v < tMin) tMin = v;
+				if (v > tMax) tMax = v;
+			}
+#ifdef _OPENMP
+#pragma omp critical(ohc_range)
+#endif
+			{
+				if (tMin < vMin) vMin = tMin;
+				if (tMax > vMax) vMax = tMax;
+			}
+#ifdef _OPENMP
+		}
+#endif
+	}
+}
+
+/* Byte-plane shuffle of a block : byte k of every element is grouped together, which lets the codec find the runs of the high bytes. */
+static void ohcShuffle(const uchar* src, uchar* dst, const int size, const int typeSize)
+{
+	int n = size / typeSize;
+	for (int k = 0; k < typeSize; k++)
+		for (int i = 0; i < n; i++)
+			dst[k * n + i] = src[i * typeSize + k];
+	memcpy(dst + n * typeSize, src + n * typeSize, size - n * typeSize);
+}
+
+static void ohcUnshuffle(const uchar* src, uchar* dst, const int size, const int typeSize)
+{
+	int n = size / typeSize;
+	for (int k = 0; k < typeSize; k++)
+		for (int i = 0; i < n; i++)
+			dst[i * typeSize + k] = src[k * n + i];
+	memcpy(dst + n * typeSize, src + n * typeSize, size - n * typeSize);
+}
+
+/* Write a sequence of the LZB block codec : token(literal length << 4 | match length - 4), literals, match offset. */
+static bool lzbEmit(uchar* dst, int& o, const int cap, const uchar* lit, int nLit, int offset, int nMatch)
+{
+	int extLit = (nLit >= 15) ? (nLit - 15) / 255 + 1 : 0;
+	int extMatch = (nMatch && nMatch - LZB_MIN_MATCH >= 15) ? (nMatch - LZB_MIN_MATCH - 15) / 255 + 1 : 0;
+	if (o + 1 + extLit + nLit + (nMatch ? 2 + extMatch : 0) > cap)
+		return false;
+
+	int m = nMatch ? nMatch - LZB_MIN_MATCH : 0;
+	dst[o++] = (uchar)(((nLit < 15 ? nLit : 15) << 4) | (m < 15 ? m : 15));
+	if (nLit >= 15) {
+		int r = nLit - 15;
+		for (; r >= 255; r -= 255) dst[o++] = 255;
+		dst[o++] = (uchar)r;
+	}
+	memcpy(dst + o, lit, nLit);
+	o += nLit;
+	if (nMatch) {
+		dst[o++] = (uchar)(offset & 0xFF);
+		dst[o++] = (uchar)(offset >> 8);
+		if (m >= 15) {
+			int r = m - 15;
+			for (; r >= 255; r -= 255) dst[o++] = 255;
+			dst[o++] = (uchar)r;
+		}
+	}
+	return true;
+}
+
+/* Compress a block. Returns the compressed size, or -1 if it does not fit in cap. */
+static int lzbCompress(const uchar* src, const int size, uchar* dst, const int cap)
+{
+	const int nHash = 1 << LZB_HASH_LOG;
+	int* table = new int[nHash];
+	for (int h = 0; h < nHash; h++) table[h] = -1;
+
+	int i = 0, o = 0, anchor = 0;
+	bool ok = true;
+	while (i + LZB_MIN_MATCH <= size) {
+		uint32_t seq;
+		memcpy(&seq, src + i, sizeof(seq));
+		uint32_t h = (seq * 2654435761u) >> (32 - LZB_HASH_LOG);
+		int ref = table[h];
+		table[h] = i;
+
+		if (ref < 0 || i - ref > 0xFFFF || memcmp(src + ref, src + i, LZB_MIN_MATCH) != 0) {
+			i++;
+			continue;
+		}
+		int len = LZB_MIN_MATCH;
+		while (i + len < size && src[ref + len] == src[i + len]) len++;
+
+		if (!(ok = lzbEmit(dst, o, cap, src + anchor, i - anchor, i - ref, len)))
+			break;
+		i += len;
+		anchor = i;
+	}
+	if (ok)
+		ok = lzbEmit(dst, o, cap, src + anchor, size - anchor, 0, 0);
+
+	delete[] table;
+	return ok ? o : -1;
+}
+
+static bool lzbDecompress(const uchar* src, const int size, uchar* dst, const int cap)
+{
+	int i = 0, o = 0;
+	while (i < size) {
+		int token = src[i++];
+		int nLit = token >> 4;
+		if (nLit == 15) {
+			int b;
+			do {
+				if (i >= size) return false;
+				b = src[i++];
+				nLit += b;
+			} while (b == 255);
+		}
+		if (i + nLit > size || o + nLit > cap) return false;
+		memcpy(dst + o, src + i, nLit);
+		i += nLit;
+		o += nLit;
+		if (i >= size) break;
+
+		if (i + 2 > size) return false;
+		int offset = src[i] | (src[i + 1] << 8);
+		i += 2;
+		int nMatch = token & 15;
+		if (nMatch == 15) {
+			int b;
+			do {
+				if (i >= size) return false;
+				b = src[i++];
+				nMatch += b;
+			} while (b == 255);
+		}
+		nMatch += LZB_MIN_MATCH;
+		if (offset == 0 || offset > o || o + nMatch > cap) return false;
+		for (int k = 0; k < nMatch; k++, o++)
+			dst[o] = dst[o - offset];
+	}
+	return o == cap;
+}
 
 
 /************************ OHC CODEC *****************************/
@@ -165,6 +493,11 @@ void oph::ImgCodecOhc::releaseCodeBuffer() {
 		delete[] this->buf_f64;
 		this->buf_f64 = nullptr;
 	}
+	if (this->buf_code) {
+		delete[] this->buf_code;
+		this->buf_code = nullptr;
+		this->buf_code_size = 0;
+	}
 }
 
 void oph::ImgCodecOhc::releaseFldData() {
@@ -193,6 +526,7 @@ oph::ImgDecoderOhc::ImgDecoderOhc(const std::string &_fname, const ohcHeader &_H
 
 oph::ImgDecoderOhc::~ImgDecoderOhc()
 {
+	this->closeMapped();
 	this->releaseOHCheader();
 	this->releaseFldData();
 	this->releaseCodeBuffer();
@@ -304,10 +638,11 @@ void oph::ImgDecoderOhc::getLinkFilePath(std::vector<std::string> &linkFilePath_
 		linkFilePath_array = this->linkFilePath;
 }
 
-bool oph::ImgDecoderOhc::load() {
+bool oph::ImgDecoderOhc::loadHeader() {
+	if (this->File.is_open())
+		this->File.close();
 	this->File.open(this->fname, std::ios::in | std::ios::binary);
 
-	bool isOpen = File.is_open();
 	if (this->File.is_open()) {
 		if (this->Header == nullptr)
 			this->Header = new ohcHeader();
@@ -317,6 +652,7 @@ bool oph::ImgDecoderOhc::load() {
 		File.read((char *)&FHeader.fileSignature, sizeof(FHeader.fileSignature));
 		if ((FHeader.fileSignature[0] != FMT_SIGN_OHC[0]) || (FHeader.fileSignature[1] != FMT_SIGN_OHC[1])) {
 			LOG("Not OHC File");
+			this->File.close();
 			return false;
 		}
 		else {
@@ -335,30 +671,137 @@ bool oph::ImgDecoderOhc::load() {
 		}
 
 		// Read Wavelength Table
+		WavLeng.clear();
 		for (uint n = 0; n < FldInfo.wavlenNum; ++n) {
 			double_t waveLength = 0.0;
 			File.read((char *)&waveLength, sizeof(waveLength));
 			WavLeng.push_back(waveLength);
 		}
 
+		// Read Codec Header and Block Table of quantized or compressed field data
+		CInfo = ohcCodecHeader();
+		Header->blockTable.clear();
+		Header->frameInfo = ohcFrameIndexHeader();
+		Header->frameTable.clear();
+		if (FldInfo.fldStore == FldStore::Frames) {
+			// Read Frame Index : each frame keeps its own Codec Header
+			File.seekg(sizeof(ohcFileHeader) + FldInfo.headerSize, ios::beg);
+			File.read((char *)&Header->frameInfo, sizeof(ohcFrameIndexHeader));
+			if (File.gcount() != sizeof(ohcFrameIndexHeader)) {
+				LOG("Error : Invalid Frame Index Header");
+				this->File.close();
+				return false;
+			}
+			if (Header->frameInfo.indexOffBytes != 0) {
+				Header->frameTable.resize(Header->frameInfo.frameNum);
+				File.seekg(Header->frameInfo.indexOffBytes, ios::beg);
+				if (Header->frameInfo.frameNum)
+					File.read((char *)Header->frameTable.data(), Header->frameInfo.frameNum * sizeof(ohcFrameEntry));
+				if (File.gcount() != (std::streamsize)(Header->frameInfo.frameNum * sizeof(ohcFrameEntry)))
+					Header->frameTable.clear();
+			}
+			if (Header->frameTable.size() != Header->frameInfo.frameNum || Header->frameInfo.indexOffBytes == 0) {
+				if (!scanFrames()) {
+					LOG("Error : Invalid Frame Index");
+					this->File.close();
+					return false;
+				}
+			}
+		}
+		else if (FldInfo.cmplxFldType != DataType::Float32 && FldInfo.cmplxFldType != DataType::Float64) {
+			File.seekg(sizeof(ohcFileHeader) + FldInfo.headerSize, ios::beg);
+			File.read((char *)&CInfo, sizeof(CInfo));
+			if (File.gcount() != sizeof(CInfo) || CInfo.codecSize != sizeof(ohcCodecHeader) + CInfo.blockNum * sizeof(uint32_t)) {
+				LOG("Error : Invalid Codec Header");
+				this->File.close();
+				return false;
+			}
+			Header->blockTable.resize(CInfo.blockNum);
+			if (CInfo.blockNum)
+				File.read((char *)Header->blockTable.data(), CInfo.blockNum * sizeof(uint32_t));
+		}
+
+		// Header information is valid from here
+		this->bLoadFile = true;
+		return true;
+	}
+	else {
+		LOG("Error : Failed loading OHC file...");
+		return false;
+	}
+}
+
+bool oph::ImgDecoderOhc::loadFieldData(Complex<Real>** cmplx_field) {
+	if (!this->File.is_open() || !this->bLoadFile) {
+		LOG("OHC CODEC Error : No loaded header. Call loadHeader() first.");
+		return false;
+	}
+
+	auto start = CUR_TIME;
+
+	bool ok = false;
+	if (FldInfo.fldStore == FldStore::Frames)
+		ok = readFrame(0, cmplx_field);
+	else switch (FldInfo.cmplxFldType) {
+	case DataType::Float64:
+	case DataType::Float32:
+		ok = decodeFieldData(cmplx_field);
+		break;
+	default:
+		ok = decodeCodedFieldData(cmplx_field, FHeader.fileOffBytes);
+		break;
+	}
+	this->File.close();
+
+	auto end = CUR_TIME;
+	LOG("%s : %.5lfsec...%s\n", __FUNCTION__, ((std::chrono::duration<Real>)(end - start)).count(), ok ? "done" : "failed");
+	return ok;
+}
+
+bool oph::ImgDecoderOhc::load() {
+	if (this->loadHeader()) {
+		this->bLoadFile = false;
+
 		// Decoding Field Data
 		bool ok = false;
-		switch (FldInfo.cmplxFldType) {
+		DataType fldType = (FldInfo.fldStore == FldStore::Frames) ? DataType::CmprFmt : FldInfo.cmplxFldType;
+		switch (fldType) {
 		case DataType::Float64:
 		case DataType::Float32:
 			ok = decodeFieldData();
 			break;
-		case DataType::CmprFmt:
-			LOG("Error : Compressed Image Format Decoding is Not Yet supported...");
-			this->File.close();
-			return false;
-			break;
-		default:
-			LOG("Error : Invalid Decoding Complex Field Data Type...");
-			this->File.close();
-			return false;
+		default: {
+			// Quantized or compressed data, or the first frame, is restored to complex field
+			ivec2 pxNum(FldInfo.pxNumX, FldInfo.pxNumY);
+			ulonglong n_pixels = (ulonglong)pxNum[_X] * pxNum[_Y];
+			Complex<Real>** cmplx = new Complex<Real>*[FldInfo.wavlenNum];
+			for (uint c = 0; c < FldInfo.wavlenNum; c++) {
+				cmplx[c] = new Complex<Real>[n_pixels];
+				memset(cmplx[c], 0, sizeof(Complex<Real>) * n_pixels);
+			}
+			if (FldInfo.fldStore == FldStore::Frames) {
+				this->bLoadFile = true;
+				ok = readFrame(0, cmplx);
+				this->bLoadFile = ok;
+			}
+			else
+				ok = decodeCodedFieldData(cmplx, FHeader.fileOffBytes);
+			for (uint c = 0; c < FldInfo.wavlenNum; c++) {
+				if (ok) {
+					OphComplexField data_field(pxNum[_X], pxNum[_Y]);
+					oph::Buffer2Field(cmplx[c], data_field, pxNum);
+					this->field_cmplx.push_back(data_field);
+				}
+				delete[] cmplx[c];
+			}
+			delete[] cmplx;
+			if (!ok) {
+				this->File.close();
+				return false;
+			}
 			break;
 		}
+		}
 		//switch (FldInfo.cmplxFldType) {
 		//case DataType::Float64:
 		//	ok = decodeFieldData<double_t>();
@@ -406,10 +849,8 @@ bool oph::ImgDecoderOhc::load() {
 		this->File.close();
 		return true;
 	}
-	else {
-		LOG("Error : Failed loading OHC file...");
+	else
 		return false;
-	}
 }
 
 void oph::ImgDecoderOhc::fieldToComplex(void)
@@ -606,6 +1047,601 @@ bool oph::ImgDecoderOhc::decodeFieldData()
 	}
 }
 
+/* Scatter one component(0 : real or amplitude or phase-only, 1 : imaginary or phase) of a chunk to the complex buffers. */
+template<typename T>
+static void scatterOhcChunk(const T* src, int count, ulonglong first, int comp, FldCodeType code,
+	bool bSeqt, int n_wavlens, ulonglong n_pixels, Real scale, Real offset, Complex<Real>** dst)
+{
+	int i;
+#ifdef _OPENMP
+#pragma omp parallel for private(i)
+#endif
+	for (i = 0; i < count; i++) {
+		ulonglong j = first + i;
+		int c = bSeqt ? (int)(j % n_wavlens) : (int)(j / n_pixels);
+		ulonglong p = bSeqt ? j / n_wavlens : j % n_pixels;
+		Complex<Real>& d = dst[c][p];
+		Real v = ohcValue(src[i]) * scale + offset;
+
+		if (code == FldCodeType::RI || (code == FldCodeType::AP && comp == 0)) {
+			d[comp] = v;
+		}
+		else if (code == FldCodeType::AP) {
+			Real a = d[_RE];
+			d[_RE] = a * cos(v);
+			d[_IM] = a * sin(v);
+		}
+		else if (code == FldCodeType::AE) {
+			d[_RE] = v;
+			d[_IM] = 0;
+		}
+		else if (code == FldCodeType::PE) {
+			d[_RE] = cos(v);
+			d[_IM] = sin(v);
+		}
+	}
+}
+
+/* Stored value = value * scale + offset */
+static void scatterOhcValues(const DataType type, const uchar* src, int count, ulonglong first, int comp, FldCodeType code,
+	bool bSeqt, int n_wavlens, ulonglong n_pixels, Real scale, Real offset, Complex<Real>** dst)
+{
+	switch (type) {
+	case DataType::Int8: scatterOhcChunk((const int8_t*)src, count, first, comp, code, bSeqt, n_wavlens, n_pixels, scale, offset, dst); break;
+	case DataType::Int16: scatterOhcChunk((const int16_t*)src, count, first, comp, code, bSeqt, n_wavlens, n_pixels, scale, offset, dst); break;
+	case DataType::Int32: scatterOhcChunk((const int32_t*)src, count, first, comp, code, bSeqt, n_wavlens, n_pixels, scale, offset, dst); break;
+	case DataType::Int64: scatterOhcChunk((const int64_t*)src, count, first, comp, code, bSeqt, n_wavlens, n_pixels, scale, offset, dst); break;
+	case DataType::Uint8: scatterOhcChunk((const uint8_t*)src, count, first, comp, code, bSeqt, n_wavlens, n_pixels, scale, offset, dst); break;
+	case DataType::Uint16: scatterOhcChunk((const uint16_t*)src, count, first, comp, code, bSeqt, n_wavlens, n_pixels, scale, offset, dst); break;
+	case DataType::Uint32: scatterOhcChunk((const uint32_t*)src, count, first, comp, code, bSeqt, n_wavlens, n_pixels, scale, offset, dst); break;
+	case DataType::Uint64: scatterOhcChunk((const uint64_t*)src, count, first, comp, code, bSeqt, n_wavlens, n_pixels, scale, offset, dst); break;
+	case DataType::Float16: scatterOhcChunk((const ohcHalf*)src, count, first, comp, code, bSeqt, n_wavlens, n_pixels, scale, offset, dst); break;
+	case DataType::Float32: scatterOhcChunk((const float*)src, count, first, comp, code, bSeqt, n_wavlens, n_pixels, scale, offset, dst); break;
+	case DataType::Float64: scatterOhcChunk((const double*)src, count, first, comp, code, bSeqt, n_wavlens, n_pixels, scale, offset, dst); break;
+	default: break;
+	}
+}
+
+/* Scale and offset restoring the value of each complex channel from an integer 'storeType' */
+static void ohcDequantize(const ohcCodecHeader& codec, Real scale[2], Real offset[2])
+{
+	double min_T, max_T;
+	bool bInteger = ohcIntegerRange(codec.storeType, min_T, max_T);
+	for (int comp = 0; comp < 2; comp++) {
+		scale[comp] = bInteger ? (codec.rangeMax[comp] - codec.rangeMin[comp]) / (max_T - min_T) : 1;
+		offset[comp] = bInteger ? codec.rangeMin[comp] - min_T * scale[comp] : 0;
+	}
+}
+
+bool oph::ImgDecoderOhc::decodeFieldData(Complex<Real>** cmplx_field)
+{
+	int n_wavlens = FldInfo.wavlenNum;
+	ulonglong n_pixels = (ulonglong)FldInfo.pxNumX * FldInfo.pxNumY;
+	ulonglong n_fields = n_pixels * n_wavlens;
+
+	if (FldInfo.fldStore == FldStore::Null) FldInfo.fldStore = FldStore::Directly;
+	if (FldInfo.fldStore != FldStore::Directly) {
+		LOG("Error : Link Image File Decoding is Not Yet supported...\n");
+		return false;
+	}
+	if (cmplx_field == nullptr) {
+		LOG("Error : No Complex Field Buffer...\n");
+		return false;
+	}
+
+	int n_cmplxChnl = 0; // Is a data value Dual data(2) or Single data(1) ?
+	switch (FldInfo.fldCodeType) {
+	case FldCodeType::RI:
+	case FldCodeType::AP:
+		n_cmplxChnl = 2;
+		break;
+	case FldCodeType::AE:
+	case FldCodeType::PE:
+		n_cmplxChnl = 1;
+		break;
+	default:
+		LOG("Error : Invalid Complex Field Encoding Type...\n");
+		return false;
+	}
+
+	if (FHeader.fileOffBytes != (uint32_t)-1)
+		File.seekg(FHeader.fileOffBytes, ios::beg);
+
+	// Disk order of each component is the same linear order as the buffers, so no transposition is needed.
+	const bool bSeqt = (FldInfo.clrArrange == ColorArran::SeqtChanl);
+	const size_t typeSize = ohcTypeSize(FldInfo.cmplxFldType);
+	const ulonglong nChunk = OHC_BULK_CHUNK;
+	char* chunk = new char[nChunk * typeSize];
+
+	bool ok = true;
+	for (int comp = 0; comp < n_cmplxChnl && ok; comp++) {
+		for (ulonglong first = 0; first < n_fields; first += nChunk) {
+			int count = (int)((n_fields - first < nChunk) ? n_fields - first : nChunk);
+			File.read(chunk, count * typeSize);
+			if (File.gcount() != (std::streamsize)(count * typeSize)) {
+				LOG("Error : Field Data is Truncated...\n");
+				ok = false;
+				break;
+			}
+			scatterOhcValues(FldInfo.cmplxFldType, (uchar*)chunk, count, first, comp, FldInfo.fldCodeType, bSeqt, n_wavlens, n_pixels, 1, 0, cmplx_field);
+		}
+	}
+	delete[] chunk;
+
+	return ok;
+}
+
+bool oph::ImgDecoderOhc::decodeCodedFieldData(Complex<Real>** cmplx_field, const ulonglong offBytes)
+{
+	int n_wavlens = FldInfo.wavlenNum;
+	ulonglong n_pixels = (ulonglong)FldInfo.pxNumX * FldInfo.pxNumY;
+	ulonglong n_fields = n_pixels * n_wavlens;
+
+	if (FldInfo.fldStore == FldStore::Null) FldInfo.fldStore = FldStore::Directly;
+	if (FldInfo.fldStore == FldStore::LinkFile) {
+		LOG("Error : Link Image File Decoding is Not Yet supported...\n");
+		return false;
+	}
+	if (cmplx_field == nullptr) {
+		LOG("Error : No Complex Field Buffer...\n");
+		return false;
+	}
+
+	// A frame is compressed on its own, so the block size decides it
+	const bool bCompress = (CInfo.blockSize != 0);
+	if ((FldInfo.cmplxFldType == DataType::CmprFmt && !bCompress) ||
+		(bCompress && FldInfo.comprsType != CompresType::LZB && FldInfo.fldStore != FldStore::Frames)) {
+		LOG("Error : Compressed Image Format Decoding is Not Yet supported...\n");
+		return false;
+	}
+	const size_t typeSize = ohcTypeSize(CInfo.storeType);
+	if (typeSize == 0 || (FldInfo.cmplxFldType != DataType::CmprFmt && CInfo.storeType != FldInfo.cmplxFldType)) {
+		LOG("Error : Invalid Decoding Complex Field Data Type...\n");
+		return false;
+	}
+
+	int n_cmplxChnl = 0; // Is a data value Dual data(2) or Single data(1) ?
+	switch (FldInfo.fldCodeType) {
+	case FldCodeType::RI:
+	case FldCodeType::AP:
+		n_cmplxChnl = 2;
+		break;
+	case FldCodeType::AE:
+	case FldCodeType::PE:
+		n_cmplxChnl = 1;
+		break;
+	default:
+		LOG("Error : Invalid Complex Field Encoding Type...\n");
+		return false;
+	}
+
+	const ulonglong rawSize = n_fields * n_cmplxChnl * typeSize;
+	if (CInfo.rawSize != rawSize) {
+		LOG("Error : Invalid Field Data Size...\n");
+		return false;
+	}
+
+	File.seekg(offBytes, ios::beg);
+	uchar* raw = new uchar[rawSize];
+	bool ok = true;
+
+	if (!bCompress) {
+		File.read((char*)raw, rawSize);
+		ok = (File.gcount() == (std::streamsize)rawSize);
+	}
+	else {
+		const int nBlock = (int)CInfo.blockNum;
+		const ulonglong blockSize = CInfo.blockSize;
+		std::vector<ulonglong> offset(nBlock + 1, 0);
+		for (int b = 0; b < nBlock && b < (int)Header->blockTable.size(); b++)
+			offset[b + 1] = offset[b] + Header->blockTable[b];
+
+		if ((ulonglong)nBlock * blockSize < rawSize || Header->blockTable.size() != (size_t)nBlock) {
+			ok = false;
+		}
+		else {
+			uchar* stored = new uchar[offset[nBlock]];
+			File.read((char*)stored, offset[nBlock]);
+			ok = (File.gcount() == (std::streamsize)offset[nBlock]);
+
+			// each block is decoded independently
+			std::vector<uchar> blockOK(nBlock, 1);
+			int b;
+#ifdef _OPENMP
+#pragma omp parallel for private(b) schedule(dynamic)
+#endif
+			for (b = 0; b < nBlock; b++) {
+				if (!ok) continue;
+				int len = (int)((rawSize - b * blockSize < blockSize) ? rawSize - b * blockSize : blockSize);
+				uchar* shuffled = new uchar[len];
+				if (Header->blockTable[b] == (uint32_t)len)
+					memcpy(shuffled, stored + offset[b], len);
+				else if (!lzbDecompress(stored + offset[b], (int)Header->blockTable[b], shuffled, len))
+					blockOK[b] = 0;
+				ohcUnshuffle(shuffled, raw + b * blockSize, len, (int)typeSize);
+				delete[] shuffled;
+			}
+			for (b = 0; b < nBlock; b++)
+				if (!blockOK[b]) ok = false;
+			delete[] stored;
+		}
+	}
+
+	if (ok) {
+		Real scale[2], offset[2];
+		ohcDequantize(CInfo, scale, offset);
+
+		const bool bSeqt = (FldInfo.clrArrange == ColorArran::SeqtChanl);
+		const ulonglong nChunk = OHC_BULK_CHUNK;
+		for (int comp = 0; comp < n_cmplxChnl; comp++) {
+			const uchar* src = raw + comp * n_fields * typeSize;
+			for (ulonglong first = 0; first < n_fields; first += nChunk) {
+				int count = (int)((n_fields - first < nChunk) ? n_fields - first : nChunk);
+				scatterOhcValues(CInfo.storeType, src + first * typeSize, count, first, comp, FldInfo.fldCodeType,
+					bSeqt, n_wavlens, n_pixels, scale[comp], offset[comp], cmplx_field);
+			}
+		}
+	}
+	else
+		LOG("Error : Field Data is Corrupted...\n");
+
+	delete[] raw;
+	return ok;
+}
+
+/* Rebuild the frame index of a container whose writer did not reach closeFrames() */
+bool oph::ImgDecoderOhc::scanFrames()
+{
+	Header->frameTable.clear();
+
+	File.clear();
+	File.seekg(0, ios::end);
+	ulonglong fileSize = (ulonglong)File.tellg();
+	ulonglong off = FHeader.fileOffBytes;
+
+	while (off + sizeof(ohcCodecHeader) <= fileSize) {
+		ohcCodecHeader codec;
+		File.seekg(off, ios::beg);
+		File.read((char *)&codec, sizeof(codec));
+		if (File.gcount() != sizeof(codec) || codec.codecSize != sizeof(ohcCodecHeader) + codec.blockNum * sizeof(uint32_t))
+			break;
+
+		ulonglong dataSize = codec.rawSize;
+		if (codec.blockNum) {
+			std::vector<uint32_t> table(codec.blockNum);
+			File.read((char *)table.data(), codec.blockNum * sizeof(uint32_t));
+			dataSize = 0;
+			for (uint b = 0; b < codec.blockNum; b++)
+				dataSize += table[b];
+		}
+		if (off + codec.codecSize + dataSize > fileSize)
+			break;
+
+		ohcFrameEntry entry;
+		entry.offBytes = off;
+		entry.size = codec.codecSize + dataSize;
+		Header->frameTable.push_back(entry);
+		off += entry.size;
+	}
+	File.clear();
+	Header->frameInfo.frameNum = (uint32_t)Header->frameTable.size();
+
+	return !Header->frameTable.empty();
+}
+
+uint oph::ImgDecoderOhc::getNumOfFrame()
+{
+	if (this->Header == nullptr || !this->bLoadFile)
+		return 0;
+	if (FldInfo.fldStore != FldStore::Frames)
+		return 1;
+	return (uint)Header->frameTable.size();
+}
+
+bool oph::ImgDecoderOhc::readFrame(const uint frame_idx, Complex<Real>** cmplx_field)
+{
+	if (!this->File.is_open() || !this->bLoadFile) {
+		LOG("OHC CODEC Error : No loaded header. Call loadHeader() first.");
+		return false;
+	}
+	if (FldInfo.fldStore != FldStore::Frames) {
+		if (frame_idx != 0) return false;
+		return (FldInfo.cmplxFldType == DataType::Float32 || FldInfo.cmplxFldType == DataType::Float64) ?
+			decodeFieldData(cmplx_field) : decodeCodedFieldData(cmplx_field, FHeader.fileOffBytes);
+	}
+	if (frame_idx >= Header->frameTable.size()) {
+		LOG("Error : Invalid Frame Index...\n");
+		return false;
+	}
+
+	// Codec Header and Block Table of the frame
+	const ohcFrameEntry& entry = Header->frameTable[frame_idx];
+	File.clear();
+	File.seekg(entry.offBytes, ios::beg);
+	File.read((char *)&CInfo, sizeof(CInfo));
+	if (File.gcount() != sizeof(CInfo) || CInfo.codecSize != sizeof(ohcCodecHeader) + CInfo.blockNum * sizeof(uint32_t)) {
+		LOG("Error : Invalid Codec Header");
+		return false;
+	}
+	Header->blockTable.resize(CInfo.blockNum);
+	if (CInfo.blockNum)
+		File.read((char *)Header->blockTable.data(), CInfo.blockNum * sizeof(uint32_t));
+
+	return decodeCodedFieldData(cmplx_field, entry.offBytes + CInfo.codecSize);
+}
+
+/* Read one stored value of the mapped field. The view is not aligned to the data type. */
+static inline Real readOhcValue(const uchar* src, const DataType type)
+{
+	switch (type) {
+	case DataType::Int8: return (Real)*(const int8_t*)src;
+	case DataType::Uint8: return (Real)*src;
+	case DataType::Int16: { int16_t v; memcpy(&v, src, sizeof(v)); return (Real)v; }
+	case DataType::Uint16: { uint16_t v; memcpy(&v, src, sizeof(v)); return (Real)v; }
+	case DataType::Float16: { uint16_t v; memcpy(&v, src, sizeof(v)); return (Real)halfToFloat(v); }
+	case DataType::Int32: { int32_t v; memcpy(&v, src, sizeof(v)); return (Real)v; }
+	case DataType::Uint32: { uint32_t v; memcpy(&v, src, sizeof(v)); return (Real)v; }
+	case DataType::Float32: { float v; memcpy(&v, src, sizeof(v)); return (Real)v; }
+	case DataType::Int64: { int64_t v; memcpy(&v, src, sizeof(v)); return (Real)v; }
+	case DataType::Uint64: { uint64_t v; memcpy(&v, src, sizeof(v)); return (Real)v; }
+	case DataType::Float64: { double v; memcpy(&v, src, sizeof(v)); return (Real)v; }
+	default: return 0;
+	}
+}
+
+#define OHC_TILE_KEY(w, tx, ty) (((ulonglong)(w) << 48) | ((ulonglong)(ty) << 24) | (ulonglong)(tx))
+
+bool oph::ImgDecoderOhc::openMapped(const uint _tileSize, const ulonglong cacheBytes)
+{
+	if (this->mapView != nullptr && this->mapName == this->fname)
+		return true;
+
+	this->closeMapped();
+	if (!this->loadHeader())
+		return false;
+	this->File.close();
+
+	if (FldInfo.fldStore == FldStore::Frames) {
+		LOG("Error : Mapped reader does not support multi-frame field data. Use readFrame()...\n");
+		return false;
+	}
+	if (FldInfo.fldStore != FldStore::Directly && FldInfo.fldStore != FldStore::Null) {
+		LOG("Error : Link Image File Decoding is Not Yet supported...\n");
+		return false;
+	}
+	if (FldInfo.cmplxFldType == DataType::CmprFmt) {
+		LOG("Error : Mapped reader does not support compressed field data...\n");
+		return false;
+	}
+	this->mapType = FldInfo.cmplxFldType;
+	ohcDequantize(CInfo, this->mapScale, this->mapOffset);
+	if (this->mapType == DataType::Float32 || this->mapType == DataType::Float64) {
+		this->mapScale[0] = this->mapScale[1] = 1;
+		this->mapOffset[0] = this->mapOffset[1] = 0;
+	}
+	if (ohcTypeSize(this->mapType) == 0) {
+		LOG("Error : Invalid Decoding Complex Field Data Type...\n");
+		return false;
+	}
+
+	int n_cmplxChnl = 0;
+	switch (FldInfo.fldCodeType) {
+	case FldCodeType::RI:
+	case FldCodeType::AP:
+		n_cmplxChnl = 2;
+		break;
+	case FldCodeType::AE:
+	case FldCodeType::PE:
+		n_cmplxChnl = 1;
+		break;
+	default:
+		LOG("Error : Invalid Complex Field Encoding Type...\n");
+		return false;
+	}
+
+	unsigned long long size = 0;
+	this->mapView = file_map_read(this->fname.c_str(), &size);
+	if (this->mapView == nullptr) {
+		LOG("Error : Failed mapping OHC file...\n");
+		return false;
+	}
+	this->mapSize = size;
+
+	size_t typeSize = ohcTypeSize(this->mapType);
+	ulonglong fieldBytes = (ulonglong)FldInfo.pxNumX * FldInfo.pxNumY * FldInfo.wavlenNum * n_cmplxChnl * typeSize;
+	if (FHeader.fileOffBytes == (uint32_t)-1 || FHeader.fileOffBytes + fieldBytes > this->mapSize) {
+		LOG("Error : Field Data is Truncated...\n");
+		this->closeMapped();
+		return false;
+	}
+
+	this->mapName = this->fname;
+	this->tileSize = (_tileSize > 0) ? _tileSize : 256;
+	this->tileBudget = cacheBytes / (sizeof(Complex<Real>) * this->tileSize * this->tileSize);
+	if (this->tileBudget < 1) this->tileBudget = 1;
+
+	return true;
+}
+
+void oph::ImgDecoderOhc::closeMapped()
+{
+	this->releaseTiles();
+	if (this->mapView != nullptr) {
+		file_unmap(this->mapView, this->mapSize);
+		this->mapView = nullptr;
+		this->mapSize = 0;
+	}
+	this->mapName.clear();
+}
+
+void oph::ImgDecoderOhc::releaseTiles()
+{
+	for (auto it = this->tiles.begin(); it != this->tiles.end(); ++it)
+		delete[] it->second.data;
+	this->tiles.clear();
+	this->tileLRU.clear();
+}
+
+const uchar* oph::ImgDecoderOhc::mappedAddress(const uint wavelen_idx, const ulonglong pixel, const int comp)
+{
+	ulonglong n_pixels = (ulonglong)FldInfo.pxNumX * FldInfo.pxNumY;
+	ulonglong n_fields = n_pixels * FldInfo.wavlenNum;
+	ulonglong idx = (FldInfo.clrArrange == ColorArran::SeqtChanl) ?
+		FldInfo.wavlenNum * pixel + wavelen_idx : wavelen_idx * n_pixels + pixel;
+	size_t typeSize = ohcTypeSize(this->mapType);
+
+	return this->mapView + FHeader.fileOffBytes + (comp * n_fields + idx) * typeSize;
+}
+
+void oph::ImgDecoderOhc::decodeTile(const uint wavelen_idx, const int tx, const int ty, Complex<Real>* data)
+{
+	const int cols = FldInfo.pxNumX;
+	const int rows = FldInfo.pxNumY;
+	const int T = this->tileSize;
+	const int x0 = tx * T;
+	const int y0 = ty * T;
+	const int w = (x0 + T < cols) ? T : cols - x0;
+	const int h = (y0 + T < rows) ? T : rows - y0;
+	const DataType type = this->mapType;
+	const FldCodeType code = FldInfo.fldCodeType;
+	const Real* scale = this->mapScale;
+	const Real* offset = this->mapOffset;
+
+	// tiles keep the x-major order of the file : pixel (x, y) at x * T + y
+	for (int x = 0; x < w; x++) {
+		for (int y = 0; y < h; y++) {
+			ulonglong pixel = (ulonglong)(x0 + x) * rows + y0 + y;
+			Real v0 = readOhcValue(mappedAddress(wavelen_idx, pixel, 0), type) * scale[0] + offset[0];
+			Complex<Real>& d = data[x * T + y];
+
+			if (code == FldCodeType::RI) {
+				d[_RE] = v0;
+				d[_IM] = readOhcValue(mappedAddress(wavelen_idx, pixel, 1), type) * scale[1] + offset[1];
+			}
+			else if (code == FldCodeType::AP) {
+				Real p = readOhcValue(mappedAddress(wavelen_idx, pixel, 1), type) * scale[1] + offset[1];
+				d[_RE] = v0 * cos(p);
+				d[_IM] = v0 * sin(p);
+			}
+			else if (code == FldCodeType::AE) {
+				d[_RE] = v0;
+				d[_IM] = 0;
+			}
+			else {
+				d[_RE] = cos(v0);
+				d[_IM] = sin(v0);
+			}
+		}
+	}
+}
+
+bool oph::ImgDecoderOhc::readRegion(const uint wavelen_idx, const ivec2 origin, const ivec2 size, Complex<Real>* dst)
+{
+	if (this->mapView == nullptr) {
+		LOG("OHC CODEC Error : No mapped file. Call openMapped() first.");
+		return false;
+	}
+	if (wavelen_idx >= FldInfo.wavlenNum || dst == nullptr ||
+		origin[_X] < 0 || origin[_Y] < 0 || size[_X] <= 0 || size[_Y] <= 0 ||
+		origin[_X] + size[_X] > (int)FldInfo.pxNumX || origin[_Y] + size[_Y] > (int)FldInfo.pxNumY) {
+		LOG("OHC CODEC Error : Invalid region.");
+		return false;
+	}
+
+	const int T = this->tileSize;
+	const int tx0 = origin[_X] / T;
+	const int ty0 = origin[_Y] / T;
+	const int tx1 = (origin[_X] + size[_X] - 1) / T;
+	const int ty1 = (origin[_Y] + size[_Y] - 1) / T;
+
+	// decode the tiles which are not cached yet
+	std::vector<ulonglong> missing;
+	for (int ty = ty0; ty <= ty1; ty++) {
+		for (int tx = tx0; tx <= tx1; tx++) {
+			ulonglong key = OHC_TILE_KEY(wavelen_idx, tx, ty);
+			auto it = this->tiles.find(key);
+			if (it == this->tiles.end())
+				missing.push_back(key);
+			else
+				this->tileLRU.splice(this->tileLRU.begin(), this->tileLRU, it->second.lru);
+		}
+	}
+
+	int nMissing = (int)missing.size();
+	std::vector<Complex<Real>*> decoded(nMissing);
+	int i;
+#ifdef _OPENMP
+#pragma omp parallel for private(i) schedule(dynamic)
+#endif
+	for (i = 0; i < nMissing; i++) {
+		decoded[i] = new Complex<Real>[T * T];
+		decodeTile(wavelen_idx, (int)(missing[i] & 0xFFFFFF), (int)((missing[i] >> 24) & 0xFFFFFF), decoded[i]);
+	}
+	for (i = 0; i < nMissing; i++) {
+		this->tileLRU.push_front(missing[i]);
+		OhcTile tile;
+		tile.data = decoded[i];
+		tile.lru = this->tileLRU.begin();
+		this->tiles[missing[i]] = tile;
+	}
+
+	// gather the region from the tiles, one column (contiguous along y) at a time
+	int x;
+#ifdef _OPENMP
+#pragma omp parallel for private(x)
+#endif
+	for (x = 0; x < size[_X]; x++) {
+		int gx = origin[_X] + x;
+		int gy = origin[_Y];
+		int end = origin[_Y] + size[_Y];
+		Complex<Real>* col = dst + (ulonglong)x * size[_Y];
+		while (gy < end) {
+			int ty = gy / T;
+			int n = ((ty + 1) * T < end) ? (ty + 1) * T - gy : end - gy;
+			const Complex<Real>* src = this->tiles.find(OHC_TILE_KEY(wavelen_idx, gx / T, ty))->second.data + (gx % T) * T + (gy % T);
+			memcpy(col + (gy - origin[_Y]), src, sizeof(Complex<Real>) * n);
+			gy += n;
+		}
+	}
+
+	// evict the least recently used tiles, but never the tiles of this region
+	ulonglong nRegion = (ulonglong)(tx1 - tx0 + 1) * (ty1 - ty0 + 1);
+	ulonglong nKeep = (this->tileBudget > nRegion) ? this->tileBudget : nRegion;
+	while (this->tiles.size() > nKeep) {
+		ulonglong key = this->tileLRU.back();
+		this->tileLRU.pop_back();
+		delete[] this->tiles[key].data;
+		this->tiles.erase(key);
+	}
+
+	return true;
+}
+
+void oph::ImgDecoderOhc::prefetchRegion(const uint wavelen_idx, const ivec2 origin, const ivec2 size)
+{
+	if (this->mapView == nullptr || wavelen_idx >= FldInfo.wavlenNum ||
+		origin[_X] < 0 || origin[_Y] < 0 || size[_X] <= 0 || size[_Y] <= 0 ||
+		origin[_X] + size[_X] > (int)FldInfo.pxNumX || origin[_Y] + size[_Y] > (int)FldInfo.pxNumY)
+		return;
+
+	const int rows = FldInfo.pxNumY;
+	const int n_cmplxChnl = (FldInfo.fldCodeType == FldCodeType::RI || FldInfo.fldCodeType == FldCodeType::AP) ? 2 : 1;
+	const bool bFullCol = (size[_Y] == rows);
+	const size_t typeSize = ohcTypeSize(this->mapType);
+
+	// the file is x-major, so columns spanning the whole height are contiguous and are hinted at once
+	for (int comp = 0; comp < n_cmplxChnl; comp++) {
+		for (int x = origin[_X]; x < origin[_X] + size[_X]; x++) {
+			ulonglong first = (ulonglong)x * rows + origin[_Y];
+			ulonglong last = bFullCol ? (ulonglong)(origin[_X] + size[_X] - 1) * rows + rows - 1 : first + size[_Y] - 1;
+			const uchar* begin = mappedAddress(wavelen_idx, first, comp);
+			const uchar* end = mappedAddress(wavelen_idx, last, comp);
+			file_map_prefetch(begin, (ulonglong)(end - begin) + typeSize);
+			if (bFullCol) break;
+		}
+	}
+}
+
 //template<typename T>
 //bool oph::ImgDecoderOhc::decodeFieldData() {
 //	// Data Type Info for Decoding
@@ -834,6 +1870,8 @@ oph::ImgEncoderOhc::ImgEncoderOhc(const std::string &_fname)
 
 oph::ImgEncoderOhc::~ImgEncoderOhc()
 {
+	if (this->bFrames)
+		this->closeFrames();
 	this->releaseOHCheader();
 	this->releaseFldData();
 	this->releaseCodeBuffer();
@@ -999,15 +2037,25 @@ void oph::ImgEncoderOhc::setPhaseEncoding(const BPhaseCode _bPhaseCode, const ve
 	}
 }
 
-//void oph::ImgEncoderOhc::setCompressedFormatType(const CompresType _comprsType) {
-//	if (this->Header == nullptr) {
-//		LOG("OHC CODEC Error : No header data.");
-//		return;
-//	}
-//	else {
-//		FldInfo.comprsType = _comprsType;
-//	}	
-//}
+void oph::ImgEncoderOhc::setFieldDataType(const DataType _cmplxFldType) {
+	if (this->Header == nullptr) {
+		LOG("OHC CODEC Error : No header data.");
+		return;
+	}
+	else {
+		FldInfo.cmplxFldType = _cmplxFldType;
+	}
+}
+
+void oph::ImgEncoderOhc::setCompressedFormatType(const CompresType _comprsType) {
+	if (this->Header == nullptr) {
+		LOG("OHC CODEC Error : No header data.");
+		return;
+	}
+	else {
+		FldInfo.comprsType = _comprsType;
+	}	
+}
 
 void oph::ImgEncoderOhc::setWavelength(const Real _wavlen, const LenUnit _unit) {
 	this->addWavelength(_wavlen);
@@ -1071,19 +2119,32 @@ bool oph::ImgEncoderOhc::save() {
 		}
 
 		// Encoding Field Data
+		const DataType storeType = FldInfo.cmplxFldType;
+		const bool bCompress = (FldInfo.comprsType == CompresType::LZB);
+		if (FldInfo.comprsType != CompresType::Null && !bCompress) {
+			LOG("Error : Compressed Image Format Encoding is Not Yet supported...");
+			this->File.close();
+			return false;
+		}
+		const bool bCoded = bCompress || (storeType != DataType::Float32 && storeType != DataType::Float64);
+
 		uint64_t dataSize = 0;
-		switch (FldInfo.cmplxFldType) {
+		switch (storeType) {
 		case DataType::Float64:
 		case DataType::Float32:
-			dataSize = encodeFieldData();
+			dataSize = bCoded ? encodeCodedFieldData(storeType, bCompress) : encodeFieldData();
 			break;
 		case DataType::CmprFmt:
-			LOG("Error : Compressed Image Format Encoding is Not Yet supported...");
+			LOG("Error : Set the data type before compression and CompresType::LZB instead of CmprFmt...");
 			//fclose(fp);
 			this->File.close();
 			return false;
 			break;
 		default:
+			if (ohcTypeSize(storeType) != 0) {
+				dataSize = encodeCodedFieldData(storeType, bCompress);
+				break;
+			}
 			LOG("Error : Invalid Encoding Complex Field Data Type...");
 			//fclose(fp);
 			this->File.close();
@@ -1145,14 +2206,17 @@ bool oph::ImgEncoderOhc::save() {
 			return false;
 		}
 		else {
-			if (FldInfo.cmplxFldType != DataType::CmprFmt)
+			if (!bCoded)
 				FldInfo.comprsType = CompresType::Null;
+			else if (bCompress)
+				FldInfo.cmplxFldType = DataType::CmprFmt;
 
+			uint32_t codecSize = bCoded ? CInfo.codecSize : 0;
 			FldInfo.headerSize = (uint32_t)(sizeof(ohcFieldInfoHeader) + wavlenTableSize);
 			FldInfo.fldSize = dataSize;
 			// Wrong size
-			FHeader.fileSize = sizeof(ohcFileHeader) + FldInfo.headerSize + FldInfo.fldSize;
-			FHeader.fileOffBytes = sizeof(ohcFileHeader) + FldInfo.headerSize;
+			FHeader.fileSize = sizeof(ohcFileHeader) + FldInfo.headerSize + codecSize + FldInfo.fldSize;
+			FHeader.fileOffBytes = sizeof(ohcFileHeader) + FldInfo.headerSize + codecSize;
 		}
 
 		// write File Header
@@ -1167,9 +2231,17 @@ bool oph::ImgEncoderOhc::save() {
 			File.write((char*)&waveLength, sizeof(double_t));
 		}
 
+		// write Codec Header, Block Table and quantized or compressed Field Data
+		if (bCoded) {
+			File.write((char *)&CInfo, sizeof(CInfo));
+			if (CInfo.blockNum)
+				File.write((char *)Header->blockTable.data(), CInfo.blockNum * sizeof(uint32_t));
+			File.write((char *)this->buf_code, this->buf_code_size);
+			FldInfo.cmplxFldType = storeType;
+		}
 		// write Complex Field Data
 		//fwrite(this->buf, 1, sizeof(dataSize), fp);
-		if (FldInfo.cmplxFldType == DataType::Float32)
+		else if (FldInfo.cmplxFldType == DataType::Float32)
 		{
 			size_t dataTypeSize = sizeof(float);
 			ulonglong maxIdx = dataSize / dataTypeSize;
@@ -1201,6 +2273,209 @@ bool oph::ImgEncoderOhc::save() {
 	}
 }
 
+uint64_t oph::ImgEncoderOhc::encodeCodedFieldData(const DataType storeType, const bool bCompress, Complex<Real>** cmplx_field)
+{
+	int n_wavlens = FldInfo.wavlenNum;
+	int rows = FldInfo.pxNumY;
+	ulonglong n_pixels = (ulonglong)FldInfo.pxNumX * FldInfo.pxNumY;
+	ulonglong n_fields = n_pixels * n_wavlens;
+	const size_t typeSize = ohcTypeSize(storeType);
+	const FldCodeType code = FldInfo.fldCodeType;
+
+	this->releaseCodeBuffer();
+	if (typeSize == 0 || (cmplx_field == nullptr && this->field_cmplx.size() < (size_t)n_wavlens))
+		return 0;
+
+	int n_cmplxChnl = 0; // Is a data value Dual data(2) or Single data(1) ?
+	if ((code == FldCodeType::AP) || (code == FldCodeType::RI))
+		n_cmplxChnl = 2;
+	else if ((code == FldCodeType::AE) || (code == FldCodeType::PE))
+		n_cmplxChnl = 1;
+	else
+		return 0;
+
+	// Range mapped to the integer type. Phase uses the phase encoding range, others the range of the data.
+	double min_T, max_T;
+	const bool bInteger = ohcIntegerRange(storeType, min_T, max_T);
+	CInfo = ohcCodecHeader();
+	CInfo.storeType = storeType;
+	if (bInteger) {
+		if (FldInfo.bPhaseCode != BPhaseCode::Encoded)
+			setPhaseEncoding(BPhaseCode::Encoded, -1.0, 1.0);
+		for (int comp = 0; comp < n_cmplxChnl; comp++) {
+			bool bPhase = (code == FldCodeType::PE) || (code == FldCodeType::AP && comp == 1);
+			if (bPhase) {
+				CInfo.rangeMin[comp] = FldInfo.phaseCodeMin * M_PI;
+				CInfo.rangeMax[comp] = FldInfo.phaseCodeMax * M_PI;
+			}
+			else if (cmplx_field)
+				ohcComponentRange(cmplx_field, comp, code, n_wavlens, rows, n_pixels, CInfo.rangeMin[comp], CInfo.rangeMax[comp]);
+			else
+				ohcComponentRange(this->field_cmplx, comp, code, n_wavlens, rows, n_pixels, CInfo.rangeMin[comp], CInfo.rangeMax[comp]);
+		}
+	}
+	else
+		setPhaseEncoding(BPhaseCode::NotEncoded, -1.0, 1.0);
+
+	const ulonglong rawSize = n_fields * n_cmplxChnl * typeSize;
+	uchar* raw = new uchar[rawSize];
+	for (int comp = 0; comp < n_cmplxChnl; comp++) {
+		Real scale = 1, offset = 0;
+		if (bInteger) {
+			scale = (CInfo.rangeMax[comp] - CInfo.rangeMin[comp]) / (max_T - min_T);
+			offset = CInfo.rangeMin[comp] - min_T * scale;
+		}
+		uchar* dst = raw + comp * n_fields * typeSize;
+		const bool bSeqt = (FldInfo.clrArrange == ColorArran::SeqtChanl);
+		if (cmplx_field)
+			quantizeOhcValues(storeType, dst, cmplx_field, comp, code, bSeqt, n_wavlens, rows, n_pixels, scale, offset);
+		else
+			quantizeOhcValues(storeType, dst, this->field_cmplx, comp, code, bSeqt, n_wavlens, rows, n_pixels, scale, offset);
+	}
+	CInfo.rawSize = rawSize;
+	Header->blockTable.clear();
+
+	if (!bCompress) {
+		this->buf_code = raw;
+		this->buf_code_size = rawSize;
+	}
+	else {
+		// Blocks are shuffled and compressed independently. A block that does not shrink is stored as it is.
+		const ulonglong blockSize = OHC_BLOCK_SIZE;
+		const int nBlock = (int)((rawSize + blockSize - 1) / blockSize);
+		std::vector<uchar*> coded(nBlock, nullptr);
+		Header->blockTable.resize(nBlock);
+
+		int b;
+#ifdef _OPENMP
+#pragma omp parallel for private(b) schedule(dynamic)
+#endif
+		for (b = 0; b < nBlock; b++) {
+			int len = (int)((rawSize - b * blockSize < blockSize) ? rawSize - b * blockSize : blockSize);
+			uchar* shuffled = new uchar[len];
+			ohcShuffle(raw + b * blockSize, shuffled, len, (int)typeSize);
+			coded[b] = new uchar[len];
+			int size = lzbCompress(shuffled, len, coded[b], len - 1);
+			if (size < 0) {
+				memcpy(coded[b], shuffled, len);
+				size = len;
+			}
+			Header->blockTable[b] = (uint32_t)size;
+			delete[] shuffled;
+		}
+
+		ulonglong total = 0;
+		for (b = 0; b < nBlock; b++)
+			total += Header->blockTable[b];
+		this->buf_code = new uchar[total];
+		this->buf_code_size = 0;
+		for (b = 0; b < nBlock; b++) {
+			memcpy(this->buf_code + this->buf_code_size, coded[b], Header->blockTable[b]);
+			this->buf_code_size += Header->blockTable[b];
+			delete[] coded[b];
+		}
+		delete[] raw;
+
+		CInfo.blockSize = (uint32_t)blockSize;
+		CInfo.blockNum = (uint32_t)nBlock;
+	}
+	CInfo.codecSize = (uint32_t)(sizeof(ohcCodecHeader) + CInfo.blockNum * sizeof(uint32_t));
+
+	return this->buf_code_size;
+}
+
+void oph::ImgEncoderOhc::writeFrameHeader()
+{
+	File.seekp(0, ios::beg);
+
+	// write File Header, Field Info Header, Wavelength Table and Frame Index Header
+	File.write((char *)&FHeader, sizeof(FHeader));
+	File.write((char *)&FldInfo, sizeof(FldInfo));
+	for (uint n = 0; n < FldInfo.wavlenNum; ++n) {
+		double_t waveLength = WavLeng[n];
+		File.write((char*)&waveLength, sizeof(double_t));
+	}
+	File.write((char *)&Header->frameInfo, sizeof(ohcFrameIndexHeader));
+}
+
+bool oph::ImgEncoderOhc::appendFrame(Complex<Real>** cmplx_field, const bool bCompress)
+{
+	if (this->Header == nullptr)
+		this->initOHCheader();
+
+	const DataType storeType = FldInfo.cmplxFldType;
+	if (cmplx_field == nullptr || ohcTypeSize(storeType) == 0 || WavLeng.size() < FldInfo.wavlenNum) {
+		LOG("Error : Invalid Encoding Complex Field Data Type...");
+		return false;
+	}
+
+	auto start = CUR_TIME;
+
+	// Shared header is written once, frame index is filled by closeFrames()
+	if (!this->bFrames) {
+		this->File.open(this->fname, std::ios::out | std::ios::trunc | std::ios::binary);
+		if (!this->File.is_open()) {
+			LOG("Error : Failed saving OHC file...");
+			return false;
+		}
+		FldInfo.fldStore = FldStore::Frames;
+		FldInfo.comprsType = CompresType::Null;
+		FldInfo.headerSize = (uint32_t)(sizeof(ohcFieldInfoHeader) + FldInfo.wavlenNum * sizeof(double_t));
+		FldInfo.fldSize = 0;
+		Header->frameInfo = ohcFrameIndexHeader();
+		Header->frameTable.clear();
+		FHeader.fileOffBytes = (uint32_t)(sizeof(ohcFileHeader) + FldInfo.headerSize + sizeof(ohcFrameIndexHeader));
+		FHeader.fileSize = FHeader.fileOffBytes;
+		this->writeFrameHeader();
+		this->bFrames = true;
+	}
+
+	uint64_t dataSize = encodeCodedFieldData(storeType, bCompress, cmplx_field);
+	if (dataSize == 0) {
+		LOG("Error : No Field Data");
+		return false;
+	}
+
+	// write Codec Header, Block Table and Field Data of the frame at the end
+	ohcFrameEntry entry;
+	entry.offBytes = FHeader.fileSize;
+	entry.size = CInfo.codecSize + dataSize;
+	File.seekp(entry.offBytes, ios::beg);
+	File.write((char *)&CInfo, sizeof(CInfo));
+	if (CInfo.blockNum)
+		File.write((char *)Header->blockTable.data(), CInfo.blockNum * sizeof(uint32_t));
+	File.write((char *)this->buf_code, this->buf_code_size);
+	this->releaseCodeBuffer();
+
+	Header->frameTable.push_back(entry);
+	FHeader.fileSize += entry.size;
+	FldInfo.fldSize += entry.size;
+
+	auto end = CUR_TIME;
+	LOG("%s : frame %d...%.5lfsec\n", __FUNCTION__, (int)Header->frameTable.size() - 1, ((std::chrono::duration<Real>)(end - start)).count());
+	return File.good();
+}
+
+bool oph::ImgEncoderOhc::closeFrames()
+{
+	if (!this->bFrames)
+		return false;
+	this->bFrames = false;
+
+	// write Frame Index after the last frame, then update the shared header
+	Header->frameInfo.frameNum = (uint32_t)Header->frameTable.size();
+	Header->frameInfo.indexOffBytes = FHeader.fileSize;
+	File.seekp(FHeader.fileSize, ios::beg);
+	if (!Header->frameTable.empty())
+		File.write((char *)Header->frameTable.data(), Header->frameTable.size() * sizeof(ohcFrameEntry));
+	FHeader.fileSize += Header->frameTable.size() * sizeof(ohcFrameEntry);
+	this->writeFrameHeader();
+
+	bool ok = File.good();
+	this->File.close();
+	return ok;
+}
+
 uint64_t oph::ImgEncoderOhc::encodeFieldData()
 {
 	ulonglong dataSizeBytes = 0;
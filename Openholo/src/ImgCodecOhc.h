@@ -90,6 +90,8 @@ namespace oph
 		//void* buf = nullptr; //coded data
 		float*	buf_f32 = nullptr; //coded data
 		double* buf_f64 = nullptr; //coded data		
+		uchar*	buf_code = nullptr; //quantized or compressed data
+		ulonglong buf_code_size = 0;
 		std::vector<OphComplexField> field_cmplx; //Real & Imagine data
 		std::vector<std::string> linkFilePath;
 
@@ -120,6 +122,23 @@ namespace oph
 
 		bool load();
 
+		//Bulk decode path : loadHeader() keeps the file open, then loadFieldData() decodes straight into
+		//caller-provided buffers(one contiguous pxNumX * pxNumY buffer per wavelength, same order as complex_H).
+		bool loadHeader();
+		bool loadFieldData(Complex<Real>** cmplx_field);
+
+		//Mapped reader : the file is memory-mapped and only the tiles touched by readRegion() are decoded.
+		//Decoded tiles are kept in a LRU cache bounded by cacheBytes. Regions are stored like the file and loadFieldData() : pixel (x, y) at x * size[_Y] + y.
+		bool openMapped(const uint _tileSize = 256, const ulonglong cacheBytes = 256ULL << 20);
+		void closeMapped();
+		bool isMapped() { return this->mapView != nullptr; }
+		bool readRegion(const uint wavelen_idx, const ivec2 origin, const ivec2 size, Complex<Real>* dst);
+		void prefetchRegion(const uint wavelen_idx, const ivec2 origin, const ivec2 size);
+
+		//Multi-frame container : loadHeader() reads the frame index once, then readFrame() seeks to any frame directly.
+		uint getNumOfFrame();
+		bool readFrame(const uint frame_idx, Complex<Real>** cmplx_field);
+
 	protected:
 		void fieldToComplex(void);
 
@@ -127,11 +146,34 @@ namespace oph
 		//template<typename T> bool decodeFieldData();
 		//template<typename T> Real decodePhase(const T phase, const Real min_p, const Real max_p, const double min_T, const double max_T);
 		bool decodeFieldData();
+		bool decodeFieldData(Complex<Real>** cmplx_field);
+		bool decodeCodedFieldData(Complex<Real>** cmplx_field, const ulonglong offBytes);
+		bool scanFrames();
 
 		//Only Amplitude Encoding or Only Phase Encoding or Amplitude & Phase data
 		std::vector<OphRealField> field_ampli;
 		std::vector<OphRealField> field_phase;
 		std::ifstream File;
+
+		//Mapped reader
+		struct OhcTile {
+			Complex<Real>* data;
+			std::list<ulonglong>::iterator lru;
+		};
+		void decodeTile(const uint wavelen_idx, const int tx, const int ty, Complex<Real>* data);
+		void releaseTiles();
+		const uchar* mappedAddress(const uint wavelen_idx, const ulonglong pixel, const int comp);
+
+		uchar* mapView = nullptr;
+		ulonglong mapSize = 0;
+		std::string mapName;
+		DataType mapType = DataType::Null;
+		Real mapScale[2];
+		Real mapOffset[2];
+		uint tileSize = 256;
+		ulonglong tileBudget = 0;
+		std::map<ulonglong, OhcTile> tiles;
+		std::list<ulonglong> tileLRU;
 	};
 
 
@@ -157,7 +199,10 @@ namespace oph
 		void setFieldEncoding(const FldStore _fldStore, const FldCodeType _fldCodeType); //const DataType _cmplxFldType = DataType::Float64);
 		void setPhaseEncoding(const BPhaseCode _bPhaseCode, const double _phaseCodeMin, const double _phaseCodeMax);
 		void setPhaseEncoding(const BPhaseCode _bPhaseCode, const vec2 _phaseCodeRange);
-		//void setCompressedFormatType(const CompresType _comprsType);
+		//Integer types quantize each complex channel over its range(phase over phaseCodeMin/Max * PI), Float16 stores half precision.
+		void setFieldDataType(const DataType _cmplxFldType);
+		//CompresType::LZB compresses the field data with the built-in lossless block codec. Other image formats are not supported yet.
+		void setCompressedFormatType(const CompresType _comprsType);
 
 		void addWavelengthNComplexFieldData(const Real wavlen, const OphComplexField &data);
 		void addComplexFieldData(const OphComplexField &data);
@@ -168,12 +213,21 @@ namespace oph
 
 		bool save();
 
+		//Multi-frame container : the first appendFrame() writes the shared header and each call appends one frame
+		//(one pxNumX * pxNumY buffer per wavelength, same order as complex_H) stored as 'cmplxFldType', compressed with LZB when bCompress is set.
+		//closeFrames() writes the frame index.
+		bool appendFrame(Complex<Real>** cmplx_field, const bool bCompress = false);
+		bool closeFrames();
+
 	protected:
 		//template<typename T> uint64_t encodeFieldData();
 		//template<typename T> T encodePhase(const Real phase_angle, const Real min_p, const Real max_p, const double min_T, const double max_T);
 		uint64_t encodeFieldData();
+		uint64_t encodeCodedFieldData(const DataType storeType, const bool bCompress, Complex<Real>** cmplx_field = nullptr);
+		void writeFrameHeader();
 
 		std::ofstream File;
+		bool bFrames = false;
 	};
 }
 
@@ -51,6 +51,10 @@
 #include "sys.h"
 #include "ImgCodecOhc.h"
 #include "ImgControl.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
 
 Openholo::Openholo(void)
 	: Base()
@@ -58,6 +62,8 @@ Openholo::Openholo(void)
 	, plan_bwd(nullptr)
 	, fft_in(nullptr)
 	, fft_out(nullptr)
+	, fft_capacity(0)
+	, fft_rank(0)
 	, pnx(1)
 	, pny(1)
 	, pnz(1)
@@ -65,16 +71,18 @@ Openholo::Openholo(void)
 	, OHC_encoder(nullptr)
 	, OHC_decoder(nullptr)
 	, complex_H(nullptr)
+	, save_queue(nullptr)
 {
 	context_ = { 0 };
 	fftw_init_threads();
-	fftw_plan_with_nthreads(omp_get_max_threads());
+	setFFTWPlannerThreads(omp_get_max_threads());
 	OHC_encoder = new oph::ImgEncoderOhc;
 	OHC_decoder = new oph::ImgDecoderOhc;
 }
 
 Openholo::~Openholo(void)
 {
+	setAsyncSave(false);
 	if (OHC_encoder) {
 		delete OHC_encoder;
 		OHC_encoder = nullptr;
@@ -86,6 +94,16 @@ Openholo::~Openholo(void)
 	fftw_cleanup_threads();
 }
 
+int Openholo::setFFTWPlannerThreads(int nThreads)
+{
+	static int planner_threads = 1;
+
+	int prev = planner_threads;
+	fftw_plan_with_nthreads(nThreads);
+	planner_threads = nThreads;
+	return prev;
+}
+
 bool Openholo::checkExtension(const char * fname, const char * ext)
 {
 	string filename(fname);
@@ -102,7 +120,82 @@ bool Openholo::checkExtension(const char * fname, const char * ext)
 		return false;
 }
 
+#define BMP_WRITE_CHUNK (1 << 22) // bytes of rows written at once by the bitmap writer
+
+/* Rows of a bitmap in file order, from an image already in file order or from color planes(byte c of a pixel is plane 2 - c) interleaved per row.
+   The 180 degree rotation uses the same pixel mapping as ImgControl::Rotate. */
+struct BmpRowSource
+{
+	uchar* src;
+	uchar** planes;
+	int width;
+	int height;
+	int ch;
+	int lineBytes;
+	bool bRotate;
+	double cc;
+	double ss;
+
+	void row(int y, uchar* line) const
+	{
+		if (!bRotate && src) {
+			memcpy(line, src + (ulonglong)y * lineBytes, lineBytes);
+			return;
+		}
+		memset(line + width * ch, 0, lineBytes - width * ch);
+
+		double centerX = (double)width / 2.0;
+		double centerY = (double)height / 2.0;
+		for (int x = 0; x < width; x++) {
+			int srcX = x, srcY = y;
+			if (bRotate) {
+				srcX = (int)(centerX + ((double)y - centerY)*ss + ((double)x - centerX)*cc);
+				srcY = (int)(centerY + ((double)y - centerY)*cc - ((double)x - centerX)*ss);
+			}
+			uchar* dst = line + x * ch;
+			if (srcY < 0 || srcY >= height || srcX < 0 || srcX >= width)
+				memset(dst, 0, ch);
+			else if (src)
+				memcpy(dst, src + (ulonglong)srcY * lineBytes + srcX * ch, ch);
+			else
+				for (int c = 0; c < ch; c++)
+					dst[c] = planes[ch - 1 - c][(ulonglong)srcY * width + srcX];
+		}
+	}
+};
+
 bool Openholo::saveAsImg(const char * fname, uint8_t bitsperpixel, uchar* src, int width, int height)
+{
+	return writeImg(fname, bitsperpixel, src, width, height, context_.bRotation);
+}
+
+bool Openholo::saveAsImgPlanes(const char * fname, uint8_t bitsperpixel, uchar** planes, int width, int height)
+{
+	return writeImg(fname, bitsperpixel, nullptr, width, height, context_.bRotation, planes);
+}
+
+void Openholo::interleavePlanes(uint8_t bitsperpixel, uchar** planes, int width, int height, uchar* dst)
+{
+	BmpRowSource rows;
+	rows.src = nullptr;
+	rows.planes = planes;
+	rows.width = width;
+	rows.height = height;
+	rows.ch = bitsperpixel / 8;
+	rows.lineBytes = ((width * bitsperpixel / 8) + 3) & ~3;
+	rows.bRotate = false;
+	rows.cc = 1.0;
+	rows.ss = 0.0;
+
+	int y;
+#ifdef _OPENMP
+#pragma omp parallel for private(y)
+#endif
+	for (y = 0; y < height; y++)
+		rows.row(y, dst + (ulonglong)y * rows.lineBytes);
+}
+
+bool Openholo::writeImg(const char * fname, uint8_t bitsperpixel, uchar* src, int width, int height, bool bRotate, uchar** planes)
 {
 	LOG("Saving...%s...\n", fname);
 	bool bOK = true;
@@ -116,6 +209,8 @@ bool Openholo::saveAsImg(const char * fname, uint8_t bitsperpixel, uchar* src, i
 	int _headersize = sizeof(bitmap);
 	int _iColor = (hasColorTable) ? 256 : 0;
 
+	if (src == nullptr && planes == nullptr)
+		return false;
 
 	rgbquad *table = nullptr;
 
@@ -134,12 +229,8 @@ bool Openholo::saveAsImg(const char * fname, uint8_t bitsperpixel, uchar* src, i
 
 	bool bConvert = _stricmp(PathFindExtensionA(fname) + 1, "bmp") ? true : false;
 
-	uchar *pBitmap = new uchar[_filesize];
-	memset(pBitmap, 0x00, _filesize);
-
 	bitmap bitmap;
 	memset(&bitmap, 0, sizeof(bitmap));
-	int iCur = 0;
 
 	bitmap.fileheader.signature[0] = 'B';
 	bitmap.fileheader.signature[1] = 'M';
@@ -156,52 +247,82 @@ bool Openholo::saveAsImg(const char * fname, uint8_t bitsperpixel, uchar* src, i
 	bitmap.bitmapinfoheader.ypixelpermeter = 0;// Y_PIXEL_PER_METER;
 	bitmap.bitmapinfoheader.xpixelpermeter = 0;// X_PIXEL_PER_METER;
 	bitmap.bitmapinfoheader.numcolorspallette = _iColor;
-	
-	memcpy(&pBitmap[iCur], &bitmap.fileheader, sizeof(fileheader));
-	iCur += sizeof(fileheader);
-	memcpy(&pBitmap[iCur], &bitmap.bitmapinfoheader, sizeof(bitmapinfoheader));
-	iCur += sizeof(bitmapinfoheader);
-	
-	if (hasColorTable) {
-		memcpy(&pBitmap[iCur], table, sizeof(rgbquad) * _iColor);
-		iCur += sizeof(rgbquad) * _iColor;
-	}
-
-	if (context_.bRotation) {
-		ImgControl *pControl = ImgControl::getInstance();
-		uchar *pTmp = new uchar[_pixelbytesize];
-		pControl->Rotate(180.0, src, pTmp, _width, _height, _width, _height, bitsperpixel / 8);
-		memcpy(&pBitmap[iCur], pTmp, _pixelbytesize);
-		delete[] pTmp;
-	}
-	else {
-		memcpy(&pBitmap[iCur], src, _pixelbytesize);
-	}
-
-	iCur += _pixelbytesize;
 
+	BmpRowSource rows;
+	rows.src = src;
+	rows.planes = planes;
+	rows.width = _width;
+	rows.height = _height;
+	rows.ch = bitsperpixel / 8;
+	rows.lineBytes = _byteperline;
+	rows.bRotate = bRotate;
+	rows.cc = cos(180.0 * M_PI / 180.0);
+	rows.ss = sin(-180.0 * M_PI / 180.0);
+
+	// Rows are produced a chunk at a time, except an image in file order is written as it is
+	const bool bDirect = (src != nullptr && !bRotate);
+	int nChunkRows = BMP_WRITE_CHUNK / _byteperline;
+	if (nChunkRows < 1) nChunkRows = 1;
+	if (nChunkRows > _height) nChunkRows = _height;
 
 	if (!bConvert) {
-		if (iCur != _filesize)
+		FILE *fp;
+		fopen_s(&fp, fname, "wb");
+		if (fp == nullptr)
 			bOK = false;
 		else {
-			FILE *fp;
-			fopen_s(&fp, fname, "wb");
-			if (fp == nullptr)
-				bOK = false;
+			fwrite(&bitmap.fileheader, sizeof(fileheader), 1, fp);
+			fwrite(&bitmap.bitmapinfoheader, sizeof(bitmapinfoheader), 1, fp);
+			if (hasColorTable)
+				fwrite(table, sizeof(rgbquad), _iColor, fp);
+
+			if (bDirect) {
+				if (fwrite(src, 1, _pixelbytesize, fp) != (size_t)_pixelbytesize)
+					bOK = false;
+			}
 			else {
-				fwrite(pBitmap, 1, _filesize, fp);
-				fclose(fp);
+				uchar *pChunk = new uchar[(ulonglong)nChunkRows * _byteperline];
+				for (int y0 = 0; y0 < _height && bOK; y0 += nChunkRows) {
+					int n = (_height - y0 < nChunkRows) ? _height - y0 : nChunkRows;
+					int y;
+#ifdef _OPENMP
+#pragma omp parallel for private(y)
+#endif
+					for (y = 0; y < n; y++)
+						rows.row(y0 + y, pChunk + (ulonglong)y * _byteperline);
+					if (fwrite(pChunk, _byteperline, n, fp) != (size_t)n)
+						bOK = false;
+				}
+				delete[] pChunk;
 			}
+			fclose(fp);
 		}
 	}
 	else {
+		// The image converter needs the whole bitmap in memory
+		uchar *pBitmap = new uchar[_filesize];
+		int iCur = 0;
+		memcpy(&pBitmap[iCur], &bitmap.fileheader, sizeof(fileheader));
+		iCur += sizeof(fileheader);
+		memcpy(&pBitmap[iCur], &bitmap.bitmapinfoheader, sizeof(bitmapinfoheader));
+		iCur += sizeof(bitmapinfoheader);
+		if (hasColorTable) {
+			memcpy(&pBitmap[iCur], table, sizeof(rgbquad) * _iColor);
+			iCur += sizeof(rgbquad) * _iColor;
+		}
+		int y;
+#ifdef _OPENMP
+#pragma omp parallel for private(y)
+#endif
+		for (y = 0; y < _height; y++)
+			rows.row(y, &pBitmap[iCur + (ulonglong)y * _byteperline]);
+
 		ImgControl *pControl = ImgControl::getInstance();
 		pControl->Save(fname, pBitmap, _filesize);
+		delete[] pBitmap;
 	}
 
 	if(hasColorTable && table) delete[] table;
-	delete[] pBitmap;
 	auto end = CUR_TIME;
 
 	auto during = ((std::chrono::duration<Real>)(end - start)).count();
@@ -212,6 +333,203 @@ bool Openholo::saveAsImg(const char * fname, uint8_t bitsperpixel, uchar* src, i
 }
 
 
+/* Asynchronous save : jobs are handed to the I/O thread through a ring of reusable output buffers */
+struct Openholo::SaveQueue
+{
+	struct Job {
+		int slot;
+		bool bOhc;
+		std::string fname;
+		uint8_t bitsperpixel;
+		int width;
+		int height;
+		bool bRotate;
+		ohcHeader header;
+	};
+
+	std::vector<uchar*> ring;
+	std::vector<ulonglong> ringSize;
+	std::vector<int> freeSlot;
+	std::deque<Job> jobs;
+	int nBusy; // jobs queued or being written
+	bool bStop;
+	bool bOK;
+
+	std::mutex lock;
+	std::condition_variable cvJob;
+	std::condition_variable cvFree;
+	std::thread worker;
+};
+
+void Openholo::setAsyncSave(bool bAsync, uint ringSize)
+{
+	if (bAsync) {
+		if (save_queue != nullptr) return;
+		if (ringSize == 0) ringSize = 1;
+
+		save_queue = new SaveQueue;
+		save_queue->ring.assign(ringSize, nullptr);
+		save_queue->ringSize.assign(ringSize, 0);
+		for (uint i = 0; i < ringSize; i++)
+			save_queue->freeSlot.push_back(i);
+		save_queue->nBusy = 0;
+		save_queue->bStop = false;
+		save_queue->bOK = true;
+		save_queue->worker = std::thread(&Openholo::saveWorker, this);
+	}
+	else {
+		if (save_queue == nullptr) return;
+
+		{
+			std::lock_guard<std::mutex> lk(save_queue->lock);
+			save_queue->bStop = true;
+		}
+		save_queue->cvJob.notify_all();
+		save_queue->worker.join(); // the queued jobs are written before the thread exits
+
+		for (size_t i = 0; i < save_queue->ring.size(); i++)
+			delete[] save_queue->ring[i];
+		delete save_queue;
+		save_queue = nullptr;
+	}
+}
+
+void Openholo::saveWorker(void)
+{
+	SaveQueue* q = save_queue;
+
+	while (true) {
+		SaveQueue::Job job;
+		{
+			std::unique_lock<std::mutex> lk(q->lock);
+			q->cvJob.wait(lk, [q] { return q->bStop || !q->jobs.empty(); });
+			if (q->jobs.empty()) break;
+			job = q->jobs.front();
+			q->jobs.pop_front();
+		}
+
+		bool bOK = false;
+		uchar* buf = q->ring[job.slot];
+		if (job.bOhc) {
+			ImgEncoderOhc encoder(job.fname);
+			encoder.setOHCheader(job.header);
+			ulonglong n_pixels = (ulonglong)job.width * job.height;
+			for (uint i = 0; i < job.header.fieldInfo.wavlenNum; i++)
+				encoder.addComplexFieldData((Complex<Real>*)buf + i * n_pixels);
+			bOK = encoder.save();
+		}
+		else
+			bOK = writeImg(job.fname.c_str(), job.bitsperpixel, buf, job.width, job.height, job.bRotate);
+
+		{
+			std::lock_guard<std::mutex> lk(q->lock);
+			if (!bOK) q->bOK = false;
+			q->freeSlot.push_back(job.slot);
+			q->nBusy--;
+		}
+		q->cvFree.notify_all();
+	}
+}
+
+uchar* Openholo::acquireSaveBuffer(ulonglong size, int& slot)
+{
+	SaveQueue* q = save_queue;
+	{
+		std::unique_lock<std::mutex> lk(q->lock);
+		q->cvFree.wait(lk, [q] { return !q->freeSlot.empty(); });
+		slot = q->freeSlot.back();
+		q->freeSlot.pop_back();
+	}
+
+	// Buffers only grow, so a sequence of same size frames never reallocates
+	if (q->ringSize[slot] < size) {
+		delete[] q->ring[slot];
+		q->ring[slot] = new uchar[size];
+		q->ringSize[slot] = size;
+	}
+	return q->ring[slot];
+}
+
+void Openholo::submitSaveImg(int slot, const char* fname, uint8_t bitsperpixel, int width, int height)
+{
+	SaveQueue::Job job;
+	job.slot = slot;
+	job.bOhc = false;
+	job.fname = fname;
+	job.bitsperpixel = bitsperpixel;
+	job.width = width;
+	job.height = height;
+	job.bRotate = context_.bRotation;
+	{
+		std::lock_guard<std::mutex> lk(save_queue->lock);
+		save_queue->jobs.push_back(job);
+		save_queue->nBusy++;
+	}
+	save_queue->cvJob.notify_one();
+}
+
+bool Openholo::saveAsImgAsync(const char * fname, uint8_t bitsperpixel, uchar* src, int width, int height)
+{
+	if (save_queue == nullptr)
+		return saveAsImg(fname, bitsperpixel, src, width, height);
+
+	int slot;
+	ulonglong size = (ulonglong)height * (((width * bitsperpixel / 8) + 3) & ~3);
+	uchar* buf = acquireSaveBuffer(size, slot);
+
+	memcpy(buf, src, size);
+
+	submitSaveImg(slot, fname, bitsperpixel, width, height);
+	return true;
+}
+
+bool Openholo::saveAsOhcAsync(const char * fname)
+{
+	if (save_queue == nullptr)
+		return saveAsOhc(fname);
+
+	std::string fullname = fname;
+	if (!checkExtension(fname, ".ohc")) fullname.append(".ohc");
+
+	SaveQueue::Job job;
+	OHC_encoder->getOHCheader(job.header);
+	job.slot = -1;
+	job.bOhc = true;
+	job.fname = fullname;
+	job.bitsperpixel = 0;
+	job.bRotate = false;
+	job.width = job.header.fieldInfo.pxNumX;
+	job.height = job.header.fieldInfo.pxNumY;
+
+	const uint nWave = job.header.fieldInfo.wavlenNum;
+	ulonglong n_pixels = (ulonglong)job.width * job.height;
+	if (complex_H == nullptr || nWave == 0 || job.header.fieldInfo.pxNumX == (uint32_t)-1) return false;
+
+	Complex<Real>* buf = (Complex<Real>*)acquireSaveBuffer(sizeof(Complex<Real>) * n_pixels * nWave, job.slot);
+	for (uint i = 0; i < nWave; i++)
+		memcpy(buf + i * n_pixels, complex_H[i], sizeof(Complex<Real>) * n_pixels);
+
+	{
+		std::lock_guard<std::mutex> lk(save_queue->lock);
+		save_queue->jobs.push_back(job);
+		save_queue->nBusy++;
+	}
+	save_queue->cvJob.notify_one();
+	return true;
+}
+
+bool Openholo::flushSave(void)
+{
+	if (save_queue == nullptr) return true;
+
+	SaveQueue* q = save_queue;
+	std::unique_lock<std::mutex> lk(q->lock);
+	q->cvFree.wait(lk, [q] { return q->nBusy == 0; });
+	bool bOK = q->bOK;
+	q->bOK = true;
+	return bOK;
+}
+
 uchar * Openholo::loadAsImg(const char * fname)
 {
 	FILE *infile;
@@ -268,19 +586,59 @@ bool Openholo::loadAsOhc(const char * fname)
 	std::string fullname = fname;
 	if (!checkExtension(fname, ".ohc")) fullname.append(".ohc");
 	OHC_decoder->setFileName(fullname.c_str());
-	if (!OHC_decoder->load()) return false;
+	if (!OHC_decoder->loadHeader()) return false;
+
+	prepareOhcField(OHC_decoder->getNumOfPixel());
+
+	if (!OHC_decoder->loadFieldData(complex_H)) return false;
 
-	context_.waveNum = OHC_decoder->getNumOfWavlen();
-	context_.pixel_number = OHC_decoder->getNumOfPixel();
+	context_.k = (2 * M_PI) / context_.wave_length[0];
+	context_.ss[_X] = context_.pixel_number[_X] * context_.pixel_pitch[_X];
+	context_.ss[_Y] = context_.pixel_number[_Y] * context_.pixel_pitch[_Y];
+
+	return true;
+}
+
+void Openholo::prepareOhcField(const ivec2 pixel_number)
+{
+	const uint nWave = OHC_decoder->getNumOfWavlen();
+	const uint pnXY = pixel_number[_X] * pixel_number[_Y];
+	if (complex_H == nullptr || context_.waveNum != nWave ||
+		context_.pixel_number[_X] * context_.pixel_number[_Y] != pnXY) {
+		if (complex_H) {
+			for (uint i = 0; i < context_.waveNum; i++)
+				delete[] complex_H[i];
+			delete[] complex_H;
+		}
+		complex_H = new Complex<Real>*[nWave];
+		for (uint i = 0; i < nWave; i++)
+			complex_H[i] = new Complex<Real>[pnXY];
+	}
+
+	context_.waveNum = nWave;
+	context_.pixel_number = pixel_number;
 	context_.pixel_pitch = OHC_decoder->getPixelPitch();
 
 	vector<Real> wavelengthArray;
 	OHC_decoder->getWavelength(wavelengthArray);
+	if (context_.wave_length) delete[] context_.wave_length;
 	context_.wave_length = new Real[wavelengthArray.size()];
 	for (int i = 0; i < wavelengthArray.size(); i++)
 		context_.wave_length[i] = wavelengthArray[i];
-	
-	OHC_decoder->getComplexFieldData(&complex_H);
+}
+
+bool Openholo::loadAsOhcRegion(const char * fname, const ivec2 origin, const ivec2 size)
+{
+	std::string fullname = fname;
+	if (!checkExtension(fname, ".ohc")) fullname.append(".ohc");
+	OHC_decoder->setFileName(fullname.c_str());
+	if (!OHC_decoder->openMapped()) return false;
+
+	prepareOhcField(size);
+
+	for (uint i = 0; i < context_.waveNum; i++) {
+		if (!OHC_decoder->readRegion(i, origin, size, complex_H[i])) return false;
+	}
 
 	context_.k = (2 * M_PI) / context_.wave_length[0];
 	context_.ss[_X] = context_.pixel_number[_X] * context_.pixel_pitch[_X];
@@ -515,39 +873,85 @@ void Openholo::convertToFormatGray8(unsigned char * src, unsigned char * dst, in
 	}
 }
 
-void Openholo::fft1(int n, Complex<Real>* in, int sign, uint flag)
+uchar* Openholo::mapFile(const char* fname, uint64_t& size)
 {
-	pnx = n;
-	bool bIn = true;
+	unsigned long long mapped = 0;
+	uchar* view = file_map_read(fname, &mapped);
+	if (view == nullptr) LOG("No such file");
+	size = mapped;
+	return view;
+}
 
-	if (fft_in == nullptr)
-		fft_in = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * n);
-	if (fft_out == nullptr)
-		fft_out = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * n);
+void Openholo::unmapFile(uchar* view, uint64_t size)
+{
+	file_unmap(view, size);
+}
 
-	if (!in){
-		in = new Complex<Real>[pnx];
-		bIn = false;
+bool Openholo::fftPlan(int rank, int nx, int ny, int nz, int sign, uint flag)
+{
+	if (sign != OPH_FORWARD && sign != OPH_BACKWARD) {
+		LOG("failed fftw : wrong sign");
+		return false;
 	}
 
-	for (int i = 0; i < n; i++) {
-		fft_in[i][_RE] = in[i].real();
-		fft_in[i][_IM] = in[i].imag();
+	size_t size = (size_t)nx * ny * nz;
+	if (rank != fft_rank || nx != pnx || ny != pny || nz != pnz || size > fft_capacity) {
+		// plans are tied to the shape and to the buffers, both are kept until the shape changes
+#ifdef _OPENMP
+#pragma omp critical(fftw_planner)
+#endif
+		{
+			if (plan_fwd) fftw_destroy_plan(plan_fwd);
+			if (plan_bwd) fftw_destroy_plan(plan_bwd);
+		}
+		plan_fwd = nullptr;
+		plan_bwd = nullptr;
+
+		if (size > fft_capacity) {
+			fftw_free(fft_in);
+			fftw_free(fft_out);
+			fft_in = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * size);
+			fft_out = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * size);
+			fft_capacity = size;
+		}
+		fft_rank = rank;
+		pnx = nx, pny = ny, pnz = nz;
 	}
 
+	fftw_plan& plan = (sign == OPH_FORWARD) ? plan_fwd : plan_bwd;
+	if (!plan) {
+		// the FFTW planner is not thread safe
+#ifdef _OPENMP
+#pragma omp critical(fftw_planner)
+#endif
+		{
+			if (rank == 1)
+				plan = fftw_plan_dft_1d(nx, fft_in, fft_out, sign, flag);
+			else if (rank == 2)
+				plan = fftw_plan_dft_2d(ny, nx, fft_in, fft_out, sign, flag);
+			else
+				plan = fftw_plan_dft_3d(nz, ny, nx, fft_in, fft_out, sign, flag);
+		}
+	}
 	fft_sign = sign;
+	return true;
+}
 
-	if (!bIn) delete[] in;
+void Openholo::fft1(int n, Complex<Real>* in, int sign, uint flag)
+{
+	// planned before the input is copied, planning may overwrite the buffers
+	if (!fftPlan(1, n, 1, 1, sign, flag))
+		return;
 
-	if (sign == OPH_FORWARD)
-		plan_fwd = fftw_plan_dft_1d(n, fft_in, fft_out, sign, flag);
-	else if (sign == OPH_BACKWARD)
-		plan_bwd = fftw_plan_dft_1d(n, fft_in, fft_out, sign, flag);
-	else {
-		LOG("failed fftw : wrong sign");
-		fftFree();
+	if (!in) {
+		memset(fft_in, 0, sizeof(fftw_complex) * n);
 		return;
 	}
+
+	for (int i = 0; i < n; i++) {
+		fft_in[i][_RE] = in[i].real();
+		fft_in[i][_IM] = in[i].imag();
+	}
 }
 
 
@@ -555,12 +959,8 @@ void Openholo::fft2(oph::ivec2 n, Complex<Real>* in, int sign, uint flag)
 {
 	if (in == nullptr) return;
 
-	pnx = n[_X], pny = n[_Y];
-
-	if (fft_in == nullptr)
-		fft_in = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * pnx * pny);
-	if (fft_out == nullptr)
-		fft_out = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * pnx * pny);
+	if (!fftPlan(2, n[_X], n[_Y], 1, sign, flag))
+		return;
 
 #if 0
 	memcpy(fft_in, in, sizeof(fftw_complex) * pnx * pny);
@@ -571,52 +971,22 @@ void Openholo::fft2(oph::ivec2 n, Complex<Real>* in, int sign, uint flag)
 		fft_in[i][_IM] = in[i][_IM];
 	}
 #endif
-
-	fft_sign = sign;
-
-	if (sign == OPH_FORWARD)
-		plan_fwd = fftw_plan_dft_2d(pny, pnx, fft_in, fft_out, sign, flag);
-	else if (sign == OPH_BACKWARD)
-		plan_bwd = fftw_plan_dft_2d(pny, pnx, fft_in, fft_out, sign, flag);
-	else {
-		LOG("failed fftw : wrong sign");
-		fftFree();
-		return;
-	}
 }
 
 void Openholo::fft3(oph::ivec3 n, Complex<Real>* in, int sign, uint flag)
 {
-	pnx = n[_X], pny = n[_Y], pnz = n[_Z];
-	bool bIn = true;
-	if (fft_in == nullptr)
-		fft_in = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * pnx * pny * pnz);
-	if (fft_out == nullptr)
-		fft_out = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * pnx * pny * pnz);
+	if (!fftPlan(3, n[_X], n[_Y], n[_Z], sign, flag))
+		return;
 
 	if (!in) {
-		in = new Complex<Real>[pnx * pny * pnz];
-		bIn = false;
+		memset(fft_in, 0, sizeof(fftw_complex) * pnx * pny * pnz);
+		return;
 	}
 
 	for (int i = 0; i < pnx * pny * pnz; i++) {
 		fft_in[i][_RE] = in[i].real();
 		fft_in[i][_IM] = in[i].imag();
 	}
-
-	fft_sign = sign;
-
-	if (!bIn) delete[] in;
-
-	if (sign == OPH_FORWARD)
-		plan_fwd = fftw_plan_dft_3d(pnz, pny, pnx, fft_in, fft_out, sign, flag);
-	else if (sign == OPH_BACKWARD)
-		plan_bwd = fftw_plan_dft_3d(pnz, pny, pnx, fft_in, fft_out, sign, flag);
-	else {
-		LOG("failed fftw : wrong sign");
-		fftFree();
-		return;
-	}
 }
 
 void Openholo::fftExecute(Complex<Real>* out, bool bReverse)
@@ -628,7 +998,6 @@ void Openholo::fftExecute(Complex<Real>* out, bool bReverse)
 	else {
 		LOG("failed fftw : wrong sign");
 		out = nullptr;
-		fftFree();
 		return;
 	}
 
@@ -654,26 +1023,26 @@ void Openholo::fftExecute(Complex<Real>* out, bool bReverse)
 		}
 
 	}
-
-	fftFree();
 }
 
 void Openholo::fftFree(void)
 {
-	if (plan_fwd) {
-		fftw_destroy_plan(plan_fwd);
-		plan_fwd = nullptr;
-	}
-	if (plan_bwd) {
-		fftw_destroy_plan(plan_bwd);
-		plan_fwd = nullptr;
+#ifdef _OPENMP
+#pragma omp critical(fftw_planner)
+#endif
+	{
+		if (plan_fwd) fftw_destroy_plan(plan_fwd);
+		if (plan_bwd) fftw_destroy_plan(plan_bwd);
 	}
 	fftw_free(fft_in);
 	fftw_free(fft_out);
 
+	plan_fwd = nullptr;
 	plan_bwd = nullptr;
 	fft_in = nullptr;
 	fft_out = nullptr;
+	fft_capacity = 0;
+	fft_rank = 0;
 
 	pnx = 1;
 	pny = 1;
@@ -682,45 +1051,23 @@ void Openholo::fftFree(void)
 
 void Openholo::fftwShift(Complex<Real>* src, Complex<Real>* dst, int nx, int ny, int type, bool bNormalized)
 {
-	Complex<Real>* tmp = new Complex<Real>[nx*ny];
-	memset(tmp, 0., sizeof(Complex<Real>)*nx*ny);
-	fftShift(nx, ny, src, tmp);
-
-	fftw_complex *in = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * nx * ny);
-	fftw_complex *out = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * nx * ny);
-	
-	memcpy(in, tmp, sizeof(Complex<Real>) * nx * ny);
-
-	fftw_plan plan = nullptr;
-	if (!plan_fwd && !plan_bwd) {
-		plan = fftw_plan_dft_2d(ny, nx, in, out, type, OPH_ESTIMATE);
-		fftw_execute(plan);
-	}
-	else {
-		if (type == OPH_FORWARD)
-			fftw_execute_dft(plan_fwd, in, out);
-		else if (type == OPH_BACKWARD)
-			fftw_execute_dft(plan_bwd, in, out);
-	}
+	// runs on the cached buffers and plans of fft2(), which are planned on the first call for a shape
+	if (!fftPlan(2, nx, ny, 1, type, OPH_ESTIMATE))
+		return;
 
-	int normalF = 1;
-	if (bNormalized) normalF = nx * ny;
-	memset(tmp, 0, sizeof(Complex<Real>)*nx*ny);
+	fftShift(nx, ny, src, (Complex<Real>*)fft_in);
+	fftw_execute(type == OPH_FORWARD ? plan_fwd : plan_bwd);
+	fftShift(nx, ny, (Complex<Real>*)fft_out, dst);
 
-	int k;
+	if (bNormalized) {
+		int normalF = nx * ny;
+		int k;
 #pragma omp parallel for private(k)
-	for (k = 0; k < nx*ny; k++) {
-		tmp[k][_RE] = out[k][_RE] / normalF;
-		tmp[k][_IM] = out[k][_IM] / normalF;
+		for (k = 0; k < nx*ny; k++) {
+			dst[k][_RE] /= normalF;
+			dst[k][_IM] /= normalF;
+		}
 	}
-	fftw_free(in);
-	fftw_free(out);
-	if (plan)
-		fftw_destroy_plan(plan);
-
-	memset(dst, 0, sizeof(Complex<Real>)*nx*ny);
-	fftShift(nx, ny, tmp, dst);
-	delete[] tmp;
 }
 
 void Openholo::fftShift(int nx, int ny, Complex<Real>* input, Complex<Real>* output)
@@ -777,6 +1124,7 @@ void Openholo::setWaveNum(int nNum)
 
 void Openholo::ophFree(void)
 {
+	fftFree();
 	ohcHeader header;
 	OHC_encoder->getOHCheader(header);
 	auto wavelength_num = header.fieldInfo.wavlenNum;
@@ -121,6 +121,21 @@ public:
 	*/
 	virtual bool saveAsImg(const char* fname, uint8_t bitsperpixel, uchar* src, int width, int height);
 
+	/**
+	* @brief Function for creating image files from separate color planes
+	* @details Each row is interleaved from the planes(width * height bytes each, plane 0 is stored as the last byte of a pixel)
+	*          while it is written, so no merged image is made.
+	* @param[in] fname Output file name
+	* @param[in] bitsperpixel Bit per pixel(8 * number of planes)
+	* @param[in] planes Color planes
+	* @param[in] width Number of pixel - width
+	* @param[in] height Number of pixel - height
+	* @return Type: <B>bool</B>\n
+	*				If the succeeds to save image file, the return value is <B>true</B>.\n
+	*				If the fails to save image file, the return value is <B>false</B>.
+	*/
+	bool saveAsImgPlanes(const char* fname, uint8_t bitsperpixel, uchar** planes, int width, int height);
+
 	/**
 	* @brief Function for loading image files
 	* @param[in] fname Input file name
@@ -149,6 +164,50 @@ public:
 	*/
 	virtual bool loadAsOhc(const char *fname);
 
+	/**
+	* @brief Function to read a region of OHC file through the mapped reader
+	* @details The file stays mapped between calls, and only the tiles touched by the region are decoded,
+	*          so the regions of a field larger than memory can be processed one by one.
+	*          context_.pixel_number is set to the size of the region, and complex_H holds it in the x-major order of the file.
+	* @param[in] fname File name
+	* @param[in] origin Top-left pixel of the region
+	* @param[in] size Number of pixels of the region
+	* @return Type: <B>bool</B>\n
+	*				If the succeeds to load the region, the return value is <B>true</B>.\n
+	*				If the fails to load the region, the return value is <B>false</B>.
+	*/
+	bool loadAsOhcRegion(const char *fname, const ivec2 origin, const ivec2 size);
+
+	/**
+	* @brief Function to turn the asynchronous save on or off
+	* @details While it is on, saveAsImgAsync() and saveAsOhcAsync() copy the data into a ring of reusable output buffers
+	*          and an I/O thread writes the files, so the next frame can be computed during the write.
+	*          When every buffer of the ring is waiting to be written, the caller is blocked until one is free.
+	* @param[in] bAsync Start(true) or finish(false) the I/O thread. Finishing waits for the queued files.
+	* @param[in] ringSize Number of output buffers.
+	*/
+	void setAsyncSave(bool bAsync, uint ringSize = 2);
+	bool isAsyncSave(void) { return save_queue != nullptr; }
+
+	/**
+	* @brief Function to queue an image file to the I/O thread. Same as saveAsImg() if the asynchronous save is off.
+	* @details The image is copied into an output buffer, so src can be reused as soon as it returns.
+	*/
+	bool saveAsImgAsync(const char* fname, uint8_t bitsperpixel, uchar* src, int width, int height);
+
+	/**
+	* @brief Function to queue complex_H as an OHC file to the I/O thread. Same as saveAsOhc() if the asynchronous save is off.
+	*/
+	bool saveAsOhcAsync(const char *fname);
+
+	/**
+	* @brief Function to wait until every queued file is written
+	* @return Type: <B>bool</B>\n
+	*				If every file since the last call is written, the return value is <B>true</B>.\n
+	*				If any of them failed, the return value is <B>false</B>.
+	*/
+	bool flushSave(void);
+
 	
 	/**
 	* @brief Function for getting the complex field
@@ -191,6 +250,16 @@ public:
 
 	void setWaveNum(int nNum);
 
+	/**
+	* @brief Function for setting the number of threads of the FFTW plans created afterwards
+	* @details The setting is global in FFTW, which has no getter for it, so the value is tracked here.
+	*          Plans executed concurrently from an OpenMP region should be created with 1 thread.
+	* @param[in] nThreads Number of threads.
+	* @return Type: <B>int</B>\n
+	*				The previous number of threads.
+	*/
+	static int setFFTWPlannerThreads(int nThreads);
+
 protected:
 	/**
 	* @brief Function for loading image files | Output image data upside down
@@ -234,6 +303,23 @@ protected:
 	* @param[in] bytesperpixel Bytes per pixel.
 	*/
 	void convertToFormatGray8(uchar* src, uchar* dst, int w, int h, int bytesperpixel);
+
+	/**
+	* @brief Function for mapping a whole file into memory as read only
+	* @param[in] fname Input file name.
+	* @param[out] size Size of the mapped view in bytes.
+	* @return Type: <B>uchar*</B>\n
+	*				If the function succeeds, the return value is <B>the mapped view's pointer</B>.\n
+	*				If the function fails, the return value is <B>nullptr</B>.
+	*/
+	uchar* mapFile(const char* fname, uint64_t& size);
+
+	/**
+	* @brief Function for releasing a view returned by mapFile
+	* @param[in] view Mapped view's pointer.
+	* @param[in] size Size of the mapped view in bytes.
+	*/
+	void unmapFile(uchar* view, uint64_t size);
 	
 	/**
 	* @brief Functions for performing fftw 1-dimension operations inside Openholo
@@ -266,6 +352,9 @@ protected:
 	* @param[out] out Dest of data.
 	*/
 	void fftExecute(Complex<Real>* out, bool bReverse = false);
+	/**
+	* @brief Release the fftw buffers and plans, which fft1, fft2, fft3 and fftwShift otherwise keep while the shape is unchanged
+	*/
 	void fftFree(void);
 	/**
 	* @brief Convert data from the spatial domain to the frequency domain using 2D FFT on CPU.
@@ -293,15 +382,53 @@ protected:
 	*/
 	virtual void ophFree(void);
 
+	/**
+	* @brief Function to write a bitmap(or a converted image) row by row from src in file order, or from planes if src is nullptr
+	*/
+	bool writeImg(const char* fname, uint8_t bitsperpixel, uchar* src, int width, int height, bool bRotate = false, uchar** planes = nullptr);
+
+	/**
+	* @brief Interleave color planes into dst in file order, with the same 4-byte aligned rows writeImg() produces from planes
+	*/
+	void interleavePlanes(uint8_t bitsperpixel, uchar** planes, int width, int height, uchar* dst);
+
+	/**
+	* @brief Set the context from the OHC header of OHC_decoder and (re)allocate complex_H for pixel_number pixels.
+	*        complex_H is kept when the wavelength and pixel counts are unchanged.
+	*/
+	void prepareOhcField(const ivec2 pixel_number);
+
+	/**
+	* @brief Asynchronous save : take a free output buffer of at least size bytes(blocks while all are in use),
+	*        then hand it to the I/O thread with submitSaveImg().
+	*/
+	uchar* acquireSaveBuffer(ulonglong size, int& slot);
+	void submitSaveImg(int slot, const char* fname, uint8_t bitsperpixel, int width, int height);
+
 private:
+	/**
+	* @brief (Re)plan the rank-dimensional nx * ny * nz transform in sign direction on fft_in/fft_out.
+	*        Buffers and plans are reused while the shape is unchanged.
+	*/
+	bool fftPlan(int rank, int nx, int ny, int nz, int sign, uint flag);
+
 	/**
 	* @brief fftw-library variables for running fft inside Openholo
 	*/
 	fftw_plan plan_fwd, plan_bwd;
 	fftw_complex *fft_in, *fft_out;
+	size_t fft_capacity;
+	int fft_rank;
 	int pnx, pny, pnz;
 	int fft_sign;
 
+	/**
+	* @brief Asynchronous save queue and I/O thread
+	*/
+	struct SaveQueue;
+	SaveQueue* save_queue;
+	void saveWorker(void);
+
 protected:
 	OphConfig context_;
 	Complex<Real>** complex_H;
@@ -344,8 +471,11 @@ protected:
 	inline 	void setPhaseEncodingOHC(const BPhaseCode phase_code, const vec2 phase_code_range)
 		{ OHC_encoder->setPhaseEncoding(phase_code, phase_code_range); }
 
-	//inline void setCompressedFormatType(const CompresType compress_type)
-	//	{ OHC_encoder->setCompressedFormatType(compress_type); }
+	inline void setFieldDataTypeOHC(const DataType data_type)
+		{ OHC_encoder->setFieldDataType(data_type); }
+
+	inline void setCompressedFormatTypeOHC(const CompresType compress_type)
+		{ OHC_encoder->setCompressedFormatType(compress_type); }
 
 	/**
 	* @brief Function to add ComplexField when adding wavelength data
@@ -44,8 +44,19 @@
 //M*/
 
 #include "PLYparser.h"
+#include "sys.h"
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 PLYparser::PLYparser()
+	: stream_data(nullptr)
+	, stream_size(0)
+	, stream_pos(0)
+	, stream_read(0)
+	, stream_layout(nullptr)
+	, stream_channels(0)
 {
 	PropertyTable.insert(std::make_pair(Type::INT8, std::make_pair(1, "char")));
 	PropertyTable.insert(std::make_pair(Type::UINT8, std::make_pair(1, "uchar")));
@@ -60,6 +71,7 @@ PLYparser::PLYparser()
 
 PLYparser::~PLYparser()
 {
+	closePLYStream();
 }
 
 PLYparser::PlyProperty::PlyProperty(std::istream &is)
@@ -135,309 +147,631 @@ bool PLYparser::findIdxOfPropertiesAndElement(const std::vector<PlyElement> &ele
 	else return false;
 }
 
-bool PLYparser::loadPLY(const std::string& fileName, ulonglong &n_points, int &color_channels, Real** vertexArray, Real** colorArray, Real** phaseArray, bool &isPhaseParse) {
-	std::string inputPath = fileName;
-	if ((fileName.find(".ply") == std::string::npos) && (fileName.find(".PLY") == std::string::npos)) inputPath += ".ply";
-	std::ifstream File(inputPath, std::ios::in | std::ios::binary);
-
+struct PLYparser::PlyLayout {
 	bool isBinary = false;
 	bool isBigEndian = false;
+	ulonglong n_points = 0;
+	ulonglong vertexOffset = 0;		//first byte of the vertex element in the file
+	bool ok_channel = false;
+	int channel = 0;
+	bool ok_color = false;			//vertex colors are loaded only if the file has no face element
+	bool isPhase = false;
+	bool colorInt[3] = { true, true, true };	//integer colors are scaled by 1/255
+	std::vector<Type> type;			//per vertex property
+	std::vector<Type> listType;		//INVALID if the property is not a list
+	std::vector<int> target;		//0~2 : x, y, z, 3~5 : red, green, blue, 6 : phase, -1 : skipped
+	std::vector<int> offset;		//byte offset of each property in a vertex
+	int stride = 0;					//bytes of a vertex, 0 if the vertex has list properties
+};
+
+static inline int plyTypeSize(const int type)
+{
+	static const int size[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+	return (type >= 0 && type < 9) ? size[type] : 0;
+}
+
+/* binary property value, byte swapped for big endian files */
+static inline double plyReadBinary(const uchar* p, const int type, const bool bSwap)
+{
+	uchar b[8];
+	int n = plyTypeSize(type);
+	if (bSwap) for (int i = 0; i < n; i++) b[i] = p[n - 1 - i];
+	else memcpy(b, p, n);
+
+	switch (type) {
+	case 1: return (double)*(int8_t*)b;
+	case 2: return (double)*(uint8_t*)b;
+	case 3: { int16_t v; memcpy(&v, b, 2); return (double)v; }
+	case 4: { uint16_t v; memcpy(&v, b, 2); return (double)v; }
+	case 5: { int32_t v; memcpy(&v, b, 4); return (double)v; }
+	case 6: { uint32_t v; memcpy(&v, b, 4); return (double)v; }
+	case 7: { float v; memcpy(&v, b, 4); return (double)v; }
+	case 8: { double v; memcpy(&v, b, 8); return v; }
+	default: return 0.0;
+	}
+}
+
+template<typename T>
+static inline void plyStore(T* vertexArray, T* colorArray, T* phaseArray, const bool* colorInt,
+	const ulonglong i, const int target, const double v)
+{
+	if (target < 3) vertexArray[3 * i + target] = (T)v;
+	else if (target < 6) colorArray[3 * i + target - 3] = (T)(colorInt[target - 3] ? v / 255.0 : v);
+	else if (phaseArray) phaseArray[i] = (T)v;
+}
+
+/* color channels of loaded points, as the point cloud generators expect them */
+template<typename T>
+static void plyColorChannels(const bool ok_channel, const int channel, const ulonglong n_points, int &color_channels, T* colorArray)
+{
+	color_channels = channel;
+	if (ok_channel && (color_channels == 1)) {
+		//gray : first n_points entries of the color array
+		for (ulonglong i = 0; i < n_points; ++i) {
+			colorArray[i] = colorArray[3 * i];
+		}
+	}
+	else if (!ok_channel) {
+		bool check = false;
+		for (ulonglong i = 0; i < n_points; ++i) {
+			if ((colorArray[3 * i + 0] != colorArray[3 * i + 1]) || (colorArray[3 * i + 1] != colorArray[3 * i + 2])) {
+				check = true;
+				break;
+			}
+		}
+
+		if (check) color_channels = 3;
+		else {
+			color_channels = 1;
+			for (ulonglong i = 0; i < n_points * 3; ++i) {
+				colorArray[i] = (T)0.5;
+			}
+		}
+	}
+}
+
+static inline bool plyIsSpace(const char c)
+{
+	return (c == ' ') || (c == '\t') || (c == '\r');
+}
+
+/* ASCII number parser : exact for up to 15 significant digits with a small exponent, strtod for the rest */
+static inline double plyParseNumber(const char*& p, const char* end)
+{
+	static const double pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+	const char* s = p;
+	bool neg = false;
+	if (p < end && (*p == '-' || *p == '+')) neg = (*p++ == '-');
+
+	ulonglong m = 0;
+	int nDigit = 0;
+	int exp10 = 0;
+	bool ok = false;
+	for (; p < end && *p >= '0' && *p <= '9'; p++, ok = true) {
+		if (nDigit < 16) { m = m * 10 + (*p - '0'); if (m) nDigit++; }
+		else { exp10++; nDigit++; }
+	}
+	if (p < end && *p == '.') {
+		for (p++; p < end && *p >= '0' && *p <= '9'; p++, ok = true) {
+			if (nDigit < 16) { m = m * 10 + (*p - '0'); if (m) nDigit++; exp10--; }
+			else nDigit++;
+		}
+	}
+	if (ok && p < end && (*p == 'e' || *p == 'E')) {
+		const char* q = p + 1;
+		bool eNeg = false;
+		if (q < end && (*q == '-' || *q == '+')) eNeg = (*q++ == '-');
+		if (q < end && *q >= '0' && *q <= '9') {
+			int e = 0;
+			for (; q < end && *q >= '0' && *q <= '9'; q++) if (e < 10000) e = e * 10 + (*q - '0');
+			exp10 += eNeg ? -e : e;
+			p = q;
+		}
+	}
+
+	if (ok && nDigit <= 15 && exp10 >= -22 && exp10 <= 22 && (p == end || plyIsSpace(*p) || *p == '\n')) {
+		double v = (exp10 < 0) ? (double)m / pow10[-exp10] : (double)m * pow10[exp10];
+		return neg ? -v : v;
+	}
+
+	//slow path : long mantissa, large exponent, inf/nan
+	p = s;
+	while (p < end && !plyIsSpace(*p) && *p != '\n') p++;
+	char buf[64];
+	size_t len = std::min<size_t>(p - s, sizeof(buf) - 1);
+	memcpy(buf, s, len);
+	buf[len] = '\0';
+	return strtod(buf, nullptr);
+}
+
+bool PLYparser::readPLYLayout(const uchar* data, const ulonglong size, PlyLayout &layout)
+{
 	std::vector<PlyElement> elements;
 	std::vector<std::string> comments;
-	std::vector<std::string> objInfo;
+	const char* text = (const char*)data;
+	ulonglong pos = 0;
+	bool bEnd = false;
+	bool bFirst = true;
+
+	//parse PLY header
+	while (pos < size) {
+		const char* eol = (const char*)memchr(text + pos, '\n', size - pos);
+		ulonglong next = eol ? (eol - text) + 1 : size;
+		std::string line(text + pos, text + next - (eol ? 1 : 0));
+		if (!line.empty() && line.back() == '\r') line.pop_back();
+		pos = next;
 
-	if (File.is_open()) {
-		//parse header
-		std::string line;
-		std::getline(File, line);
 		std::istringstream lineStr(line);
 		std::string token;
-		lineStr.clear();
 		lineStr >> token;
 
-		if ((token != "ply") && (token != "PLY")) {
-			std::cerr << "Error : Failed loading ply file..." << std::endl;
-			File.close();
-			return false;
+		if (bFirst) {
+			if ((token != "ply") && (token != "PLY")) return false;
+			bFirst = false;
 		}
-		else {
+		else if (token == "comment") comments.push_back((8 > 0) ? line.erase(0, 8) : line);
+		else if (token == "format") {
+			std::string str;
+			lineStr >> str;
+			if (str == "binary_little_endian") layout.isBinary = true;
+			else if (str == "binary_big_endian") layout.isBinary = layout.isBigEndian = true;
+		}
+		else if (token == "element") elements.emplace_back(lineStr);
+		else if (token == "property") {
+			if (!elements.size()) {
+				std::cerr << "No Elements defined, file is malformed" << std::endl;
+				return false;
+			}
+			elements.back().properties.emplace_back(lineStr);
+		}
+		else if (token == "end_header") {
+			bEnd = true;
+			break;
+		}
+	}
+	if (!bEnd) return false;
+
 #ifdef _DEBUG
-			std::cout << "Parsing *.PLY file for OpenHolo Point Cloud Generation..." << std::endl;
+	//print comment list
+	for (auto cmt : comments) {
+		std::cout << "Comment : " << cmt << std::endl;
+	}
+
+	//print element and property list
+	for (auto elmnt : elements) {
+		std::cout << "Element - " << elmnt.name << " : ( " << elmnt.size << " )" << std::endl;
+		for (auto Property : elmnt.properties) {
+			std::cout << "\tProperty : " << Property.name << " : ( " << PropertyTable[Property.propertyType].second << " )" << std::endl;
+		}
+	}
 #endif
-			//parse PLY header
-			while (std::getline(File, line)) {
-				//std::istringstream lineStr(line);
-				lineStr.clear();
-				lineStr.str(line);
-				std::istream(lineStr.rdbuf()) >> token;
 
-				if (token == "comment") {
-					comments.push_back((8 > 0) ? line.erase(0, 8) : line);
+	longlong idxE_color = -1;
+	int idxP_channel = -1;
+	layout.ok_channel = findIdxOfPropertiesAndElement(elements, "color", "channel", idxE_color, idxP_channel);
+
+	longlong idxE_vertex = -1;
+	int idxP[7] = { -1, -1, -1, -1, -1, -1, -1 };
+	bool ok_vertex = findIdxOfPropertiesAndElement(elements, "vertex", "x", idxE_vertex, idxP[0]);
+	ok_vertex = findIdxOfPropertiesAndElement(elements, "vertex", "y", idxE_vertex, idxP[1]) && ok_vertex;
+	ok_vertex = findIdxOfPropertiesAndElement(elements, "vertex", "z", idxE_vertex, idxP[2]) && ok_vertex;
+	if (!ok_vertex) {
+		std::cerr << "Error : file is not having vertices data..." << std::endl;
+		return false;
+	}
+
+	longlong idxE_face = -1;
+	int idxP_list = -1;
+	bool ok_face = findIdxOfPropertiesAndElement(elements, "face", "vertex_indices", idxE_face, idxP_list);
+
+	bool ok_color = findIdxOfPropertiesAndElement(elements, "vertex", "red", idxE_vertex, idxP[3]);
+	ok_color = findIdxOfPropertiesAndElement(elements, "vertex", "green", idxE_vertex, idxP[4]) && ok_color;
+	ok_color = findIdxOfPropertiesAndElement(elements, "vertex", "blue", idxE_vertex, idxP[5]) && ok_color;
+	if (!ok_color) {
+		ok_color = findIdxOfPropertiesAndElement(elements, "vertex", "diffuse_red", idxE_vertex, idxP[3]);
+		ok_color = findIdxOfPropertiesAndElement(elements, "vertex", "diffuse_green", idxE_vertex, idxP[4]) && ok_color;
+		ok_color = findIdxOfPropertiesAndElement(elements, "vertex", "diffuse_blue", idxE_vertex, idxP[5]) && ok_color;
+	}
+	layout.ok_color = ok_color && !ok_face;
+	layout.isPhase = findIdxOfPropertiesAndElement(elements, "vertex", "phase", idxE_vertex, idxP[6]);
+
+	//compile the vertex layout
+	const PlyElement &vertex = elements[idxE_vertex];
+	int nProp = (int)vertex.properties.size();
+	layout.n_points = vertex.size;
+	layout.type.resize(nProp);
+	layout.listType.resize(nProp);
+	layout.target.assign(nProp, -1);
+	layout.offset.resize(nProp);
+	layout.stride = 0;
+	bool bFixed = true;
+	for (int p = 0; p < nProp; p++) {
+		const PlyProperty &prop = vertex.properties[p];
+		layout.type[p] = prop.propertyType;
+		layout.listType[p] = prop.isList ? prop.listType : Type::INVALID;
+		layout.offset[p] = layout.stride;
+		layout.stride += PropertyTable[prop.propertyType].first;
+		if (prop.isList) bFixed = false;
+	}
+	for (int k = 0; k < 7; k++) {
+		if (idxP[k] < 0 || (k >= 3 && k < 6 && !layout.ok_color)) continue;
+		layout.target[idxP[k]] = k;
+		if (k >= 3 && k < 6)
+			layout.colorInt[k - 3] = (layout.type[idxP[k]] != Type::FLOAT32) && (layout.type[idxP[k]] != Type::FLOAT64);
+	}
+	if (!bFixed) layout.stride = 0;
+
+	//skip the elements ahead of the vertex element, reading the color channel on the way
+	for (longlong idxE = 0; idxE < idxE_vertex; ++idxE) {
+		const PlyElement &elmnt = elements[idxE];
+		for (longlong e = 0; e < elmnt.size; ++e) {
+			if (layout.isBinary) {
+				for (int p = 0; p < (int)elmnt.properties.size(); ++p) {
+					const PlyProperty &prop = elmnt.properties[p];
+					int nSize = PropertyTable[prop.propertyType].first;
+					ulonglong nCnt = 1;
+					if (prop.isList) {
+						int nList = PropertyTable[prop.listType].first;
+						if (pos + nList > size) return false;
+						nCnt = (ulonglong)plyReadBinary(data + pos, (int)prop.listType, layout.isBigEndian);
+						pos += nList;
+					}
+					if (pos + nCnt * nSize > size) return false;
+					if (idxE == idxE_color && p == idxP_channel && e == 0)
+						layout.channel = (int)plyReadBinary(data + pos, (int)prop.propertyType, layout.isBigEndian);
+					pos += nCnt * nSize;
 				}
-				else if (token == "format") {
-					std::string str;
-					lineStr.clear();
-					lineStr >> str;
-					if (str == "binary_little_endian") isBinary = true;
-					else if (str == "binary_big_endian") isBinary = isBigEndian = true;
+			}
+			else {
+				const char* eol = (const char*)memchr(text + pos, '\n', size - pos);
+				if (idxE == idxE_color && e == 0) {
+					const char* p = text + pos;
+					const char* lineEnd = eol ? eol : text + size;
+					while (p < lineEnd && plyIsSpace(*p)) p++;
+					layout.channel = (int)plyParseNumber(p, lineEnd);
 				}
-				else if (token == "element") {
-					elements.emplace_back(lineStr);
+				pos = eol ? (eol - text) + 1 : size;
+			}
+		}
+	}
+	layout.vertexOffset = pos;
+
+	return true;
+}
+
+/* sequential decode of count vertices starting at p, returns the byte after them (nullptr if the body is short) */
+template<typename T>
+const uchar* PLYparser::decodePLYPoints(const uchar* p, const uchar* end, const PlyLayout &layout,
+	const ulonglong count, T* vertexArray, T* colorArray, T* phaseArray)
+{
+	const int nProp = (int)layout.type.size();
+	const bool bSwap = layout.isBigEndian;
+
+	for (ulonglong i = 0; i < count; i++) {
+		// BINARY
+		if (layout.isBinary) {
+			for (int q = 0; q < nProp; q++) {
+				int nSize = PropertyTable[layout.type[q]].first;
+				ulonglong nCnt = 1;
+				if (layout.listType[q] != Type::INVALID) {
+					int nList = PropertyTable[layout.listType[q]].first;
+					if (p + nList > end) return nullptr;
+					nCnt = (ulonglong)plyReadBinary(p, (int)layout.listType[q], bSwap);
+					p += nList;
 				}
-				else if (token == "property") {
-					if (!elements.size()) std::cerr << "No Elements defined, file is malformed" << std::endl;
-					elements.back().properties.emplace_back(lineStr);
+				if (p + nCnt * nSize > end) return nullptr;
+				if (layout.target[q] >= 0 && nCnt > 0)
+					plyStore(vertexArray, colorArray, phaseArray, layout.colorInt, i, layout.target[q], plyReadBinary(p, (int)layout.type[q], bSwap));
+				p += nCnt * nSize;
+			}
+		}
+		// ASCII
+		else {
+			if (p >= end) return nullptr;
+			const char* c = (const char*)p;
+			const char* eol = (const char*)memchr(c, '\n', end - p);
+			const char* lineEnd = eol ? eol : (const char*)end;
+
+			//line Processing
+			for (int q = 0; q < nProp; q++) {
+				while (c < lineEnd && plyIsSpace(*c)) c++;
+				if (c >= lineEnd) break;
+				if (layout.target[q] < 0) {
+					while (c < lineEnd && !plyIsSpace(*c)) c++;
+					continue;
 				}
-				else if (token == "obj_info") objInfo.push_back((9 > 0) ? line.erase(0, 9) : line);
-				else if (token == "end_header") break;
+				plyStore(vertexArray, colorArray, phaseArray, layout.colorInt, i, layout.target[q], plyParseNumber(c, lineEnd));
 			}
+			p = eol ? (const uchar*)eol + 1 : end;
+		}
+	}
+	return p;
+}
 
-#ifdef _DEBUG
-			//print comment list
-			for (auto cmt : comments) {
-				std::cout << "Comment : " << cmt << std::endl;
+template<typename T>
+bool PLYparser::decodePLYVertex(const uchar* data, const ulonglong size, const PlyLayout &layout,
+	int &color_channels, T* vertexArray, T* colorArray, T* phaseArray)
+{
+	const ulonglong n_points = layout.n_points;
+	const int nProp = (int)layout.type.size();
+	if (!layout.isPhase) phaseArray = nullptr;
+
+	std::memset(vertexArray, 0, sizeof(T) * 3 * n_points);
+	std::memset(colorArray, 0, sizeof(T) * 3 * n_points);
+	if (phaseArray) std::memset(phaseArray, 0, sizeof(T) * n_points);
+
+	// BINARY, fixed size vertices : decoded in parallel by stride
+	if (layout.isBinary && layout.stride > 0) {
+		const uchar* body = data + layout.vertexOffset;
+		const ulonglong stride = layout.stride;
+		const bool bSwap = layout.isBigEndian;
+		if (layout.vertexOffset + stride * n_points > size) return false;
+
+		longlong i;
+#ifdef _OPENMP
+#pragma omp parallel for private(i)
+#endif
+		for (i = 0; i < (longlong)n_points; i++) {
+			const uchar* vtx = body + stride * i;
+			for (int q = 0; q < nProp; q++) {
+				if (layout.target[q] < 0) continue;
+				plyStore(vertexArray, colorArray, phaseArray, layout.colorInt, i, layout.target[q],
+					plyReadBinary(vtx + layout.offset[q], (int)layout.type[q], bSwap));
 			}
+		}
+	}
+	// BINARY with list properties : every vertex has its own size
+	else if (layout.isBinary) {
+		if (!decodePLYPoints(data + layout.vertexOffset, data + size, layout, n_points, vertexArray, colorArray, phaseArray))
+			return false;
+	}
+	// ASCII : newline aligned chunks decoded in parallel
+	else {
+		const uchar* body = data + layout.vertexOffset;
+		const uchar* end = data + size;
+		const ulonglong len = end - body;
+		int nChunk = 1;
+#ifdef _OPENMP
+		nChunk = omp_get_max_threads() * 4;
+#endif
+		if ((ulonglong)nChunk > len / 4096 + 1) nChunk = (int)(len / 4096 + 1);
+
+		//chunk boundaries at line starts
+		std::vector<const uchar*> bound(nChunk + 1);
+		bound[0] = body;
+		bound[nChunk] = end;
+		for (int k = 1; k < nChunk; k++) {
+			const uchar* p = body + len * k / nChunk;
+			if (p < bound[k - 1]) p = bound[k - 1];
+			const uchar* eol = (const uchar*)memchr(p, '\n', end - p);
+			bound[k] = eol ? eol + 1 : end;
+		}
 
-			//print element and property list
-			for (auto elmnt : elements) {
-				std::cout << "Element - " << elmnt.name << " : ( " << elmnt.size << " )" << std::endl;
-				for (auto Property : elmnt.properties) {
-					auto tmp = PropertyTable[Property.propertyType].second;
-					std::cout << "\tProperty : " << Property.name << " : ( " << PropertyTable[Property.propertyType].second << " )" << std::endl;
-				}
+		//lines of each chunk, then the index of its first vertex
+		std::vector<ulonglong> first(nChunk + 1, 0);
+		int k;
+#ifdef _OPENMP
+#pragma omp parallel for private(k)
+#endif
+		for (k = 0; k < nChunk; k++) {
+			ulonglong nLine = 0;
+			for (const uchar* p = bound[k]; p && p < bound[k + 1]; nLine++) {
+				p = (const uchar*)memchr(p, '\n', bound[k + 1] - p);
+				if (p) p++;
 			}
+			first[k + 1] = nLine;
+		}
+		for (k = 0; k < nChunk; k++) first[k + 1] += first[k];
+		if (first[nChunk] < n_points) return false;
+
+#ifdef _OPENMP
+#pragma omp parallel for private(k) schedule(dynamic)
 #endif
-			longlong idxE_color = -1;
-			int idxP_channel = -1;
-			bool ok_channel = findIdxOfPropertiesAndElement(elements, "color", "channel", idxE_color, idxP_channel);
+		for (k = 0; k < nChunk; k++) {
+			if (first[k] >= n_points) continue;
+			ulonglong count = std::min(first[k + 1], n_points) - first[k];
+			decodePLYPoints(bound[k], bound[k + 1], layout, count,
+				vertexArray + 3 * first[k], colorArray + 3 * first[k], phaseArray ? phaseArray + first[k] : nullptr);
+		}
+	}
 
-			longlong idxE_vertex = -1;
-			int idxP_x = -1;
-			int idxP_y = -1;
-			int idxP_z = -1;
-			bool ok_vertex = findIdxOfPropertiesAndElement(elements, "vertex", "x", idxE_vertex, idxP_x);
-			ok_vertex = findIdxOfPropertiesAndElement(elements, "vertex", "y", idxE_vertex, idxP_y);
-			ok_vertex = findIdxOfPropertiesAndElement(elements, "vertex", "z", idxE_vertex, idxP_z);
-			if (!ok_vertex) {
-				std::cerr << "Error : file is not having vertices data..." << std::endl;
-				return false;
-			}
+	plyColorChannels(layout.ok_channel, layout.channel, n_points, color_channels, colorArray);
+	return true;
+}
 
-			longlong idxE_face = -1;
-			int idxP_list = -1;
-			int idxP_red = -1;
-			int idxP_green = -1;
-			int idxP_blue = -1;
-			int idxP_alpha = -1;
-			bool ok_face = findIdxOfPropertiesAndElement(elements, "face", "vertex_indices", idxE_face, idxP_list);
+template<typename T>
+bool PLYparser::loadPLYInto(const std::string& fileName, const ulonglong n_points, int &color_channels,
+	T* vertexArray, T* colorArray, T* phaseArray)
+{
+	std::string inputPath = fileName;
+	if ((fileName.find(".ply") == std::string::npos) && (fileName.find(".PLY") == std::string::npos)) inputPath += ".ply";
 
-			bool ok_alpha = findIdxOfPropertiesAndElement(elements, "face", "alpha", idxE_face, idxP_alpha);
+	ulonglong size = 0;
+	uchar* data = file_map_read(inputPath.c_str(), &size);
+	if (!data) {
+		std::cerr << "Error : Failed loading ply file..." << std::endl;
+		return false;
+	}
 
-			bool ok_color = findIdxOfPropertiesAndElement(elements, "vertex", "red", idxE_vertex, idxP_red);
-			ok_color = findIdxOfPropertiesAndElement(elements, "vertex", "green", idxE_vertex, idxP_green);
-			ok_color = findIdxOfPropertiesAndElement(elements, "vertex", "blue", idxE_vertex, idxP_blue);
+	PlyLayout layout;
+	bool ok = readPLYLayout(data, size, layout);
+	if (ok && (layout.n_points != n_points || !vertexArray || !colorArray)) {
+		std::cerr << "Error : arrays are not sized for the ply file..." << std::endl;
+		ok = false;
+	}
+	if (ok) {
+		file_map_prefetch(data + layout.vertexOffset, size - layout.vertexOffset);
+		ok = decodePLYVertex(data, size, layout, color_channels, vertexArray, colorArray, phaseArray);
+	}
+	file_unmap(data, size);
 
-			if (!ok_color) {
-				if (ok_vertex) {
-					ok_color = findIdxOfPropertiesAndElement(elements, "vertex", "diffuse_red", idxE_vertex, idxP_red);
-					ok_color = findIdxOfPropertiesAndElement(elements, "vertex", "diffuse_green", idxE_vertex, idxP_green);
-					ok_color = findIdxOfPropertiesAndElement(elements, "vertex", "diffuse_blue", idxE_vertex, idxP_blue);
-				}
-				if (!ok_color && ok_face) {
-					ok_color = findIdxOfPropertiesAndElement(elements, "face", "red", idxE_face, idxP_red);
-					ok_color = findIdxOfPropertiesAndElement(elements, "face", "green", idxE_face, idxP_green);
-					ok_color = findIdxOfPropertiesAndElement(elements, "face", "blue", idxE_face, idxP_blue);
+	if (!ok) std::cerr << "Error : Failed loading ply file..." << std::endl;
+	return ok;
+}
 
-				}
-			}
+bool PLYparser::loadPLYHeader(const std::string& fileName, ulonglong &n_points, int &color_channels, bool &isPhaseParse)
+{
+	std::string inputPath = fileName;
+	if ((fileName.find(".ply") == std::string::npos) && (fileName.find(".PLY") == std::string::npos)) inputPath += ".ply";
 
-			int idxP_phase = -1;
-			isPhaseParse = findIdxOfPropertiesAndElement(elements, "vertex", "phase", idxE_vertex, idxP_phase);
-			if (!isPhaseParse) *phaseArray = nullptr;
+	ulonglong size = 0;
+	uchar* data = file_map_read(inputPath.c_str(), &size);
+	if (!data) {
+		std::cerr << "Error : Failed loading ply file..." << std::endl;
+		return false;
+	}
 
-			
+	PlyLayout layout;
+	bool ok = readPLYLayout(data, size, layout);
+	file_unmap(data, size);
+	if (!ok) {
+		std::cerr << "Error : Failed loading ply file..." << std::endl;
+		return false;
+	}
 
+	n_points = layout.n_points;
+	color_channels = layout.ok_channel ? layout.channel : 0;
+	isPhaseParse = layout.isPhase;
+	return true;
+}
 
-			n_points = elements[idxE_vertex].size;
-			*vertexArray = new Real[3 * n_points];
-			*colorArray = new Real[3 * n_points];
-			std::memset(*vertexArray, NULL, sizeof(Real) * 3 * n_points);
-			std::memset(*colorArray, NULL, sizeof(Real) * 3 * n_points);
-			if (isPhaseParse) {
-				*phaseArray = new Real[n_points];
-				std::memset(*phaseArray, NULL, sizeof(Real) * n_points);
-			}
+bool PLYparser::loadPLY(const std::string& fileName, const ulonglong n_points, int &color_channels, Real* vertexArray, Real* colorArray, Real* phaseArray)
+{
+	return loadPLYInto(fileName, n_points, color_channels, vertexArray, colorArray, phaseArray);
+}
 
+bool PLYparser::loadPLY(const std::string& fileName, const ulonglong n_points, int &color_channels, Real_t* vertexArray, Real_t* colorArray, Real_t* phaseArray)
+{
+	return loadPLYInto(fileName, n_points, color_channels, vertexArray, colorArray, phaseArray);
+}
 
+bool PLYparser::openPLYStream(const std::string& fileName, ulonglong &n_points, int &color_channels, bool &isPhaseParse)
+{
+	closePLYStream();
 
-			//parse Point Cloud Data
-			for (size_t idxE = 0; idxE < elements.size(); ++idxE) {
-				for (longlong e = 0; e < elements[idxE].size; ++e) {
-					auto list = 0;
-					auto x = 0.0f;
-					auto y = 0.0f;
-					auto z = 0.0f;
-					auto red = 0;
-					auto green = 0;
-					auto blue = 0;
-					auto alpha = 0;
-					auto phase = 0.0f;
-					void *tmp = nullptr;
-
-					int nSize;
-					//if()
-
-					
-					// BINARY
-					if (isBinary) {
-						//vertex data parsing
-						if (idxE == idxE_vertex) {
-							//line Processing
-							for (int p = 0; p < elements[idxE].properties.size(); ++p) {
-								nSize = PropertyTable[elements[idxE].properties[p].propertyType].first;
-
-								if (p == idxP_x) tmp = &x;
-								else if (p == idxP_y) tmp = &y;
-								else if (p == idxP_z) tmp = &z;
-								else if (p == idxP_red) tmp = &red;
-								else if (p == idxP_green) tmp = &green;
-								else if (p == idxP_blue) tmp = &blue;
-								else if (p == idxP_phase && isPhaseParse) tmp = &phase;
-								else tmp = nullptr;
-								if (tmp)
-									File.read((char *)tmp, nSize);
-							}
-						}
-						//face data parsing
-						else if (idxE == idxE_face) {
-							//line Processing
-							for (int p = 0; p < elements[idxE].properties.size(); ++p) {
-								nSize = PropertyTable[elements[idxE].properties[p].propertyType].first;
-
-								if (elements[idxE].properties[p].isList) { // list type
-									int nList = PropertyTable[elements[idxE].properties[p].listType].first;
-									auto nCnt = 0;
-									File.read((char *)&nCnt, nList);
-									int *pTest = new int[nCnt];
-									for (int i = 0; i < nCnt; ++i) {
-										File.read((char *)&pTest[i], nSize);
-									}
-									delete[] pTest;
-								}
-
-								if (p == idxP_red) tmp = &red;
-								else if (p == idxP_green) tmp = &green;
-								else if (p == idxP_blue) tmp = &blue;
-								else if (p == idxP_alpha) tmp = &alpha;
-								else tmp = nullptr;
-								if (tmp)
-									File.read((char *)tmp, nSize);
-							}
-						}
-						//color channel parsing
-						else if (ok_channel && (idxE == idxE_color)) {
-							for (int p = 0; p < elements[idxE].properties.size(); ++p) {
-								nSize = PropertyTable[elements[idxE].properties[p].propertyType].first;
-								File.read((char *)&color_channels, nSize);
-							}
-						}
-					}
-					// ASCII
-					else {
-						std::getline(File, line);
-						lineStr.str(line);
-						std::string val;
-
-						//color channel parsing
-						if (ok_channel && (idxE == idxE_color)) {
-							lineStr.clear();
-							lineStr >> val;
-							color_channels = std::stoi(val);
-						}
+	std::string inputPath = fileName;
+	if ((fileName.find(".ply") == std::string::npos) && (fileName.find(".PLY") == std::string::npos)) inputPath += ".ply";
+
+	stream_data = file_map_read(inputPath.c_str(), &stream_size);
+	if (!stream_data) {
+		std::cerr << "Error : Failed loading ply file..." << std::endl;
+		return false;
+	}
+
+	stream_layout = new PlyLayout;
+	if (!readPLYLayout(stream_data, stream_size, *stream_layout)) {
+		closePLYStream();
+		std::cerr << "Error : Failed loading ply file..." << std::endl;
+		return false;
+	}
+	stream_pos = stream_layout->vertexOffset;
+	stream_read = 0;
+
+	const PlyLayout &layout = *stream_layout;
+	if (layout.ok_channel)
+		stream_channels = layout.channel;
+	else if (!layout.ok_color)
+		stream_channels = 1;	//no vertex colors : gray 0.5, as loadPLY
+	else {
+		//like loadPLY, colors are gray 0.5 when every vertex is gray : scan up to the first colored vertex
+		const ulonglong nChunk = 1 << 16;
+		std::vector<Real> vertex(3 * nChunk), color(3 * nChunk);
+		const uchar* p = stream_data + stream_pos;
+		bool bGray = true;
+		for (ulonglong done = 0; p && bGray && done < layout.n_points; done += nChunk) {
+			ulonglong count = std::min(nChunk, layout.n_points - done);
+			p = decodePLYPoints(p, stream_data + stream_size, layout, count, vertex.data(), color.data(), (Real*)nullptr);
+			for (ulonglong i = 0; p && bGray && i < count; i++)
+				bGray = (color[3 * i + 0] == color[3 * i + 1]) && (color[3 * i + 1] == color[3 * i + 2]);
+		}
+		stream_channels = bGray ? 1 : 3;
+	}
 
-						//vertex data parsing
-						if (idxE == idxE_vertex) {
+	n_points = layout.n_points;
+	color_channels = stream_channels;
+	isPhaseParse = layout.isPhase;
+	return true;
+}
 
-							//line Processing
-							for (int p = 0; p < elements[idxE].properties.size(); ++p) {
-								lineStr.clear();
+ulonglong PLYparser::readPLYStream(const ulonglong maxPoints, Real* vertexArray, Real* colorArray, Real* phaseArray)
+{
+	if (!stream_layout || stream_read >= stream_layout->n_points) return 0;
 
-								lineStr >> val;
+	const PlyLayout &layout = *stream_layout;
+	ulonglong count = std::min(maxPoints, layout.n_points - stream_read);
+	if (!layout.isPhase) phaseArray = nullptr;
 
-								if (p == idxP_x) x = std::stof(val);
-								else if (p == idxP_y) y = std::stof(val);
-								else if (p == idxP_z) z = std::stof(val);
-								else if (p == idxP_red) red = std::stoi(val);
-								else if (p == idxP_green) green = std::stoi(val);
-								else if (p == idxP_blue) blue = std::stoi(val);
-								else if ((p == idxP_phase) && isPhaseParse) phase = std::stof(val);
-							}
-						}
-					}
-#if 1
-					if (idxE == idxE_vertex) {
-						(*vertexArray)[3 * e + 0] = (Real)x;
-						(*vertexArray)[3 * e + 1] = (Real)y;
-						(*vertexArray)[3 * e + 2] = (Real)z;
-					}
-					if (!ok_face) {
-						(*colorArray)[3 * e + 0] = (Real)(red / 255.f);
-						(*colorArray)[3 * e + 1] = (Real)(green / 255.f);
-						(*colorArray)[3 * e + 2] = (Real)(blue / 255.f);
-					}
-					if (isPhaseParse) (*phaseArray)[e] = phase;
-#endif
-					
-				}
-			}
-			File.close();
+	std::memset(vertexArray, 0, sizeof(Real) * 3 * count);
+	std::memset(colorArray, 0, sizeof(Real) * 3 * count);
+	if (phaseArray) std::memset(phaseArray, 0, sizeof(Real) * count);
 
-			if (ok_channel && (color_channels == 1)) {
-				Real* grayArray = new Real[n_points];
-				for (ulonglong i = 0; i < n_points; ++i) {
-					grayArray[i] = (*colorArray)[3 * i];
-				}
-				delete[](*colorArray);
-				*colorArray = grayArray;
-			}
-			else if (!ok_channel) {
-				bool check = false;
-				for (ulonglong i = 0; i < n_points; ++i) {
-					if (((*colorArray)[3 * i + 0] != (*colorArray)[3 * i + 1]) || ((*colorArray)[3 * i + 1] != (*colorArray)[3 * i + 2])) {
-						check = true;
-						break;
-					}
-				}
+	const uchar* p = decodePLYPoints(stream_data + stream_pos, stream_data + stream_size, layout, count, vertexArray, colorArray, phaseArray);
+	if (!p) {
+		std::cerr << "Error : ply file is shorter than its header..." << std::endl;
+		stream_read = layout.n_points;
+		return 0;
+	}
+	stream_pos = p - stream_data;
+	stream_read += count;
 
-				if (check) color_channels = 3;
-				else if (!check) {
-					color_channels = 1;
-#if 0
-					Real* grayArray = new Real[n_points];
-					for (ulonglong i = 0; i < n_points; ++i) {
-						grayArray[i] = (*colorArray)[3 * i];
-					}
-					delete[](*colorArray);
-					*colorArray = grayArray;
-#else
+	if (stream_channels == 1) {
+		int color_channels;
+		plyColorChannels(layout.ok_channel, layout.channel, count, color_channels, colorArray);
+	}
+	return count;
+}
 
-					for (ulonglong i = 0; i < n_points * 3; ++i) {
-						(*colorArray)[i] = 0.5;
-					}
-#endif
-				}
-			}
+void PLYparser::closePLYStream()
+{
+	if (stream_data) file_unmap(stream_data, stream_size);
+	delete stream_layout;
+	stream_data = nullptr;
+	stream_layout = nullptr;
+	stream_size = stream_pos = stream_read = 0;
+	stream_channels = 0;
+}
+
+bool PLYparser::loadPLY(const std::string& fileName, ulonglong &n_points, int &color_channels, Real** vertexArray, Real** colorArray, Real** phaseArray, bool &isPhaseParse) {
+	std::string inputPath = fileName;
+	if ((fileName.find(".ply") == std::string::npos) && (fileName.find(".PLY") == std::string::npos)) inputPath += ".ply";
 
+	ulonglong size = 0;
+	uchar* data = file_map_read(inputPath.c_str(), &size);
+	if (!data) {
+		std::cerr << "Error : Failed loading ply file..." << std::endl;
+		return false;
+	}
 #ifdef _DEBUG
-			std::cout << "Success loading " << n_points << " Point Clouds, Color Channels : " << color_channels << std::endl;
+	std::cout << "Parsing *.PLY file for OpenHolo Point Cloud Generation..." << std::endl;
 #endif
-			return true;
-		}
+
+	PlyLayout layout;
+	if (!readPLYLayout(data, size, layout)) {
+		file_unmap(data, size);
+		std::cerr << "Error : Failed loading ply file..." << std::endl;
+		return false;
 	}
-	else {
+
+	n_points = layout.n_points;
+	isPhaseParse = layout.isPhase;
+	*vertexArray = new Real[3 * n_points];
+	*colorArray = new Real[3 * n_points];
+	*phaseArray = isPhaseParse ? new Real[n_points] : nullptr;
+
+	file_map_prefetch(data + layout.vertexOffset, size - layout.vertexOffset);
+	bool ok = decodePLYVertex(data, size, layout, color_channels, *vertexArray, *colorArray, *phaseArray);
+	file_unmap(data, size);
+
+	if (!ok) {
 		std::cerr << "Error : Failed loading ply file..." << std::endl;
 		return false;
 	}
+#ifdef _DEBUG
+	std::cout << "Success loading " << n_points << " Point Clouds, Color Channels : " << color_channels << std::endl;
+#endif
+	return true;
 }
 
 
@@ -139,6 +139,31 @@ private:
 		const std::string &propertyKeys,
 		longlong &elementIdx,
 		int &propertyIdx);
+
+	//vertex layout of a mapped point cloud file, compiled once from the header
+	struct PlyLayout;
+
+	bool readPLYLayout(const uchar* data, const ulonglong size, PlyLayout &layout);
+
+	template<typename T>
+	const uchar* decodePLYPoints(const uchar* p, const uchar* end, const PlyLayout &layout,
+		const ulonglong count, T* vertexArray, T* colorArray, T* phaseArray);
+
+	template<typename T>
+	bool decodePLYVertex(const uchar* data, const ulonglong size, const PlyLayout &layout,
+		int &color_channels, T* vertexArray, T* colorArray, T* phaseArray);
+
+	template<typename T>
+	bool loadPLYInto(const std::string& fileName, const ulonglong n_points, int &color_channels,
+		T* vertexArray, T* colorArray, T* phaseArray);
+
+	//point cloud stream
+	uchar* stream_data;
+	ulonglong stream_size;
+	ulonglong stream_pos;
+	ulonglong stream_read;
+	PlyLayout* stream_layout;
+	int stream_channels;			//color channels readPLYStream delivers
 	
 public:
 	bool loadPLY(					// for Point Cloud Data
@@ -150,6 +175,48 @@ public:
 		Real** phaseArray, //If isPhaseParse is false, PhaseArray is nullptr
 		bool &isPhaseParse);
 
+	bool loadPLYHeader(				// for Point Cloud Data : header only, to size the arrays of loadPLY below
+		const std::string& fileName,
+		ulonglong &n_points,
+		int &color_channels, //'channel' of the color element, 0 if the file has none
+		bool &isPhaseParse);
+
+	bool loadPLY(					// for Point Cloud Data : into preallocated arrays (vertex, color : 3 * n_points, phase : n_points or nullptr)
+		const std::string& fileName,
+		const ulonglong n_points,
+		int &color_channels,
+		Real* vertexArray,
+		Real* colorArray,
+		Real* phaseArray);
+
+	bool loadPLY(
+		const std::string& fileName,
+		const ulonglong n_points,
+		int &color_channels,
+		Real_t* vertexArray,
+		Real_t* colorArray,
+		Real_t* phaseArray);
+
+	/**
+	* @brief Point cloud stream : the file is mapped once, and readPLYStream decodes the next points into chunk sized arrays.
+	* @details color_channels follows loadPLY : the 'channel' of the color element if the file has one, otherwise 1 (gray 0.5)
+	*          when the vertices have no colors or every color is gray, and 3 for RGB. Files with colors but no channel element
+	*          are scanned once here, up to the first colored vertex, to tell gray from RGB.
+	*/
+	bool openPLYStream(
+		const std::string& fileName,
+		ulonglong &n_points,
+		int &color_channels,
+		bool &isPhaseParse);
+
+	ulonglong readPLYStream(		//number of points read, 0 at the end of the stream
+		const ulonglong maxPoints,
+		Real* vertexArray,			//3 * maxPoints
+		Real* colorArray,			//3 * maxPoints, gray files use the first maxPoints entries
+		Real* phaseArray);			//maxPoints or nullptr
+
+	void closePLYStream();
+
 	bool savePLY(					
 		const std::string& fileName,
 		const ulonglong n_points,
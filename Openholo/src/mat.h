@@ -43,6 +43,7 @@
 //
 //M*/
 
+
 #ifndef __mat_h
 #define __mat_h
 
@@ -52,13 +53,97 @@
 #include "define.h"
 
 #include <vector>
+#include <cstring>
+#include <utility>
+#include <type_traits>
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <stdlib.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using namespace oph;
 
 namespace oph
 {
+	template<typename T> class matrix;
+
+	/**
+	* @brief base of the lazy elementwise matrix expressions.
+	*        An expression is only evaluated when it is assigned to a matrix, in a single pass.
+	*/
+	template<typename E>
+	struct MatExpr
+	{
+		enum { isScalar = 0 };
+		const E& self(void) const { return static_cast<const E&>(*this); }
+	};
+
+	/**
+	* @brief scalar operand of a matrix expression
+	*/
 	template<typename T>
-	class _declspec(dllexport) matrix
+	struct MatScalar : public MatExpr<MatScalar<T>>
+	{
+		enum { isScalar = 1 };
+		typedef T value_type;
+
+		T val;
+
+		MatScalar(const T& _val) : val(_val) {}
+		const T& eval(size_t) const { return val; }
+		ivec2 getSize(void) const { return ivec2(0, 0); }
+	};
+
+	/**
+	* @brief matrices are held by reference, intermediate expressions by value
+	*/
+	template<typename E> struct MatOperand { typedef const E type; };
+	template<typename T> struct MatOperand<matrix<T>> { typedef const matrix<T>& type; };
+
+	struct MatOpAdd { template<typename V, typename A, typename B> static V apply(const A& a, const B& b) { V v(a); v += b; return v; } };
+	struct MatOpSub { template<typename V, typename A, typename B> static V apply(const A& a, const B& b) { V v(a); v -= b; return v; } };
+	struct MatOpMul { template<typename V, typename A, typename B> static V apply(const A& a, const B& b) { V v(a); v *= b; return v; } };
+	struct MatOpDiv { template<typename V, typename A, typename B> static V apply(const A& a, const B& b) { V v(a); v /= b; return v; } };
+	// element / element keeps the numerator where the denominator is zero (same as matrix::div)
+	struct MatOpDivSafe { template<typename V, typename A, typename B> static V apply(const A& a, const B& b) { V v(a); if (b == V(0)) return v; v /= b; return v; } };
+
+	/**
+	* @brief elementwise binary expression of two matrix expressions or of an expression and a scalar
+	*/
+	template<typename L, typename R, typename Op>
+	struct MatBinary : public MatExpr<MatBinary<L, R, Op>>
+	{
+		typedef typename std::conditional<L::isScalar != 0, typename R::value_type, typename L::value_type>::type value_type;
+
+		typename MatOperand<L>::type l;
+		typename MatOperand<R>::type r;
+
+		MatBinary(const L& _l, const R& _r) : l(_l), r(_r) {}
+
+		value_type eval(size_t i) const { return Op::template apply<value_type>(l.eval(i), r.eval(i)); }
+
+		// (0, 0) if the operands do not have the same size
+		ivec2 getSize(void) const {
+			if (L::isScalar) return r.getSize();
+			if (R::isScalar) return l.getSize();
+			return (l.getSize() == r.getSize()) ? l.getSize() : ivec2(0, 0);
+		}
+	};
+
+	/**
+	* @brief matrix stored in a single contiguous, 64-byte aligned buffer.
+	*        Element (x, y) is located at mat[x * size[_Y] + y] (row-major with size[_X] rows),
+	*        so data() can be handed to FFTW or memcpy as a size[_X] x size[_Y] array.
+	*        Operators + - * / between matrices and scalars are elementwise and lazy:
+	*        e.g. dst = (a - b) * 0.5 is evaluated in one parallel loop without temporaries.
+	*        mul() is the matrix product.
+	*/
+	template<typename T>
+	class _declspec(dllexport) matrix : public MatExpr<matrix<T>>
 	{
 	public:
 		using typeT = typename std::enable_if<
@@ -67,27 +152,39 @@ namespace oph
 			std::is_same<uchar, T>::value ||
 			std::is_same<Complex<Real>, T>::value || std::is_same<Complex<Real_t>, T>::value, T>::type;
 
-		std::vector<T>* mat;
+		enum { ALIGNMENT = 64 };
+		typedef T value_type;
+
+		T* mat;
 		ivec2 size;
 
-		matrix(void) : size(1, 1) {
+		matrix(void) : mat(nullptr), size(1, 1), capacity(0) {
 			init();
 		}
 
-		matrix(int x, int y) : size(x, y) {
+		matrix(int x, int y) : mat(nullptr), size(x, y), capacity(0) {
 			init();
 		}
 
-		matrix(ivec2 _size) : size(_size) {
+		matrix(ivec2 _size) : mat(nullptr), size(_size), capacity(0) {
 			init();
 		}
 
-		matrix(const matrix<T>& ref) : size(ref.size) {
-			init();
-			for (int x = 0; x < size[_X]; x++)
-				for (int y = 0; y < size[_Y]; y++) {
-					mat[x][y] = ref.mat[x][y];
-				}
+		matrix(const matrix<T>& ref) : mat(nullptr), size(ref.size), capacity(0) {
+			allocate(numel());
+			if (mat) memcpy(mat, ref.mat, sizeof(T) * numel());
+		}
+
+		template<typename E>
+		matrix(const MatExpr<E>& e) : mat(nullptr), size(e.self().getSize()), capacity(0) {
+			allocate(numel());
+			*this = e;
+		}
+
+		matrix(matrix<T>&& ref) noexcept : mat(ref.mat), size(ref.size), capacity(ref.capacity) {
+			ref.mat = nullptr;
+			ref.size = ivec2(0, 0);
+			ref.capacity = 0;
 		}
 
 		~matrix() {
@@ -95,54 +192,69 @@ namespace oph
 		}
 
 		void init(void) {
-			mat = new std::vector<T>[size[0]];
-			for (int x = 0; x < size[_X]; x++) {
-				for (int y = 0; y < size[_Y]; y++) {
-					if (x == y && size[_X] == size[_Y])
-						mat[x].push_back(1);
-					else
-						mat[x].push_back(0);
-				}
-			}
+			allocate(numel());
+			zeros();
 		}
 
 		void release(void) {
 			if (!mat) return;
-			delete[] mat;
+#ifdef _WIN32
+			_aligned_free(mat);
+#else
+			free(mat);
+#endif
 			mat = nullptr;
+			capacity = 0;
 		}
 
 		oph::ivec2& getSize(void) { return size; }
+		const oph::ivec2& getSize(void) const { return size; }
+
+		const T& eval(size_t i) const { return mat[i]; }
+
+		/**
+		* @brief number of elements (size[_X] * size[_Y])
+		*/
+		size_t numel(void) const { return (size_t)size[_X] * size[_Y]; }
+
+		/**
+		* @brief pointer to the first element of the contiguous buffer
+		*/
+		T* data(void) { return mat; }
+		const T* data(void) const { return mat; }
 
+		/**
+		* @brief change the dimension and clear all elements.
+		*/
 		matrix<T>& resize(int x, int y) {
-			release();
+			return resizeNoInit(x, y).zeros();
+		}
 
+		/**
+		* @brief change the dimension without clearing. The buffer is reused when it is large enough,
+		*        so the elements are undefined; only for callers that overwrite every element.
+		*/
+		matrix<T>& resizeNoInit(int x, int y) {
 			size[0] = x; size[1] = y;
 
-			init();
+			if (numel() > capacity) {
+				release();
+				allocate(numel());
+			}
 
 			return *this;
 		}
 
 		matrix<T>& identity(void) {
 			if (size[_X] != size[_Y]) return *this;
-			for (int x = 0; x < size[_X]; x++) {
-				for (int y = 0; y < size[_Y]; y++) {
-					if (x == y)
-						mat[x][y] = 1;
-					else
-						mat[x][y] = 0;
-				}
-			}
+			zeros();
+			for (int x = 0; x < size[_X]; x++)
+				mat[(size_t)x * size[_Y] + x] = 1;
 			return *this;
 		}
 
 		matrix<T>& zeros(void) {
-			for (int col = 0; col < size[_COL]; col++) {
-				for (int row = 0; row < size[_ROW]; row++) {
-					mat[col][row] = 0;
-				}
-			}
+			if (mat) memset(mat, 0, sizeof(T) * numel());
 			return *this;
 		}
 
@@ -228,28 +340,15 @@ namespace oph
 		//	return *this;
 		//}
 
+
 		matrix<T>& add(matrix<T>& p) {
 			if (size != p.size) return *this;
-
-			for (int x = 0; x < size[_X]; x++) {
-				for (int y = 0; y < size[_Y]; y++) {
-					mat[x][y] += p[x][y];
-				}
-			}
-
-			return *this;
+			return *this = *this + p;
 		}
 
 		matrix<T>& sub(matrix<T>& p) {
 			if (size != p.size) return *this;
-
-			for (int x = 0; x < size[_X]; x++) {
-				for (int y = 0; y < size[_Y]; y++) {
-					mat[x][y] -= p[x][y];
-				}
-			}
-
-			return *this;
+			return *this = *this - p;
 		}
 
 		matrix<T>& mul(matrix<T>& p) {
@@ -261,73 +360,91 @@ namespace oph
 				for (int y = 0; y < res.size[_Y]; y++) {
 					res[x][y] = 0;
 					for (int num = 0; num < p.size[_X]; num++) {
-						res[x][y] += mat[x][num] * p[num][y];
+						res[x][y] += (*this)(x, num) * p(num, y);
 					}
 				}
 			}
-			this->resize(res.size[_X], res.size[_Y]);
-			*this = res;
+			*this = std::move(res);
 
 			return *this;
 		}
 
 		matrix<T>& div(matrix<T>& p) {
 			if (size != p.size) return *this;
-
-			for (int x = 0; x < size[_X]; x++) {
-				for (int y = 0; y < size[_Y]; y++) {
-					if (p[x][y] == 0) continue;
-					mat[x][y] /= p[x][y];
-				}
-			}
-
-			return *this;
+			return *this = *this / p;
 		}
 
 		matrix<T>& mulElem(matrix<T>& p) {
 			if (size != p.size) return *this;
+			return *this = *this * p;
+		}
 
-			matrix<T> res(size);
 
-			for (int x = 0; x < res.size[_X]; x++) {
-				for (int y = 0; y < res.size[_Y]; y++) {
-					res[x][y] = 0;
-					res[x][y] = mat[x][y] * p.mat[x][y];
-				}
-			}
+		T* operator[](const int index) {
+			return mat + (size_t)index * size[_Y];
+		}
 
-			*this = res;
+		const T* operator[](const int index) const {
+			return mat + (size_t)index * size[_Y];
+		}
 
-			return *this;
+		T& operator ()(int x, int y) {
+			return mat[(size_t)x * size[_Y] + y];
+		}
+
+		const T& operator ()(int x, int y) const {
+			return mat[(size_t)x * size[_Y] + y];
 		}
 
+		inline matrix<T>& operator =(const matrix<T>& p) {
+			if (this == &p) return *this;
 
-		std::vector<T>& operator[](const int index) {
-			return mat[index];
+			resizeNoInit(p.size[_X], p.size[_Y]);
+			if (mat) memcpy(mat, p.mat, sizeof(T) * numel());
+
+			return *this;
 		}
 
-		T& operator ()(int x, int y) {
-			return mat[x][y];
+		inline matrix<T>& operator =(matrix<T>&& p) noexcept {
+			if (this == &p) return *this;
+
+			release();
+			mat = p.mat;
+			size = p.size;
+			capacity = p.capacity;
+			p.mat = nullptr;
+			p.size = ivec2(0, 0);
+			p.capacity = 0;
+
+			return *this;
 		}
 
-		inline void operator =(matrix<T>& p) {
-			if (size != p.size)
-				return;
+		/**
+		* @brief evaluate an elementwise expression into this matrix in a single pass.
+		*        Operands may alias this matrix. Left unchanged if the operand sizes differ.
+		*/
+		template<typename E>
+		inline matrix<T>& operator =(const MatExpr<E>& e) {
+			const E& expr = e.self();
+			ivec2 exprSize = expr.getSize();
+			if (exprSize[_X] <= 0 || exprSize[_Y] <= 0) return *this;
+
+			resizeNoInit(exprSize[_X], exprSize[_Y]);
+
+			// signed 64-bit index : MSVC's OpenMP 2.0 does not take an unsigned one
+			const longlong n = (longlong)numel();
+			longlong i;
+#ifdef _OPENMP
+#pragma omp parallel for private(i)
+#endif
+			for (i = 0; i < n; i++)
+				mat[i] = expr.eval(i);
 
-			for (int x = 0; x < size[_X]; x++) {
-				for (int y = 0; y < size[_Y]; y++) {
-					mat[x][y] = p[x][y];
-				}
-			}
+			return *this;
 		}
 
-		inline void operator =(T* p) {
-			for (int x = 0; x < size[_X]; x++) {
-				for (int y = 0; y < size[_y]; y++) {
-					mat[x][y] = *p;
-					p++;
-				}
-			}
+		inline void operator =(const T* p) {
+			memcpy(mat, p, sizeof(T) * numel());
 		}
 
 		//matrix<T>& operator ()(T args...) {
@@ -350,58 +467,32 @@ namespace oph
 		//	return *this;
 		//}
 
-		matrix<T>& operator +(matrix<T>& p) {
-			return add(p);
-		}
 
-		matrix<T>& operator -(matrix<T>& p) {
-			return sub(p);
-		}
-
-		matrix<T>& operator *(matrix<T>& p) {
-			return mul(p);
-		}
-
-		matrix<T>& operator /(matrix<T>& p) {
-			return div(p);
-		}
-
-		matrix<T>& operator +(const T& p) {
-			for (int x = 0; x < size[_X]; x++) {
-				for (int y = 0; y < size[_Y]; y++) {
-					mat[x][y] += p;
-				}
-			}
-			return *this;
-		}
-
-		const matrix<T>& operator -(const T& p) {
-			for (int x = 0; x < size[_X]; x++) {
-				for (int y = 0; y < size[_Y]; y++) {
-					mat[x][y] -= p;
-				}
-			}
-			return *this;
-		}
-
-		const matrix<T>& operator *(const T& p) {
-			for (int x = 0; x < size[_X]; x++) {
-				for (int y = 0; y < size[_Y]; y++) {
-					mat[x][y] *= p;
-				}
-			}
-			return *this;
-		}
-
-		const matrix<T>& operator /(const T& p) {
-			for (int x = 0; x < size[_X]; x++) {
-				for (int y = 0; y < size[_Y]; y++) {
-					mat[x][y] /= p;
-				}
-			}
-			return *this;
+		template<typename E> matrix<T>& operator +=(const MatExpr<E>& e) { return *this = *this + e.self(); }
+		template<typename E> matrix<T>& operator -=(const MatExpr<E>& e) { return *this = *this - e.self(); }
+		template<typename E> matrix<T>& operator *=(const MatExpr<E>& e) { return *this = *this * e.self(); }
+		template<typename E> matrix<T>& operator /=(const MatExpr<E>& e) { return *this = *this / e.self(); }
+
+		matrix<T>& operator +=(const T& p) { return *this = *this + p; }
+		matrix<T>& operator -=(const T& p) { return *this = *this - p; }
+		matrix<T>& operator *=(const T& p) { return *this = *this * p; }
+		matrix<T>& operator /=(const T& p) { return *this = *this / p; }
+
+	private:
+		size_t capacity;
+
+		void allocate(size_t n) {
+			if (n == 0) return;
+#ifdef _WIN32
+			mat = (T*)_aligned_malloc(sizeof(T) * n, ALIGNMENT);
+#else
+			void* p = nullptr;
+			mat = posix_memalign(&p, ALIGNMENT, sizeof(T) * n) == 0 ? (T*)p : nullptr;
+#endif
+			capacity = mat ? n : 0;
 		}
 
+	public:
 		//print test
 		//void Print(const char* _context) {
 		//	for (int x = 0; x < size[_X]; x++) {
@@ -414,6 +505,27 @@ namespace oph
 		//}
 	};
 
+#define MAT_EXPR_OPERATOR(OP, OP_MAT, OP_SCALAR) \
+	template<typename L, typename R> \
+	inline MatBinary<L, R, OP_MAT> operator OP(const MatExpr<L>& l, const MatExpr<R>& r) { \
+		return MatBinary<L, R, OP_MAT>(l.self(), r.self()); \
+	} \
+	template<typename L> \
+	inline MatBinary<L, MatScalar<typename L::value_type>, OP_SCALAR> operator OP(const MatExpr<L>& l, const typename L::value_type& s) { \
+		return MatBinary<L, MatScalar<typename L::value_type>, OP_SCALAR>(l.self(), MatScalar<typename L::value_type>(s)); \
+	} \
+	template<typename R> \
+	inline MatBinary<MatScalar<typename R::value_type>, R, OP_SCALAR> operator OP(const typename R::value_type& s, const MatExpr<R>& r) { \
+		return MatBinary<MatScalar<typename R::value_type>, R, OP_SCALAR>(MatScalar<typename R::value_type>(s), r.self()); \
+	}
+
+	MAT_EXPR_OPERATOR(+, MatOpAdd, MatOpAdd)
+	MAT_EXPR_OPERATOR(-, MatOpSub, MatOpSub)
+	MAT_EXPR_OPERATOR(*, MatOpMul, MatOpMul)
+	MAT_EXPR_OPERATOR(/, MatOpDivSafe, MatOpDiv)
+
+#undef MAT_EXPR_OPERATOR
+
 	typedef oph::matrix<int> OphIntField;
 	typedef oph::matrix<uchar> OphByteField;
 	typedef oph::matrix<Real> OphRealField;
@@ -425,4 +537,4 @@ namespace oph
 	typedef OphComplexTField MatF;
 }
 
-#endif // !__mat_h
\ No newline at end of file
+#endif // !__mat_h
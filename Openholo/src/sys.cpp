@@ -1,6 +1,12 @@
 #include "sys.h"
 #include <stdarg.h>
 #include <stdio.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 static FILE *fp;
  
 void file_log(const char *fmt, ...)
@@ -95,4 +101,74 @@ int string_cmp(const WChar* str1, const WChar* str2)
 #else
 	return strcmp(str1, str2);
 #endif
-}
\ No newline at end of file
+}
+
+unsigned char* file_map_read(const char* fname, unsigned long long* size)
+{
+	*size = 0;
+#ifdef _WIN32
+	HANDLE hFile = CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE) return nullptr;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart == 0) {
+		CloseHandle(hFile);
+		return nullptr;
+	}
+
+	HANDLE hMap = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(hFile);
+	if (hMap == nullptr) return nullptr;
+
+	// the view keeps the mapping alive, so both handles can be closed here.
+	unsigned char* view = (unsigned char*)MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(hMap);
+	if (view == nullptr) return nullptr;
+
+	*size = (unsigned long long)fileSize.QuadPart;
+	return view;
+#else
+	int fd = open(fname, O_RDONLY);
+	if (fd == -1) return nullptr;
+
+	struct stat st;
+	if (fstat(fd, &st) == -1 || st.st_size == 0) {
+		close(fd);
+		return nullptr;
+	}
+
+	void* view = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (view == MAP_FAILED) return nullptr;
+
+	*size = (unsigned long long)st.st_size;
+	return (unsigned char*)view;
+#endif
+}
+
+void file_unmap(void* view, unsigned long long size)
+{
+	if (view == nullptr) return;
+#ifdef _WIN32
+	UnmapViewOfFile(view);
+#else
+	munmap(view, size);
+#endif
+}
+
+void file_map_prefetch(const void* addr, unsigned long long len)
+{
+	if (addr == nullptr || len == 0) return;
+#ifdef _WIN32
+#if _WIN32_WINNT >= 0x0602
+	WIN32_MEMORY_RANGE_ENTRY range;
+	range.VirtualAddress = (PVOID)addr;
+	range.NumberOfBytes = (SIZE_T)len;
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+#else
+	unsigned long long page = (unsigned long long)sysconf(_SC_PAGESIZE);
+	unsigned long long begin = (unsigned long long)addr & ~(page - 1);
+	madvise((void*)begin, (unsigned long long)addr + len - begin, MADV_WILLNEED);
+#endif
+}
@@ -89,6 +89,10 @@ WChar* string_cpy(WChar* dest, const WChar* src);
 WChar* string_cat(WChar* dest, const WChar* src);
 int    string_cmp(const WChar* str1, const WChar* str2);
 
+unsigned char* file_map_read(const char* fname, unsigned long long* size);
+void file_unmap(void* view, unsigned long long size);
+void file_map_prefetch(const void* addr, unsigned long long len);
+
 
 #endif
 
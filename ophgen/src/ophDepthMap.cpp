@@ -116,6 +116,11 @@ void ophDepthMap::setViewingWindow(bool is_ViewingWindow)
 */
 bool ophDepthMap::readConfig(const char * fname)
 {
+	if (loadCachedConfig(fname)) {
+		initialize();
+		return true;
+	}
+
 	if (!ophGen::readConfig(fname))
 		return false;
 
@@ -202,6 +207,7 @@ bool ophDepthMap::readConfig(const char * fname)
 	auto during = ((chrono::duration<Real>)(end - start)).count();
 	LOG("%lf (s)...done\n", during);
 
+	storeCachedConfig();
 	initialize();
 	return true;
 }
@@ -227,6 +233,7 @@ bool ophDepthMap::readImageDepth(const char* source_folder, const char* img_pref
 		LOG("Error: Source image does not exist: %s.\n", sdir.c_str());
 		return false;
 	}
+	_findclose(handle);
 
 	std::string imgfullname;
 	imgfullname = std::string(source_folder).append("\\").append(fd.name);
@@ -234,18 +241,18 @@ bool ophDepthMap::readImageDepth(const char* source_folder, const char* img_pref
 	int w, h, bytesperpixel;
 	bool ret = getImgSize(w, h, bytesperpixel, imgfullname.c_str());
 
-	oph::uchar* imgload = new uchar[w*h*bytesperpixel];
-	ret = loadAsImgUpSideDown(imgfullname.c_str(), imgload);
+	// the load buffers are kept across calls, they only grow
+	m_imgLoad.resize((size_t)w * h * bytesperpixel);
+	ret = loadAsImgUpSideDown(imgfullname.c_str(), m_imgLoad.data());
 	if (!ret) {
 		LOG("Failed::Image Load: %s\n", imgfullname.c_str());
 		return false;
 	}
 	LOG("Succeed::Image Load: %s\n", imgfullname.c_str());
 
-	oph::uchar* img = new uchar[w*h];
-	convertToFormatGray8(imgload, img, w, h, bytesperpixel);
-
-	delete[] imgload;
+	m_img.resize((size_t)w * h);
+	uchar* img = m_img.data();
+	convertToFormatGray8(m_imgLoad.data(), img, w, h, bytesperpixel);
 
 
 	//=================================================================================
@@ -256,14 +263,15 @@ bool ophDepthMap::readImageDepth(const char* source_folder, const char* img_pref
 		LOG("Error: Source depthmap does not exist: %s.\n", sddir);
 		return false;
 	}
+	_findclose(handle);
 
 	std::string dimgfullname = std::string(source_folder).append("\\").append(fd.name);
 
 	int dw, dh, dbytesperpixel;
 	ret = getImgSize(dw, dh, dbytesperpixel, dimgfullname.c_str());
 	
-	uchar* dimgload = new uchar[dw*dh*dbytesperpixel];
-	ret = loadAsImgUpSideDown(dimgfullname.c_str(), dimgload);
+	m_dimgLoad.resize((size_t)dw * dh * dbytesperpixel);
+	ret = loadAsImgUpSideDown(dimgfullname.c_str(), m_dimgLoad.data());
 	if (!ret) {
 		LOG("Failed::Depth Image Load: %s\n", dimgfullname.c_str());
 		return false;
@@ -274,18 +282,20 @@ bool ophDepthMap::readImageDepth(const char* source_folder, const char* img_pref
 	m_vecDepthImg[_X] = dw;
 	m_vecDepthImg[_Y] = dh;
 
-	uchar* dimg = new uchar[dw*dh];
-	convertToFormatGray8(dimgload, dimg, dw, dh, dbytesperpixel);
-
-	delete[] dimgload;
+	m_dimg.resize((size_t)dw * dh);
+	uchar* dimg = m_dimg.data();
+	convertToFormatGray8(m_dimgLoad.data(), dimg, dw, dh, dbytesperpixel);
 
 	//resize image
 	int pnX = context_.pixel_number[_X];
 	int pnY = context_.pixel_number[_Y];
 
-	if (rgb_img) delete[] rgb_img;
-
-	rgb_img = new uchar[pnX*pnY];
+	// the input buffers are kept while the resolution does not change
+	bool bRealloc = !rgb_img || !depth_img || m_vecRGBImg[_X] != pnX || m_vecRGBImg[_Y] != pnY;
+	if (bRealloc) {
+		if (rgb_img) delete[] rgb_img;
+		rgb_img = new uchar[pnX*pnY];
+	}
 	memset(rgb_img, 0, sizeof(char)*pnX*pnY);
 
 	if (w != pnX || h != pnY)
@@ -298,9 +308,10 @@ bool ophDepthMap::readImageDepth(const char* source_folder, const char* img_pref
 	m_vecRGBImg[_Y] = pnY;
 
 	//ret = creatBitmapFile(newimg, pnX, pnY, 8, "stest");
-	if (depth_img) delete[] depth_img;
-
-	depth_img = new uchar[pnX*pnY];
+	if (bRealloc) {
+		if (depth_img) delete[] depth_img;
+		depth_img = new uchar[pnX*pnY];
+	}
 	memset(depth_img, 0, sizeof(char)*pnX*pnY);
 
 	if (dw != pnX || dh != pnY)
@@ -311,9 +322,6 @@ bool ophDepthMap::readImageDepth(const char* source_folder, const char* img_pref
 	m_vecDepthImg[_X] = pnX;
 	m_vecDepthImg[_Y] = pnY;
 
-	delete[] img;
-	delete[] dimg;
-
 	return true;
 }
 
@@ -377,7 +385,8 @@ void ophDepthMap::encoding(unsigned int ENCODE_FLAG, unsigned int SSB_PASSBAND)
 	const uint pnX = context_.pixel_number[_X];
 	const uint pnY = context_.pixel_number[_Y];
 	const uint nChannel = context_.waveNum;
-	Complex<Real>* dst = new Complex<Real>[pnX * pnY];
+	m_field.resize((size_t)pnX * pnY);
+	Complex<Real>* dst = m_field.data();
 
 	for (uint ch = 0; ch < nChannel; ch++) {
 		fft2(context_.pixel_number, complex_H[ch], OPH_BACKWARD);
@@ -404,7 +413,6 @@ void ophDepthMap::encoding(unsigned int ENCODE_FLAG, unsigned int SSB_PASSBAND)
 		}
 		else ophGen::encoding(ENCODE_FLAG, SSB_PASSBAND, dst);
 	}
-	delete[] dst;
 	auto end = CUR_TIME;
 	LOG("Elapsed Time: %lf(s)\n", ELAPSED_TIME(begin, end));
 }
@@ -631,6 +639,10 @@ void ophDepthMap::calcHoloCPU()
 
 	int sum = 0;
 
+	// one layer buffer for all depths and channels, kept across calls
+	m_field.resize(pnXY);
+	Complex<Real> *input = m_field.data();
+
 	for (int ch = 0; ch < nChannel; ch++) {
 		Real lambda = context_.wave_length[ch];
 		Real k = context_.k = (2 * M_PI / lambda);
@@ -639,7 +651,6 @@ void ophDepthMap::calcHoloCPU()
 
 			Real temp_depth = (is_ViewingWindow) ? dlevel_transform[dtr - 1] : dlevel[dtr - 1];
 
-			Complex<Real> *input = new Complex<Real>[pnXY];
 			memset(input, 0.0, sizeof(Complex<Real>) * pnXY);
 
 			Real locsum = 0.0;
@@ -668,7 +679,6 @@ void ophDepthMap::calcHoloCPU()
 			else {
 				//LOG("Depth: %d of %d : Nothing here\n", dtr, dm_config_.num_of_depth);
 			}
-			delete[] input;
 			m_nProgress = (int)((Real)(ch * depth_sz + p) * 100 / (depth_sz * nChannel));
 
 		}
@@ -206,6 +206,18 @@ protected:
 
 	void ophFree(void);
 
+	virtual void serializeConfig(OphConfigArchive& ar)
+	{
+		ar & dm_config_.FLAG_CHANGE_DEPTH_QUANTIZATION & dm_config_.DEFAULT_DEPTH_QUANTIZATION & dm_config_.NUMBER_OF_DEPTH_QUANTIZATION;
+		ar & dm_config_.num_of_depth & dm_config_.render_depth & dm_config_.RANDOM_PHASE;
+		ar & dm_config_.fieldLength & dm_config_.near_depthmap & dm_config_.far_depthmap;
+	}
+	virtual bool loadBatchInput(const OphBatchJob& job)
+	{
+		return job.inputs.size() >= 3 && readImageDepth(job.inputs[0].c_str(), job.inputs[1].c_str(), job.inputs[2].c_str());
+	}
+	virtual void generateBatchItem(void) { generateHologram(); }
+
 private:
 	bool					is_CPU;								///< if true, it is implemented on the CPU, otherwise on the GPU.
 	bool					is_ViewingWindow;
@@ -214,6 +226,9 @@ private:
 	unsigned char*			rgb_img;
 	ivec2					m_vecRGBImg;
 	ivec2					m_vecDepthImg;
+	vector<uchar>			m_imgLoad, m_dimgLoad;				///< readImageDepth() scratch - loaded image and depth map, kept across calls.
+	vector<uchar>			m_img, m_dimg;						///< readImageDepth() scratch - gray image and depth map before resizing.
+	vector<Complex<Real>>	m_field;							///< CPU variable - one depth layer(calcHoloCPU) or fringe(encoding), kept across calls.
 	unsigned char*			img_src_gpu;						///< GPU variable - image source data, values are from 0 to 255.
 	unsigned char*			dimg_src_gpu;						///< GPU variable - depth map data, values are from 0 to 255.
 	Real*					depth_index_gpu;					///< GPU variable - quantized depth map data.
@@ -52,6 +52,8 @@
 #include <omp.h>
 #include "tinyxml2.h"
 #include "PLYparser.h"
+#include <typeinfo>
+#include <mutex>
 //#include "OpenCL.h"
 //#include "CUDA.h"
 
@@ -114,9 +116,11 @@ ophGen::ophGen(void)
 	, m_lpEncoded(nullptr)
 	, m_lpNormalized(nullptr)
 	, m_nOldChannel(0)
+	, m_nOldPixel(0)
 	, m_elapsedTime(0.0)
 	, m_dFieldLength(0.0)
 	, m_nStream(1)
+	, m_nConfigHash(0)
 {
 	//OpenCL::getInstance();
 	//CUDA::getInstance();
@@ -137,6 +141,19 @@ void ophGen::initialize(void)
 	const uint pnXY = pnX * pnY;
 	const int nChannel = context_.waveNum;
 
+	// Same sized buffers are kept, and only cleared
+	if (complex_H != nullptr && m_lpEncoded != nullptr && m_lpNormalized != nullptr &&
+		nChannel == m_nOldChannel && pnXY == m_nOldPixel) {
+		for (uint i = 0; i < nChannel; i++) {
+			memset(complex_H[i], 0, sizeof(Complex<Real>) * pnXY);
+			memset(m_lpEncoded[i], 0, sizeof(Real) * pnXY);
+			memset(m_lpNormalized[i], 0, sizeof(uchar) * pnXY);
+		}
+		m_vecEncodeSize[_X] = pnX;
+		m_vecEncodeSize[_Y] = pnY;
+		return;
+	}
+
 	// Memory Location for Result Image
 	if (complex_H != nullptr) {
 		for (uint i = 0; i < m_nOldChannel; i++) {
@@ -188,6 +205,7 @@ void ophGen::initialize(void)
 	}
 
 	m_nOldChannel = nChannel;
+	m_nOldPixel = pnXY;
 	m_vecEncodeSize[_X] = pnX;
 	m_vecEncodeSize[_Y] = pnY;
 }
@@ -297,6 +315,133 @@ bool ophGen::readConfig(const char* fname)
 	return true;
 }
 
+int ophGen::generateBatch(std::vector<OphBatchJob>& jobs, unsigned int ENCODE_FLAG)
+{
+	LOG("[%s] %d jobs\n", __FUNCTION__, (int)jobs.size());
+	auto begin = CUR_TIME;
+	const uint nChannel = context_.waveNum;
+	const uint8_t bitsperpixel = (uint8_t)((nChannel == 3 && context_.bMergeImg) ? 24 : 8);
+	int nSucceed = 0;
+
+	for (size_t i = 0; i < jobs.size(); i++) {
+		OphBatchJob& job = jobs[i];
+		job.bSucceed = false;
+		job.loadTime = job.generateTime = job.saveTime = 0;
+
+		auto t0 = CUR_TIME;
+		if (!loadBatchInput(job)) {
+			LOG("<FAILED> batch job %d : failed to load the input.\n", (int)i);
+			continue;
+		}
+		auto t1 = CUR_TIME;
+		generateBatchItem();
+		encoding(ENCODE_FLAG);
+		normalize();
+		auto t2 = CUR_TIME;
+		job.bSucceed = job.output.empty() ? true : save(job.output.c_str(), bitsperpixel);
+		auto t3 = CUR_TIME;
+
+		job.loadTime = ((std::chrono::duration<Real>)(t1 - t0)).count();
+		job.generateTime = ((std::chrono::duration<Real>)(t2 - t1)).count();
+		job.saveTime = ((std::chrono::duration<Real>)(t3 - t2)).count();
+		if (job.bSucceed) nSucceed++;
+
+		LOG("batch job %d : load %lf, generate %lf, save %lf (s)\n", (int)i, job.loadTime, job.generateTime, job.saveTime);
+	}
+	if (isAsyncSave() && !flushSave())
+		LOG("<FAILED> batch : failed to save some holograms.\n");
+
+	auto end = CUR_TIME;
+	LOG("%s : %d/%d jobs, %lf(s)\n", __FUNCTION__, nSucceed, (int)jobs.size(), ((std::chrono::duration<Real>)(end - begin)).count());
+	return nSucceed;
+}
+
+/* compiled config cache : archive per (file hash, generator type) */
+static std::map<ulonglong, std::vector<uchar>> g_configCache;
+static std::mutex g_configLock;
+
+static ulonglong configHash(const uchar* data, const ulonglong size, ulonglong hash = 14695981039346656037ULL)
+{
+	for (ulonglong i = 0; i < size; i++) {
+		hash ^= data[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+void ophGen::clearConfigCache(void)
+{
+	std::lock_guard<std::mutex> lk(g_configLock);
+	g_configCache.clear();
+}
+
+ulonglong ophGen::getConfigKey(void)
+{
+	const char* type = typeid(*this).name();
+	return configHash((const uchar*)type, strlen(type), m_nConfigHash);
+}
+
+void ophGen::serializeContext(OphConfigArchive& ar)
+{
+	uint nWave = context_.waveNum;
+	ar & nWave;
+	if (ar.bLoad && (nWave != context_.waveNum || !context_.wave_length)) {
+		// the wavelength array is kept while the number of wavelengths does not change
+		if (context_.wave_length) delete[] context_.wave_length;
+		context_.wave_length = new Real[nWave];
+	}
+	context_.waveNum = nWave;
+	for (uint i = 0; i < nWave; i++)
+		ar & context_.wave_length[i];
+
+	ar & context_.pixel_number & context_.pixel_pitch & context_.shift;
+	ar & context_.bRotation & context_.bMergeImg & context_.bUseDP;
+	ar & m_dFieldLength & m_nStream;
+}
+
+bool ophGen::loadCachedConfig(const char* fname)
+{
+	ulonglong size = 0;
+	uchar* data = file_map_read(fname, &size);
+	if (!data) return false;
+	m_nConfigHash = configHash(data, size);
+	file_unmap(data, size);
+
+	OphConfigArchive ar(true);
+	{
+		std::lock_guard<std::mutex> lk(g_configLock);
+		auto it = g_configCache.find(getConfigKey());
+		if (it == g_configCache.end()) return false;
+		ar.data = it->second;
+	}
+	LOG("[%s] %s (compiled config)\n", __FUNCTION__, fname);
+
+	serializeContext(ar);
+	serializeConfig(ar);
+
+	context_.ss[_X] = context_.pixel_number[_X] * context_.pixel_pitch[_X];
+	context_.ss[_Y] = context_.pixel_number[_Y] * context_.pixel_pitch[_Y];
+
+	Openholo::setPixelNumberOHC(context_.pixel_number);
+	Openholo::setPixelPitchOHC(context_.pixel_pitch);
+
+	OHC_encoder->clearWavelength();
+	for (uint i = 0; i < context_.waveNum; i++)
+		Openholo::setWavelengthOHC(context_.wave_length[i], LenUnit::m);
+
+	return true;
+}
+
+void ophGen::storeCachedConfig(void)
+{
+	OphConfigArchive ar;
+	serializeContext(ar);
+	serializeConfig(ar);
+
+	std::lock_guard<std::mutex> lk(g_configLock);
+	g_configCache[getConfigKey()].swap(ar.data);
+}
+
 void ophGen::RS_Propagation(uchar *src, Complex<Real> *dst, Real lambda, Real distance)
 {
 	OphConfig *pConfig = &context_;
@@ -909,7 +1054,6 @@ bool ophGen::save(const char * fname, uint8_t bitsperpixel, uchar* src, uint px,
 	if (fname == nullptr) return false;
 
 	uchar* source = src;
-	bool bAlloc = false;
 	const uint nChannel = context_.waveNum;
 
 	ivec2 p(px, py);
@@ -944,31 +1088,35 @@ bool ophGen::save(const char * fname, uint8_t bitsperpixel, uchar* src, uint px,
 	if (src == nullptr) {
 		if (nChannel == 1) {
 			source = m_lpNormalized[0];
-			saveAsImg(path, bitsperpixel, source, p[_X], p[_Y]);
+			saveAsImgAsync(path, bitsperpixel, source, p[_X], p[_Y]);
 		}
 		else if (nChannel == 3) {
 			if (context_.bMergeImg) {
-				uint nSize = (((p[_X] * bitsperpixel / 8) + 3) & ~3) * p[_Y];
-				source = new uchar[nSize];
-				bAlloc = true;
-				for (int i = 0; i < nChannel; i++) {
-					mergeColor(i, p[_X], p[_Y], m_lpNormalized[i], source);
+				if (isAsyncSave()) {
+					// merge straight into an output buffer of the I/O thread, with the rows saveAsImgPlanes writes
+					uint nSize = (((p[_X] * bitsperpixel / 8) + 3) & ~3) * p[_Y];
+					int slot;
+					source = acquireSaveBuffer(nSize, slot);
+					interleavePlanes(bitsperpixel, m_lpNormalized, p[_X], p[_Y], source);
+					submitSaveImg(slot, path, bitsperpixel, p[_X], p[_Y]);
+				}
+				else {
+					// channels are interleaved row by row while writing
+					saveAsImgPlanes(path, bitsperpixel, m_lpNormalized, p[_X], p[_Y]);
 				}
-				saveAsImg(path, bitsperpixel, source, p[_X], p[_Y]);
-				if (bAlloc) delete[] source;
 			}
 			else {
 				for (int i = 0; i < nChannel; i++) {
 					sprintf_s(path, "%s%s%s_%d%s", drive, dir, file, i, ext);
 					source = m_lpNormalized[i];
-					saveAsImg(path, bitsperpixel / nChannel, source, p[_X], p[_Y]);
+					saveAsImgAsync(path, bitsperpixel / nChannel, source, p[_X], p[_Y]);
 				}
 			}
 		}
 		else return false;
 	}
 	else
-		saveAsImg(path, bitsperpixel, source, p[_X], p[_Y]);
+		saveAsImgAsync(path, bitsperpixel, source, p[_X], p[_Y]);
 
 	return true;
 }
@@ -60,6 +60,61 @@ struct OphDepthMapConfig;
 struct OphMeshData;
 struct OphWRPConfig;
 
+/**
+* @struct OphConfigArchive
+* @brief Compiled config : the values parsed from a config(*.xml) file in a fixed binary layout.
+* @details The same serializeConfig() writes the archive after parsing and reads it back from the cache.
+*			The cache is in-process only : archives are never written to disk, so every new process parses each config once.
+*/
+struct GEN_DLL OphConfigArchive {
+	std::vector<uchar> data;
+	size_t pos;
+	bool bLoad;
+
+	explicit OphConfigArchive(bool load = false) : pos(0), bLoad(load) {}
+
+	template<typename T>
+	OphConfigArchive& operator&(T& v) {
+		if (bLoad) {
+			if (pos + sizeof(T) <= data.size()) memcpy(&v, &data[pos], sizeof(T));
+			pos += sizeof(T);
+		}
+		else {
+			const uchar* p = (const uchar*)&v;
+			data.insert(data.end(), p, p + sizeof(T));
+		}
+		return *this;
+	}
+
+	template<typename T>
+	OphConfigArchive& operator&(std::vector<T>& v) {
+		ulonglong n = v.size();
+		*this & n;
+		if (bLoad) v.resize(n);
+		for (ulonglong i = 0; i < n; i++) *this & v[i];
+		return *this;
+	}
+};
+
+/**
+* @struct OphBatchJob
+* @brief One hologram of ophGen::generateBatch.
+*/
+struct GEN_DLL OphBatchJob {
+	/// Input files : point cloud(*.ply) / mesh file, extension / RGB-D source folder, image prefix, depth image prefix
+	std::vector<std::string> inputs;
+	/// Hologram image file, empty to keep the result in the buffers only
+	std::string output;
+	/// Result of the job
+	bool bSucceed;
+	/// Elapsed time(sec) of loading, generation with encoding, and saving
+	Real loadTime;
+	Real generateTime;
+	Real saveTime;
+
+	OphBatchJob() : bSucceed(false), loadTime(0), generateTime(0), saveTime(0) {}
+};
+
 /**
 * @ingroup gen
 * @brief
@@ -133,6 +188,27 @@ public:
 	*/
 	bool readConfig(const char* fname);
 
+	/**
+	* @brief Generate the holograms of many inputs back-to-back with the config read last.
+	* @details The buffers of initialize() and the caches of the generator are reused by every job.
+	*			Each job is loaded with loadBatchInput(), generated with generateBatchItem(), encoded, normalized and saved to its output.
+	* @param[in,out] jobs Inputs and outputs. The result and the elapsed times of each job are set.
+	* @param[in] ENCODE_FLAG encoding method
+	* @return Type: <B>int</B>\n
+	*				The number of succeeded jobs.
+	*/
+	int generateBatch(std::vector<OphBatchJob>& jobs, unsigned int ENCODE_FLAG = ENCODE_PHASE);
+
+	/**
+	* @brief Hash(64-bit FNV-1a) of the config file read last, stable across runs.
+	*/
+	ulonglong getConfigHash(void) { return m_nConfigHash; }
+
+	/**
+	* @brief Release every compiled config of the process.
+	*/
+	static void clearConfigCache(void);
+
 	/**
 	* @brief Angular spectrum propagation method.
 	* @param[in] ch index of channel.
@@ -258,10 +334,43 @@ protected:
 private:
 	/// previous number of channel.
 	int						m_nOldChannel;
+	/// previous number of pixel.
+	ulonglong				m_nOldPixel;
 
 protected:
 	Real					m_dFieldLength;
 	int						m_nStream;
+	/// hash of the config file read last.
+	ulonglong				m_nConfigHash;
+
+	/**
+	* @brief Restore the config of fname from the compiled config cache.
+	* @param[in] fname config file name
+	* @return Type: <B>bool</B>\n
+	*				If fname was compiled before, OphConfig and serializeConfig() are restored without parsing it and the return value is <B>true</B>.\n
+	*				Otherwise the return value is <B>false</B>, and the caller parses fname and calls storeCachedConfig().
+	*/
+	bool loadCachedConfig(const char* fname);
+	/**
+	* @brief Compile the config just parsed into the cache, keyed by the hash of the file and the generator type.
+	*/
+	void storeCachedConfig(void);
+	/**
+	* @brief Module config values of the compiled config. Overridden by generators that parse their own config values.
+	*/
+	virtual void serializeConfig(OphConfigArchive& ar) {}
+	/**
+	* @brief Load the input of a batch job into the generator. Overridden by generators supporting generateBatch().
+	*/
+	virtual bool loadBatchInput(const OphBatchJob& job) { return false; }
+	/**
+	* @brief Generate the complex field of the loaded batch input.
+	*/
+	virtual void generateBatchItem(void) {}
+
+private:
+	void serializeContext(OphConfigArchive& ar);
+	ulonglong getConfigKey(void);
 
 public:
 	void transVW(int nSize, Real *dst, Real *src);
@@ -377,6 +377,11 @@ void ophIFTA::encoding(unsigned int ENCODE_FLAG, unsigned int SSB_PASSBAND)
 
 bool ophIFTA::readConfig(const char* fname)
 {
+	if (loadCachedConfig(fname)) {
+		initialize();
+		return true;
+	}
+
 	if (!ophGen::readConfig(fname))
 		return false;
 
@@ -412,6 +417,7 @@ bool ophIFTA::readConfig(const char* fname)
 	if (!next || XML_SUCCESS != next->QueryIntText(&m_config.num_of_iteration))
 		m_config.num_of_iteration = 1;
 
+	storeCachedConfig();
 	initialize();
 	return true;
 }
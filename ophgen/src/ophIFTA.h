@@ -36,5 +36,8 @@ private:
 	int bytesperpixel;
 
 	OphIFTAConfig m_config;
+
+protected:
+	virtual void serializeConfig(OphConfigArchive& ar) { ar & m_config; }
 };
 
@@ -50,15 +50,34 @@
 
 #define for_i(itr, oper) for(int i=0; i<itr; i++){ oper }
 
+/**
+* @brief Header of the pre-packed light field container written by ophLF::saveLFPack
+*/
+struct LFPackHeader
+{
+	char		signature[4];	// "OLFP"
+	uint32_t	version;
+	int32_t		numX, numY;		// number of element images
+	int32_t		resolX, resolY;	// resolution of element images
+	uint64_t	dataOffset;		// offset of the pixel-major data [pixelIdx][imageIdx]
+};
+
 ophLF::ophLF(void)
 	: num_image(ivec2(0, 0))
 	, resolution_image(ivec2(0, 0))
 	, distanceRS2Holo(0.0)
 	, is_CPU(true)
 	, is_ViewingWindow(false)
+	, is_PixelMajor(false)
+	, is_Streaming(false)
 	, LF(nullptr)
+	, pixelLF(nullptr)
+	, mappedLF(nullptr)
+	, mappedSize(0)
+	, rowPlan(nullptr)
 	, RSplane_complex_field(nullptr)
 	, bSinglePrecision(false)
+	, nImages(0)
 {
 	LOG("*** LIGHT FIELD : BUILD DATE: %s %s ***\n\n", __DATE__, __TIME__);
 }
@@ -73,8 +92,23 @@ void ophLF::setViewingWindow(bool is_ViewingWindow)
 	this->is_ViewingWindow = is_ViewingWindow;
 }
 
+void ophLF::setPixelMajor(bool is_PixelMajor)
+{
+	this->is_PixelMajor = is_PixelMajor;
+}
+
+void ophLF::setStreaming(bool is_Streaming)
+{
+	this->is_Streaming = is_Streaming;
+}
+
 bool ophLF::readConfig(const char* fname) 
 {
+	if (loadCachedConfig(fname)) {
+		initialize();
+		return true;
+	}
+
 	if (!ophGen::readConfig(fname))
 		return false;
 
@@ -126,6 +160,7 @@ bool ophLF::readConfig(const char* fname)
 	auto during = ((chrono::duration<Real>)(end - start)).count();
 	LOG("%lf (s)..done\n", during);
 
+	storeCachedConfig();
 	initialize();
 	return true;
 }
@@ -143,36 +178,19 @@ int ophLF::loadLF(const char* directory, const char* exten)
 	intptr_t ff = _findfirst(sdir.c_str(), &data);
 	if (ff != -1)
 	{
-		int num = 0;
-		uchar* rgbOut;
-		ivec2 sizeOut;
-		int bytesperpixel;
-
-		while (1)
-		{
-			string imgfullname = std::string(LF_directory).append("\\").append(data.name);
-
-			getImgSize(sizeOut[_X], sizeOut[_Y], bytesperpixel, imgfullname.c_str());
-
-			rgbOut = loadAsImg(imgfullname.c_str());
-
-			if (rgbOut == 0) {
-				cout << "LF load was failed." << endl;
-				return -1;
-			}
-
-			convertToFormatGray8(rgbOut, *(LF + num), sizeOut[_X], sizeOut[_Y], bytesperpixel);
-			delete[] rgbOut; // solved memory leak.
-			num++;
+		vector<string> files;
+		do {
+			files.push_back(std::string(LF_directory).append("\\").append(data.name));
+		} while (_findnext(ff, &data) != -1);
+		_findclose(ff);
 
-			int out = _findnext(ff, &data);
-			if (out == -1)
-				break;
+		if (!loadLFImages(files)) {
+			cout << "LF load was failed." << endl;
+			return -1;
 		}
-		_findclose(ff);
 		cout << "LF load was successed." << endl;
 
-		if (num_image[_X] * num_image[_Y] != num) {
+		if (num_image[_X] * num_image[_Y] != (int)files.size()) {
 			cout << "num_image is not matched." << endl;
 		}
 		return 1;
@@ -194,36 +212,20 @@ int ophLF::loadLF()
 	intptr_t ff = _findfirst(sdir.c_str(), &data);
 	if (ff != -1)
 	{
-		int num = 0;
-		uchar* rgbOut;
-		ivec2 sizeOut;
-		int bytesperpixel;
-
-		while (1)
-		{
-			string imgfullname = std::string(LF_directory).append("/").append(data.name);
-
-			getImgSize(sizeOut[_X], sizeOut[_Y], bytesperpixel, imgfullname.c_str());
-			rgbOut = loadAsImg(imgfullname.c_str());
-
-			if (rgbOut == 0) {
-				cout << "LF load was failed." << endl;
-				cin.get();
-				return -1;
-			}
-
-			convertToFormatGray8(rgbOut, *(LF + num), sizeOut[_X], sizeOut[_Y], bytesperpixel);
-
-			num++;
+		vector<string> files;
+		do {
+			files.push_back(std::string(LF_directory).append("/").append(data.name));
+		} while (_findnext(ff, &data) != -1);
+		_findclose(ff);
 
-			int out = _findnext(ff, &data);
-			if (out == -1)
-				break;
+		if (!loadLFImages(files)) {
+			cout << "LF load was failed." << endl;
+			cin.get();
+			return -1;
 		}
-		_findclose(ff);
 		cout << "LF load was successed." << endl;
 
-		if (num_image[_X] * num_image[_Y] != num) {
+		if (num_image[_X] * num_image[_Y] != (int)files.size()) {
 			cout << "num_image is not matched." << endl;
 			cin.get();
 		}
@@ -237,6 +239,164 @@ int ophLF::loadLF()
 	}
 }
 
+bool ophLF::loadLFImages(const vector<string>& files)
+{
+	auto begin = CUR_TIME;
+
+	const int nX = num_image[_X];
+	const int nY = num_image[_Y];
+	const int nFiles = ((int)files.size() < nImages) ? (int)files.size() : nImages;
+
+	// images left to decode per view row; a finished row is transformed right away.
+	vector<int> remain(nY, nX);
+	if (is_Streaming)
+		prepareRSPlane();
+
+	bool bOK = true;
+	int num_threads = 1;
+	int i;
+#ifdef _OPENMP
+#pragma omp parallel
+	{
+#pragma omp master
+		num_threads = omp_get_num_threads();
+#pragma omp for private(i) schedule(dynamic) reduction(&&:bOK)
+#endif
+		for (i = 0; i < nFiles; i++) {
+			int w = 0, h = 0, bytesperpixel = 0;
+			getImgSize(w, h, bytesperpixel, files[i].c_str());
+
+			uchar* rgbOut = loadAsImg(files[i].c_str());
+			if (rgbOut == nullptr) {
+				bOK = false;
+				continue;
+			}
+
+			storeLF(i, rgbOut, w, h, bytesperpixel);
+			delete[] rgbOut;
+
+			if (is_Streaming) {
+				int left;
+#ifdef _OPENMP
+#pragma omp critical(LFRowCount)
+#endif
+				left = --remain[i / nX];
+
+				if (left == 0)
+					transformLFRow(i / nX);
+			}
+		}
+#ifdef _OPENMP
+	}
+#endif
+
+	auto end = CUR_TIME;
+	LOG("\n%s (%d threads) : %lf(s)\n\n", __FUNCTION__, num_threads, ((std::chrono::duration<Real>)(end - begin)).count());
+	return bOK;
+}
+
+bool ophLF::saveLFPack(const char* fname)
+{
+	if (!LF && !pixelLF) return false;
+
+	const int nXY = num_image[_X] * num_image[_Y];
+	const int rXY = resolution_image[_X] * resolution_image[_Y];
+
+	LFPackHeader header;
+	memcpy(header.signature, "OLFP", 4);
+	header.version = 1;
+	header.numX = num_image[_X];
+	header.numY = num_image[_Y];
+	header.resolX = resolution_image[_X];
+	header.resolY = resolution_image[_Y];
+	header.dataOffset = sizeof(LFPackHeader);
+
+	FILE* fp;
+	fopen_s(&fp, fname, "wb");
+	if (fp == nullptr) return false;
+
+	bool bOK = fwrite(&header, sizeof(LFPackHeader), 1, fp) == 1;
+	if (is_PixelMajor) {
+		bOK &= fwrite(pixelLF, 1, (size_t)nXY * rXY, fp) == (size_t)nXY * rXY;
+	}
+	else {
+		// the pack is always pixel-major, transpose one image row at a time.
+		const int rX = resolution_image[_X];
+		uchar* line = new uchar[(size_t)nXY * rX];
+		for (int y = 0; y < resolution_image[_Y] && bOK; y++) {
+			for (int img = 0; img < nXY; img++) {
+				const uchar* src = LF[img] + rX * y;
+				for (int x = 0; x < rX; x++)
+					line[(size_t)x * nXY + img] = src[x];
+			}
+			bOK &= fwrite(line, 1, (size_t)nXY * rX, fp) == (size_t)nXY * rX;
+		}
+		delete[] line;
+	}
+	fclose(fp);
+
+	return bOK;
+}
+
+int ophLF::loadLFPack(const char* fname)
+{
+	releaseLF();
+
+	uint64_t size = 0;
+	uchar* view = mapFile(fname, size);
+	if (view == nullptr) {
+		cout << "LF load was failed." << endl;
+		return -1;
+	}
+
+	LFPackHeader header;
+	if (size < sizeof(LFPackHeader)) {
+		unmapFile(view, size);
+		cout << "LF load was failed." << endl;
+		return -1;
+	}
+	memcpy(&header, view, sizeof(LFPackHeader));
+
+	const uint64_t nXY = (uint64_t)header.numX * header.numY;
+	const uint64_t rXY = (uint64_t)header.resolX * header.resolY;
+	if (memcmp(header.signature, "OLFP", 4) || header.version != 1 ||
+		header.dataOffset + nXY * rXY > size) {
+		unmapFile(view, size);
+		cout << "LF load was failed." << endl;
+		return -1;
+	}
+
+	if (num_image[_X] != header.numX || num_image[_Y] != header.numY ||
+		resolution_image[_X] != header.resolX || resolution_image[_Y] != header.resolY) {
+		cout << "num_image is not matched." << endl;
+	}
+	num_image = ivec2(header.numX, header.numY);
+	resolution_image = ivec2(header.resolX, header.resolY);
+
+	if (is_PixelMajor) {
+		// read straight from the mapped view, pages are loaded on first touch.
+		mappedLF = view;
+		mappedSize = size;
+		pixelLF = view + header.dataOffset;
+		nImages = (int)nXY;
+	}
+	else {
+		initializeLF();
+		const uchar* src = view + header.dataOffset;
+		int img;
+#ifdef _OPENMP
+#pragma omp parallel for private(img)
+#endif
+		for (img = 0; img < nImages; img++) {
+			for (uint64_t i = 0; i < rXY; i++)
+				LF[img][i] = src[i * nXY + img];
+		}
+		unmapFile(view, size);
+	}
+	cout << "LF load was successed." << endl;
+	return 1;
+}
+
 void ophLF::generateHologram() 
 {
 	resetBuffer();
@@ -280,7 +440,7 @@ void ophLF::generateHologram()
 //}
 
 
-void ophLF::initializeLF()
+void ophLF::releaseLF()
 {
 	if (LF) {
 		for (int i = 0; i < nImages; i++) {
@@ -292,84 +452,247 @@ void ophLF::initializeLF()
 		delete[] LF;
 		LF = nullptr;
 	}
-
-	LF = new uchar*[num_image[_X] * num_image[_Y]];
-	for (int i = 0; i < num_image[_X] * num_image[_Y]; i++) {
-		LF[i] = new uchar[resolution_image[_X] * resolution_image[_Y]];
-		memset(LF[i], 0, resolution_image[_X] * resolution_image[_Y]);
+	if (mappedLF) {
+		unmapFile(mappedLF, mappedSize);
+		mappedLF = nullptr;
+		mappedSize = 0;
+		pixelLF = nullptr;
+	}
+	if (pixelLF) {
+		delete[] pixelLF;
+		pixelLF = nullptr;
 	}
+	rowReady.clear();
+}
+
+void ophLF::initializeLF()
+{
+	releaseLF();
+
 	nImages = num_image[_X] * num_image[_Y];
+	const int nPixels = resolution_image[_X] * resolution_image[_Y];
+
+	if (is_PixelMajor) {
+		pixelLF = new uchar[(size_t)nImages * nPixels];
+		memset(pixelLF, 0, (size_t)nImages * nPixels);
+	}
+	else {
+		LF = new uchar*[nImages];
+		for (int i = 0; i < nImages; i++) {
+			LF[i] = new uchar[nPixels];
+			memset(LF[i], 0, nPixels);
+		}
+	}
 	cout << "The Number of the Images : " << num_image[_X] * num_image[_Y] << endl;
 }
 
-
-void ophLF::convertLF2ComplexField()
+void ophLF::storeLF(int idx, uchar* rgb, int w, int h, int bytesperpixel)
 {
-	auto begin = CUR_TIME;
+	if (idx >= nImages) return;
+
+	if (!is_PixelMajor) {
+		convertToFormatGray8(rgb, LF[idx], w, h, bytesperpixel);
+		return;
+	}
 
-	const uint nX = num_image[_X];
-	const uint nY = num_image[_Y];
-	const uint nXY = nX * nY;
-	const uint rX = resolution_image[_X];
-	const uint rY = resolution_image[_Y];
-	const uint rXY = rX * rY;
+	// transpose the element image into the pixel-major buffer while loading,
+	// so the angular samples of each pixel end up adjacent.
+	const int rXY = resolution_image[_X] * resolution_image[_Y];
+	const int nPixels = (w * h < rXY) ? w * h : rXY;
+	uchar* gray = new uchar[w * h];
+	convertToFormatGray8(rgb, gray, w, h, bytesperpixel);
+
+	uchar* dst = pixelLF + idx;
+	for (int i = 0; i < nPixels; i++)
+		dst[(size_t)i * nImages] = gray[i];
+
+	delete[] gray;
+}
+
+
+void ophLF::prepareRSPlane()
+{
+	const int nX = num_image[_X];
+	const int nY = num_image[_Y];
+	const int nXY = nX * nY;
+	const int rX = resolution_image[_X];
+	const int rY = resolution_image[_Y];
+	const int rXY = rX * rY;
+	const int hnX = nX / 2;
+	const int hnY = nY / 2;
 
 	if (RSplane_complex_field) {
 		delete[] RSplane_complex_field;
 		RSplane_complex_field = nullptr;
 	}
-	RSplane_complex_field = new Complex<Real>[nXY * rXY];
-	memset(RSplane_complex_field, 0.0, sizeof(Complex<Real>) * nXY * rXY);
+	RSplane_complex_field = new Complex<Real>[(size_t)nXY * rXY];
+
+	// fftshift(fft2(fftshift(LF))) : index tables replace both shift passes.
+	shiftIn[_X].resize(nX);
+	shiftIn[_Y].resize(nY);
+	shiftOut[_X].resize(nX);
+	shiftOut[_Y].resize(nY);
+	for (int i = 0; i < nX; i++) {
+		shiftIn[_X][i] = (i - hnX < 0) ? i - hnX + nX : i - hnX;
+		shiftOut[_X][i] = (i + hnX) % nX;
+	}
+	for (int j = 0; j < nY; j++) {
+		shiftIn[_Y][j] = (j - hnY < 0) ? j - hnY + nY : j - hnY;
+		shiftOut[_Y][j] = (j + hnY) % nY;
+	}
+	rowReady.assign(nY, 0);
+
+	// RS plane layout : [idxrY][idxnY][idxrX][idxnX]
+	// One view row (fixed idxnY) of every pixel tile is transformed along x by a
+	// single plan. It is executed on other rows through the new-array interface,
+	// so the plan must not assume alignment, and it runs on the calling thread.
+	fftw_iodim dims;
+	dims.n = nX; dims.is = 1; dims.os = 1;
+
+	fftw_iodim howmany_dims[2];
+	howmany_dims[0].n = rY; howmany_dims[0].is = nXY * rX; howmany_dims[0].os = nXY * rX;
+	howmany_dims[1].n = rX; howmany_dims[1].is = nX; howmany_dims[1].os = nX;
+
+	if (rowPlan) fftw_destroy_plan(rowPlan);
+	fftw_complex* field = reinterpret_cast<fftw_complex*>(RSplane_complex_field);
+	int nPlannerThreads = setFFTWPlannerThreads(1);
+	rowPlan = fftw_plan_guru_dft(1, &dims, 2, howmany_dims, field, field, OPH_FORWARD, OPH_ESTIMATE | OPH_UNALIGNED);
+	setFFTWPlannerThreads(nPlannerThreads);
+}
 
-	//Complex<Real>* complexLF = new Complex<Real>[rXY];
-	Complex<Real>* complexLF = new Complex<Real>[nXY];
+void ophLF::transformLFRow(int idxnY)
+{
+	const int nX = num_image[_X];
+	const int nY = num_image[_Y];
+	const int nXY = nX * nY;
+	const int rX = resolution_image[_X];
+	const int rY = resolution_image[_Y];
+	const int* inX = shiftIn[_X].data();
+	const int offset = nX * rX * shiftIn[_Y][idxnY];
+
+	for (int idxrY = 0; idxrY < rY; idxrY++) {
+		Complex<Real>* row = RSplane_complex_field + (size_t)nXY * rX * idxrY + offset;
+		if (is_PixelMajor) {
+			// pixelLF[pixel idx][img idx]
+			const uchar* src = pixelLF + (size_t)nXY * rX * idxrY + nX * idxnY;
+			for (int idxrX = 0; idxrX < rX; idxrX++) {
+				Complex<Real>* dst = row + nX * idxrX;
+				for (int idxnX = 0; idxnX < nX; idxnX++)
+					dst[inX[idxnX]] = Complex<Real>((Real)src[idxnX], 0.0);
+				src += nXY;
+			}
+		}
+		else {
+			for (int idxnX = 0; idxnX < nX; idxnX++) {
+				// LF[img idx][pixel idx]
+				const uchar* src = LF[idxnX + nX * idxnY] + rX * idxrY;
+				Complex<Real>* dst = row + inX[idxnX];
+				for (int idxrX = 0; idxrX < rX; idxrX++)
+					dst[nX * idxrX] = Complex<Real>((Real)src[idxrX], 0.0);
+			}
+		}
+	}
 
-	Complex<Real>* FFTLF = new Complex<Real>[nXY];
+	fftw_complex* field = reinterpret_cast<fftw_complex*>(RSplane_complex_field + offset);
+	fftw_execute_dft(rowPlan, field, field);
+	rowReady[idxnY] = 1;
+}
 
-	Real randVal;
-	Complex<Real> phase(0.0, 0.0);
+void ophLF::convertLF2ComplexField()
+{
+	auto begin = CUR_TIME;
 
-	int idxrX;
-	int idxImg = 0;
+	const int nX = num_image[_X];
+	const int nY = num_image[_Y];
+	const int nXY = nX * nY;
+	const int rX = resolution_image[_X];
+	const int rY = resolution_image[_Y];
+	const int rXY = rX * rY;
 
-	for (idxrX = 0; idxrX < rX; idxrX++) { // 192
-		for (int idxrY = 0; idxrY < rY; idxrY++) { // 108
-			memset(complexLF, 0.0, sizeof(Complex<Real>) * nXY);
-			memset(FFTLF, 0.0, sizeof(Complex<Real>) * nXY);
+	// a streaming load has already transformed the view rows it completed.
+	if (!RSplane_complex_field || !rowPlan || (int)rowReady.size() != nY)
+		prepareRSPlane();
 
-			for (int idxnY = 0; idxnY < nY; idxnY++) { // 10
-				for (int idxnX = 0; idxnX < nX; idxnX++) { // 10
-					// LF[img idx][pixel idx]
-					complexLF[idxnX + nX * idxnY] = (Real)(LF[idxnX + nX * idxnY][idxrX + rX * idxrY]);
-				}
-			}
+	int idxnY;
+#ifdef _OPENMP
+#pragma omp parallel for private(idxnY)
+#endif
+	for (idxnY = 0; idxnY < nY; idxnY++) {
+		if (!rowReady[idxnY])
+			transformLFRow(idxnY);
+	}
+
+	// y direction of the angular FFTs, all tiles at once.
+	fftw_iodim dims;
+	dims.n = nY; dims.is = nX * rX; dims.os = nX * rX;
 
-			fft2(num_image, complexLF, OPH_FORWARD, OPH_ESTIMATE);
-			fftwShift(complexLF, FFTLF, nX, nY, OPH_FORWARD);
-			//fftExecute(FFTLF);
-
-			for (int idxnX = 0; idxnX < nX; idxnX++) { // 10
-				for (int idxnY = 0; idxnY < nY; idxnY++) { // 10
-					randVal = rand((Real)0, (Real)1, idxrX * idxrY);
-					phase(0, 2 * M_PI * randVal); // random phase
-
-					//*(RSplane_complex_field + nXY * rX*idxrY + nX * rX*idxnY + nX * idxrX + idxnX) = *(FFTLF + (idxnX + nX * idxnY))*exp(phase);
-					// 100 * 192 * 107 + 10 * 192 * 107 + 10 * 191 + 9
-					RSplane_complex_field[nXY * rX*idxrY + nX * rX*idxnY + nX * idxrX + idxnX] =
-						FFTLF[idxnX + nX * idxnY] * exp(phase);
-					//
-					// (20/5) (x:5/y:8) => 165
+	fftw_iodim howmany_dims[2];
+	howmany_dims[0].n = rY; howmany_dims[0].is = nXY * rX; howmany_dims[0].os = nXY * rX;
+	howmany_dims[1].n = nX * rX; howmany_dims[1].is = 1; howmany_dims[1].os = 1;
+
+	fftw_complex* field = reinterpret_cast<fftw_complex*>(RSplane_complex_field);
+	fftw_plan plan = fftw_plan_guru_dft(1, &dims, 2, howmany_dims, field, field, OPH_FORWARD, OPH_ESTIMATE);
+	fftw_execute(plan);
+	fftw_destroy_plan(plan);
+
+	const int* outX = shiftOut[_X].data();
+	const int* outY = shiftOut[_Y].data();
+	int idxrY;
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+	{
+		Complex<Real>* tile = new Complex<Real>[nXY];
+		Complex<Real> phase(0.0, 0.0);
+#ifdef _OPENMP
+#pragma omp for private(idxrY)
+#endif
+		for (idxrY = 0; idxrY < rY; idxrY++) {
+			Complex<Real>* row = RSplane_complex_field + (size_t)nXY * rX * idxrY;
+			for (int idxrX = 0; idxrX < rX; idxrX++) {
+				Complex<Real>* base = row + nX * idxrX;
+				for (int idxnY = 0; idxnY < nY; idxnY++)
+					memcpy(tile + nX * idxnY, base + nX * rX * idxnY, sizeof(Complex<Real>) * nX);
+
+				// the seed only depends on the pixel, so one draw covers the whole tile.
+				Real randVal = rand((Real)0, (Real)1, idxrX * idxrY);
+				phase(0, 2 * M_PI * randVal); // random phase
+				Complex<Real> rnd = phase.exp();
+
+				for (int idxnY = 0; idxnY < nY; idxnY++) {
+					Complex<Real>* dst = base + nX * rX * idxnY;
+					const Complex<Real>* src = tile + nX * outY[idxnY];
+					for (int idxnX = 0; idxnX < nX; idxnX++)
+						dst[idxnX] = src[outX[idxnX]] * rnd;
 				}
 			}
-			idxImg++;
 		}
+		delete[] tile;
 	}
-	delete[] complexLF, FFTLF;
-	fftFree();
+
+	// the RS plane now holds the final field, the next conversion starts over from LF.
+	fftw_destroy_plan(rowPlan);
+	rowPlan = nullptr;
+	rowReady.clear();
+
 	auto end = CUR_TIME;
 	LOG("\n%s : %lf(s)\n\n", __FUNCTION__, ((std::chrono::duration<Real>)(end - begin)).count());
 }
 
+void ophLF::ophFree(void)
+{
+	releaseLF();
+	if (RSplane_complex_field) {
+		delete[] RSplane_complex_field;
+		RSplane_complex_field = nullptr;
+	}
+	if (rowPlan) {
+		fftw_destroy_plan(rowPlan);
+		rowPlan = nullptr;
+	}
+	ophGen::ophFree();
+}
+
 void ophLF::writeIntensity_gray8_bmp(const char* fileName, int nx, int ny, Complex<Real>* complexvalue, int k)
 {
 	const int n = nx * ny;
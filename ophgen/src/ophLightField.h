@@ -111,7 +111,14 @@ protected:
 private:
 
 	uchar** LF;										/// Light Field array / 4-D array
+	uchar* pixelLF;									/// Light Field array / pixel-major [pixelIdx][imageIdx]
+	uchar* mappedLF;								/// Mapped view of a light field pack, pixelLF points into it
+	uint64_t mappedSize;
 	Complex<Real>* RSplane_complex_field;			/// Complex field in Ray Sampling plane
+	fftw_plan rowPlan;								/// x direction angular FFT of one view row
+	vector<int> shiftIn[2];							/// fftshift index tables of the angular FFT
+	vector<int> shiftOut[2];
+	vector<uchar> rowReady;							/// view rows already transformed along x
 
 	// ==== GPU Variables ===============================================
 	bool		is_CPU;
@@ -135,6 +142,8 @@ public:
 	inline Real getDistRS2Holo() { return distanceRS2Holo; }
 	inline Real getFieldLens() { return fieldLens; }
 	inline uchar** getLF() { return LF; }
+	inline uchar* getPixelLF() { return pixelLF; }
+	inline bool isPixelMajor() { return is_PixelMajor; }
 	inline oph::Complex<Real>* getRSPlane() { return RSplane_complex_field; }
 public:
 	/**
@@ -158,6 +167,25 @@ public:
 	*/
 	int loadLF(const char* directory, const char* exten);
 	int loadLF();
+
+	/**
+	* @brief	Light Field pack load
+	* @details	Maps a file written by saveLFPack. With the pixel-major layout the
+	*			mapped view is used as pixelLF without a copy.
+	* @param	fname			Light Field pack file name
+	* @return	LF or pixelLF
+	*/
+	int loadLFPack(const char* fname);
+
+	/**
+	* @brief	Light Field pack save
+	* @details	Writes the loaded light field as one pixel-major block for repeated runs.
+	* @param	fname			Light Field pack file name
+	* @return	Type: <B>bool</B>\n
+	*			If the function succeeds, the return value is <B>true</B>.\n
+	*			If the function fails, the return value is <B>false</B>.
+	*/
+	bool saveLFPack(const char* fname);
 	//void readPNG(const string filename, uchar* data);
 
 	/**
@@ -199,12 +227,41 @@ public:
 	* @param is_ViewingWindow : the value for specifying whether the hologram generation method is implemented on the viewing window
 	*/
 	void setViewingWindow(bool is_ViewingWindow);
+
+	/**
+	* @brief Set the value of a variable is_PixelMajor(true or false)
+	* @details <pre>
+	if is_PixelMajor == true
+	loadLF stores the light field in one contiguous buffer, pixelLF[pixelIdx * numOfImages + imageIdx]
+	else
+	loadLF stores one buffer per element image, LF[imageIdx][pixelIdx] </pre>
+	* Must be set before loadLF is called.
+	* @param is_PixelMajor : the value for specifying the light field storage layout
+	*/
+	void setPixelMajor(bool is_PixelMajor);
+
+	/**
+	* @brief Set the value of a variable is_Streaming(true or false)
+	* @details <pre>
+	if is_Streaming == true
+	loadLF runs the x direction angular FFTs of each view row as soon as its images are decoded
+	else
+	all angular FFTs run in convertLF2ComplexField </pre>
+	* @param is_Streaming : the value for specifying whether loading overlaps the conversion
+	*/
+	void setStreaming(bool is_Streaming);
 protected:
 	
 	// Inner functions
 
 	void initializeLF();
+	void releaseLF();
+	bool loadLFImages(const vector<string>& files);
+	void storeLF(int idx, uchar* rgb, int w, int h, int bytesperpixel);
+	void prepareRSPlane();
+	void transformLFRow(int idxnY);
 	void convertLF2ComplexField();
+	virtual void ophFree(void);
 
 	// ==== GPU Methods ===============================================
 	void prepareInputdataGPU();
@@ -218,8 +275,13 @@ private:
 	Real distanceRS2Holo;					/// Distance from Ray Sampling plane to Hologram plane
 	Real fieldLens;
 	bool is_ViewingWindow;
+	bool is_PixelMajor;
+	bool is_Streaming;
 	bool bSinglePrecision;
 	int nImages;
+
+protected:
+	virtual void serializeConfig(OphConfigArchive& ar) { ar & fieldLens & num_image & resolution_image & distanceRS2Holo; }
 };
 
 
@@ -74,10 +74,23 @@ void ophLF::prepareInputdataGPU()
 	HANDLE_ERROR(cudaMalloc(&LF_gpu, sizeof(uchar1*) * nXY));
 	LFData_gpu = (uchar**)malloc(sizeof(uchar*) * nXY);
 
-	for (int i = 0; i < nXY; i++) {
-		HANDLE_ERROR(cudaMalloc(&LFData_gpu[i], sizeof(uchar1) * rXY));
-		HANDLE_ERROR(cudaMemset(LFData_gpu[i], 0, sizeof(uchar1) * rXY));
-		HANDLE_ERROR(cudaMemcpyAsync(LFData_gpu[i], LF[i], sizeof(uchar) * rXY, cudaMemcpyHostToDevice), streamLF);
+	if (is_PixelMajor) {
+		// the kernel reads LF[img idx][pixel idx], so gather each view out of pixelLF.
+		uchar* view = new uchar[rXY];
+		for (int i = 0; i < nXY; i++) {
+			for (int j = 0; j < rXY; j++)
+				view[j] = pixelLF[(size_t)j * nXY + i];
+			HANDLE_ERROR(cudaMalloc(&LFData_gpu[i], sizeof(uchar1) * rXY));
+			HANDLE_ERROR(cudaMemcpy(LFData_gpu[i], view, sizeof(uchar) * rXY, cudaMemcpyHostToDevice));
+		}
+		delete[] view;
+	}
+	else {
+		for (int i = 0; i < nXY; i++) {
+			HANDLE_ERROR(cudaMalloc(&LFData_gpu[i], sizeof(uchar1) * rXY));
+			HANDLE_ERROR(cudaMemset(LFData_gpu[i], 0, sizeof(uchar1) * rXY));
+			HANDLE_ERROR(cudaMemcpyAsync(LFData_gpu[i], LF[i], sizeof(uchar) * rXY, cudaMemcpyHostToDevice), streamLF);
+		}
 	}
 
 	HANDLE_ERROR(cudaMemcpy(LF_gpu, LFData_gpu, sizeof(uchar*) * nXY, cudaMemcpyHostToDevice));
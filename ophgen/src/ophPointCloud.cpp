@@ -48,6 +48,10 @@
 #include "tinyxml2.h"
 #include <sys.h>
 #include <cufft.h>
+#include "PLYparser.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 ophPointCloud::ophPointCloud(void)
 	: ophGen()
@@ -56,6 +60,10 @@ ophPointCloud::ophPointCloud(void)
 	, m_nProgress(0)
 	, n_points(-1)
 	, bSinglePrecision(false)
+	, is_Streaming(false)
+	, m_nChunkSize(1 << 18)
+	, m_nDiffFlag(PC_DIFF_RS)
+	, m_nPointCapacity(0)
 {
 	LOG("*** POINT CLOUD : BUILD DATE: %s %s ***\n\n", __DATE__, __TIME__);
 }
@@ -65,6 +73,10 @@ ophPointCloud::ophPointCloud(const char* pc_file, const char* cfg_file)
 	, is_CPU(true)
 	, is_ViewingWindow(false)
 	, m_nProgress(0)
+	, is_Streaming(false)
+	, m_nChunkSize(1 << 18)
+	, m_nDiffFlag(PC_DIFF_RS)
+	, m_nPointCapacity(0)
 {
 	n_points = loadPointCloud(pc_file);
 	if (n_points == -1) std::cerr << "OpenHolo Error : Failed to load Point Cloud Data File(*.dat)" << std::endl;
@@ -87,15 +99,67 @@ void ophPointCloud::setViewingWindow(bool is_ViewingWindow)
 	this->is_ViewingWindow = is_ViewingWindow;
 }
 
+void ophPointCloud::setStreaming(bool is_Streaming, uint chunkSize)
+{
+	this->is_Streaming = is_Streaming;
+	m_nChunkSize = chunkSize > 0 ? chunkSize : 1;
+}
+
 int ophPointCloud::loadPointCloud(const char* pc_file)
 {
+	if (is_Streaming) {
+		// only the header : the points are read while the hologram is generated
+		PLYparser plyIO;
+		if (!plyIO.openPLYStream(pc_file, pc_data_.n_points, pc_data_.n_colors, pc_data_.isPhaseParse))
+			return -1;
+		m_streamFile = pc_file;
+		n_points = (int)pc_data_.n_points;
+		return n_points;
+	}
 	n_points = ophGen::loadPointCloud(pc_file, &pc_data_);
+	m_nPointCapacity = n_points > 0 ? n_points : 0;
 
 	return n_points;
 }
 
+bool ophPointCloud::loadBatchInput(const OphBatchJob& job)
+{
+	if (job.inputs.empty()) return false;
+	if (is_Streaming)
+		return loadPointCloud(job.inputs[0].c_str()) != -1;
+
+	PLYparser plyIO;
+	ulonglong n = 0;
+	bool isPhaseParse = false;
+	if (!plyIO.loadPLYHeader(job.inputs[0], n, pc_data_.n_colors, isPhaseParse))
+		return false;
+
+	// point arrays only grow, so the points of a batch are decoded in place
+	if (n > m_nPointCapacity || !pc_data_.vertex || !pc_data_.color || !pc_data_.phase) {
+		delete[] pc_data_.vertex;
+		delete[] pc_data_.color;
+		delete[] pc_data_.phase;
+		pc_data_.vertex = new Real[3 * n];
+		pc_data_.color = new Real[3 * n];
+		pc_data_.phase = new Real[n];
+		m_nPointCapacity = n;
+	}
+	if (!plyIO.loadPLY(job.inputs[0], n, pc_data_.n_colors, pc_data_.vertex, pc_data_.color, pc_data_.phase))
+		return false;
+
+	pc_data_.n_points = n;
+	pc_data_.isPhaseParse = isPhaseParse;
+	n_points = (int)n;
+	return true;
+}
+
 bool ophPointCloud::readConfig(const char* fname)
 {
+	if (loadCachedConfig(fname)) {
+		initialize();
+		return true;
+	}
+
 	if (!ophGen::readConfig(fname))
 		return false;
 
@@ -138,6 +202,7 @@ bool ophPointCloud::readConfig(const char* fname)
 	auto during = ((chrono::duration<Real>)(end - start)).count();
 	LOG("%lf (s)..done\n", during);
 
+	storeCachedConfig();
 	initialize();
 	return true;
 }
@@ -163,9 +228,14 @@ Real ophPointCloud::generateHologram(uint diff_flag)
 	LOG("4) Diffraction Method : %s\n", diff_flag == PC_DIFF_RS ? "R-S" : "Fresnel");
 	LOG("5) Number of Point Cloud : %d\n", n_points);
 	LOG("6) Precision Level : %s\n", getPrecision() ? "Single" : "Double");
+	if (is_Streaming)
+		LOG("7) Streaming : %u points per chunk (CPU)\n", m_nChunkSize);
 
 	// Create CGH Fringe Pattern by 3D Point Cloud
-	if (is_CPU) { //Run CPU
+	if (is_Streaming) { //Run CPU, reading the points chunk by chunk
+		genCghPointCloudStream(diff_flag);
+	}
+	else if (is_CPU) { //Run CPU
 		genCghPointCloudCPU(diff_flag);
 	}
 	else { //Run GPU
@@ -299,9 +369,6 @@ Real ophPointCloud::genCghPointCloudCPU(uint diff_flag)
 
 	uint nChannel = context_.waveNum;
 
-	bool bIsGrayScale = pc_data_.n_colors == 1 ? true : false;
-
-	int i; // private variable for Multi Threading
 	int num_threads = 1;
 	int sum = 0;
 	m_nProgress = 0;
@@ -316,74 +383,188 @@ Real ophPointCloud::genCghPointCloudCPU(uint diff_flag)
 	}
 	
 	for (uint ch = 0; ch < nChannel; ++ch) {
-		// Wave Number (2 * PI / lambda(wavelength))
-		Real lambda = context_.wave_length[ch];
-		Real k = context_.k = (2 * M_PI / lambda);
+		num_threads = diffractPoints(diff_flag, ch, pVertex, pc_data_.color, pc_data_.n_colors, n_points, n_points, sum);
+	}
+	if (is_ViewingWindow) {
+		delete[] pVertex;
+	}
+	auto end = CUR_TIME;
+	Real elapsed_time = ((chrono::duration<Real>)(end - begin)).count();
+	LOG("\n%s : %lf(s) <%d threads>\n\n",
+		__FUNCTION__,
+		elapsed_time,
+		num_threads);
+
+	return elapsed_time;
+}
+
+int ophPointCloud::diffractPoints(uint diff_flag, uint ch, const Real* pVertex, const Real* pColor, int nColors, int nPoint, int nTotal, int &sum)
+{
+	ivec2 pn;
+	pn[_X] = context_.pixel_number[_X];
+	pn[_Y] = context_.pixel_number[_Y];
+
+	vec2 pp;
+	pp[_X] = context_.pixel_pitch[_X];
+	pp[_Y] = context_.pixel_pitch[_Y];
+
+	vec2 ss;
+	ss[_X] = context_.ss[_X];
+	ss[_Y] = context_.ss[_Y];
+
+	uint nChannel = context_.waveNum;
 
-		Real ratio = context_.wave_length[nChannel - 1] / context_.wave_length[ch];
+	bool bIsGrayScale = nColors == 1 ? true : false;
 
-		uint nAdd = bIsGrayScale ? 0 : ch;
+	int i; // private variable for Multi Threading
+	int num_threads = 1;
+
+	// Wave Number (2 * PI / lambda(wavelength))
+	Real lambda = context_.wave_length[ch];
+	Real k = context_.k = (2 * M_PI / lambda);
+
+	Real ratio = context_.wave_length[nChannel - 1] / context_.wave_length[ch];
+
+	uint nAdd = bIsGrayScale ? 0 : ch;
 #ifdef _OPENMP
 #pragma omp parallel
-		{
-			num_threads = omp_get_num_threads(); // get number of Multi Threading
-			int tid = omp_get_thread_num();
+	{
+		num_threads = omp_get_num_threads(); // get number of Multi Threading
+		int tid = omp_get_thread_num();
 
 #pragma omp for private(i)
 #endif
-			for (i = 0; i < n_points; ++i) { //Create Fringe Pattern
-				uint iVertex = 3 * i; // x, y, z
-				uint iColor = pc_data_.n_colors * i + nAdd; // rgb or gray-scale
-				Real pcx, pcy, pcz;
-
-				pcx = pVertex[iVertex + _X];
-				pcy = pVertex[iVertex + _Y];
-				pcz = pVertex[iVertex + _Z];
-				pcx *= pc_config_.scale[_X];
-				pcy *= pc_config_.scale[_Y];
-				pcz *= pc_config_.scale[_Z];
-				pcx *= ratio;
-				pcy *= ratio;
-#if 1
-				pcz += pc_config_.distance;
-				
-				Real amplitude = pc_data_.color[iColor];
-
-				switch (diff_flag)
-				{
-				case PC_DIFF_RS:
-					diffractNotEncodedRS(ch, pn, pp, ss, vec3(pcx, pcy, pcz), k, amplitude, lambda);
-#else
-				Real amplitude = pc_data_.color[iColor];
-				switch (diff_flag)
-				{
-				case PC_DIFF_RS:
-					RS_Propagation(vec3(pcx, pcy, pcz), complex_H[ch], lambda, pc_config_.distance, amplitude);
+		for (i = 0; i < nPoint; ++i) { //Create Fringe Pattern
+			uint iVertex = 3 * i; // x, y, z
+			uint iColor = nColors * i + nAdd; // rgb or gray-scale
+			Real pcx, pcy, pcz;
+
+			pcx = pVertex[iVertex + _X];
+			pcy = pVertex[iVertex + _Y];
+			pcz = pVertex[iVertex + _Z];
+			pcx *= pc_config_.scale[_X];
+			pcy *= pc_config_.scale[_Y];
+			pcz *= pc_config_.scale[_Z];
+			pcx *= ratio;
+			pcy *= ratio;
+			pcz += pc_config_.distance;
+
+			Real amplitude = pColor[iColor];
+
+			switch (diff_flag)
+			{
+			case PC_DIFF_RS:
+				diffractNotEncodedRS(ch, pn, pp, ss, vec3(pcx, pcy, pcz), k, amplitude, lambda);
+				break;
+			case PC_DIFF_FRESNEL:
+				diffractNotEncodedFrsn(ch, pn, pp, ss, vec3(pcx, pcy, pcz), k, amplitude, lambda);
+				break;
+			}
+#pragma omp atomic
+			sum++;
 
+			m_nProgress = (int)((Real)sum * 100 / ((Real)nTotal * nChannel));
+		}
+#ifdef _OPENMP
+	}
 #endif
-					break;
-				case PC_DIFF_FRESNEL:
-					diffractNotEncodedFrsn(ch, pn, pp, ss, vec3(pcx, pcy, pcz), k, amplitude, lambda);
-					break;
-				}
-#pragma omp atomic
-				sum++;
+	return num_threads;
+}
+
+Real ophPointCloud::genCghPointCloudStream(uint diff_flag)
+{
+	auto begin = CUR_TIME;
+
+	PLYparser plyIO;
+	ulonglong nTotal = 0;
+	int nColors = 0;
+	bool isPhaseParse = false;
+	if (!plyIO.openPLYStream(m_streamFile, nTotal, nColors, isPhaseParse)) {
+		LOG("Failed to open the point cloud stream \"%s\"\n", m_streamFile.c_str());
+		return 0.0;
+	}
+	pc_data_.n_colors = nColors;
+
+	// Length (Width) of complex field at eyepiece plane (by simple magnification)
+	context_.ss[_X] = context_.pixel_number[_X] * context_.pixel_pitch[_X];
+	context_.ss[_Y] = context_.pixel_number[_Y] * context_.pixel_pitch[_Y];
 
-				m_nProgress = (int)((Real)sum * 100 / ((Real)n_points * nChannel));
+	uint nChannel = context_.waveNum;
+	const ulonglong nChunk = m_nChunkSize;
+
+	// Double buffer : the producer thread decodes one chunk while the other is diffracted.
+	Real* vertex[2] = { new Real[nChunk * 3], new Real[nChunk * 3] };
+	Real* color[2] = { new Real[nChunk * 3], new Real[nChunk * 3] };
+	ulonglong count[2] = { 0, 0 };
+	bool bFull[2] = { false, false };
+	std::mutex lock;
+	std::condition_variable cvChunk;
+
+	std::thread producer([&] {
+		for (int slot = 0; ; slot ^= 1) {
+			{
+				std::unique_lock<std::mutex> lk(lock);
+				cvChunk.wait(lk, [&] { return !bFull[slot]; });
 			}
-#ifdef _OPENMP
+			ulonglong n = plyIO.readPLYStream(nChunk, vertex[slot], color[slot], nullptr);
+			{
+				std::lock_guard<std::mutex> lk(lock);
+				count[slot] = n;
+				bFull[slot] = true;
+			}
+			cvChunk.notify_all();
+			if (n == 0) break;
 		}
-#endif
+	});
+
+	int num_threads = 1;
+	int sum = 0;
+	ulonglong nRead = 0;
+	m_nProgress = 0;
+
+	Real *pVertex = is_ViewingWindow ? new Real[nChunk * 3] : nullptr;
+	for (int slot = 0; ; slot ^= 1) {
+		{
+			std::unique_lock<std::mutex> lk(lock);
+			cvChunk.wait(lk, [&] { return bFull[slot]; });
+		}
+		ulonglong n = count[slot];
+		if (n == 0) break;
+
+		Real *pSrc = vertex[slot];
+		if (is_ViewingWindow) {
+			transVW((int)n * 3, pVertex, pSrc);
+			pSrc = pVertex;
+		}
+		// point contributions are additive, so each chunk is diffracted on its own
+		for (uint ch = 0; ch < nChannel; ++ch) {
+			num_threads = diffractPoints(diff_flag, ch, pSrc, color[slot], nColors, (int)n, (int)nTotal, sum);
+		}
+		nRead += n;
+
+		{
+			std::lock_guard<std::mutex> lk(lock);
+			bFull[slot] = false;
+		}
+		cvChunk.notify_all();
 	}
-	if (is_ViewingWindow) {
-		delete[] pVertex;
+	producer.join();
+
+	delete[] pVertex;
+	for (int slot = 0; slot < 2; slot++) {
+		delete[] vertex[slot];
+		delete[] color[slot];
 	}
+	if (nRead != nTotal)
+		LOG("Point cloud stream ended at %llu of %llu points\n", nRead, nTotal);
+
 	auto end = CUR_TIME;
 	Real elapsed_time = ((chrono::duration<Real>)(end - begin)).count();
-	LOG("\n%s : %lf(s) <%d threads>\n\n",
+	LOG("\n%s : %lf(s) <%d threads, %llu points per chunk>\n\n",
 		__FUNCTION__,
 		elapsed_time,
-		num_threads);
+		num_threads,
+		nChunk);
 
 	return elapsed_time;
 }
@@ -656,6 +656,23 @@ public:
 	*/
 	bool isCPU() { return is_CPU; }
 
+	/**
+	* @brief Set the streaming mode of the point cloud generation
+	* @details In streaming mode, loadPointCloud reads only the header of the *.ply file, and generateHologram
+	*			decodes the points chunk by chunk on a producer thread while the previous chunk is diffracted on the CPU.
+	*			Memory is bounded by the chunk size. Without a color channel element, the colors are used as RGB.
+	* @param[in] is_Streaming : streaming on/off
+	* @param[in] chunkSize : number of points in a chunk
+	*/
+	void setStreaming(bool is_Streaming, uint chunkSize = 1 << 18);
+	bool isStreaming() { return is_Streaming; }
+
+	/**
+	* @brief Set the diffraction method of generateBatch()
+	* @param[in] diff_flag PC_DIFF_RS or PC_DIFF_FRESNEL
+	*/
+	void setDiffractionFlag(uint diff_flag) { m_nDiffFlag = diff_flag; }
+
 	/**
 	* @brief override
 	* @{
@@ -727,6 +744,18 @@ private:
 	*/
 	Real genCghPointCloudCPU(uint diff_flag);
 	
+	/**
+	* @brief Add the fringe pattern of nPoint points to channel ch
+	* @return number of threads
+	*/
+	int diffractPoints(uint diff_flag, uint ch, const Real* pVertex, const Real* pColor, int nColors, int nPoint, int nTotal, int &sum);
+
+	/**
+	* @brief genCghPointCloudCPU() on a point cloud stream, chunk by chunk
+	* @return implement time (sec)
+	*/
+	Real genCghPointCloudStream(uint diff_flag);
+
 	void diffractEncodedRS(uint channel, ivec2 pn, vec2 pp, vec2 ss, vec3 pc, Real k, Real amplitude, vec2 theta);
 	void diffractNotEncodedRS(uint channel, ivec2 pn, vec2 pp, vec2 ss, vec3 pc, Real k, Real amplitude, Real lambda);
 
@@ -747,10 +776,20 @@ private:
 	bool is_CPU;
 	bool is_ViewingWindow;
 	bool bSinglePrecision;
+	bool is_Streaming;
+	uint m_nChunkSize;
+	std::string m_streamFile;
+	uint m_nDiffFlag;
+	ulonglong m_nPointCapacity;
 	int n_points;
 	uint m_nProgress;
 	OphPointCloudConfig pc_config_;
 	OphPointCloudData	pc_data_;
+
+protected:
+	virtual void serializeConfig(OphConfigArchive& ar) { ar & pc_config_.scale & pc_config_.distance; }
+	virtual bool loadBatchInput(const OphBatchJob& job);
+	virtual void generateBatchItem(void) { generateHologram(m_nDiffFlag); }
 };
 
 #endif // !__ophPointCloud_h
\ No newline at end of file
@@ -77,6 +77,19 @@ ophTri::ophTri(void)
 	, no(nullptr)
 	, na(nullptr)
 	, nv(nullptr)
+	, meshData(nullptr)
+	, triMeshArray(nullptr)
+	, SHADING_TYPE(SHADING_FLAT)
+	, flx(nullptr)
+	, fly(nullptr)
+	, flz(nullptr)
+	, freqTermX(nullptr)
+	, freqTermY(nullptr)
+	, m_nFaceCapacity(0)
+	, m_nPixelCapacity(0)
+	, m_fftBuffer(nullptr)
+	, m_fftPlan(nullptr)
+	, m_fftSize(0, 0)
 {
 	LOG("*** MESH : BUILD DATE: %s %s ***\n\n", __DATE__, __TIME__);
 }
@@ -123,9 +136,81 @@ uint ophTri::loadMeshText(const char* fileName)
 	return 1;
 }
 
+void ophTri::releaseMeshData()
+{
+	if (!meshData) return;
+
+	// a text mesh is read into its own array, a PLY mesh uses the vertex array
+	if (triMeshArray != meshData->vertex)
+		delete[] triMeshArray;
+	delete[] meshData->face_idx;
+	delete[] meshData->vertex;
+	delete[] meshData->color;
+	meshData->face_idx = nullptr;
+	meshData->vertex = nullptr;
+	meshData->color = nullptr;
+	meshData->n_faces = 0;
+	triMeshArray = nullptr;
+}
+
+void ophTri::ophFree(void)
+{
+	ophGen::ophFree();
+
+	releaseMeshData();
+	delete meshData;
+	meshData = nullptr;
+
+	delete[] normalizedMeshData;
+	delete[] scaledMeshData;
+	delete[] no;
+	delete[] na;
+	delete[] nv;
+	normalizedMeshData = nullptr;
+	scaledMeshData = nullptr;
+	no = nullptr;
+	na = nullptr;
+	nv = nullptr;
+	m_nFaceCapacity = 0;
+
+	delete[] angularSpectrum;
+	delete[] refAS;
+	delete[] ASTerm;
+	delete[] randTerm;
+	delete[] phaseTerm;
+	delete[] convol;
+	delete[] fx;
+	delete[] fy;
+	delete[] fz;
+	delete[] flx;
+	delete[] fly;
+	delete[] flz;
+	delete[] freqTermX;
+	delete[] freqTermY;
+	angularSpectrum = refAS = ASTerm = randTerm = phaseTerm = convol = nullptr;
+	fx = fy = fz = flx = fly = flz = freqTermX = freqTermY = nullptr;
+	m_nPixelCapacity = 0;
+
+#ifdef _OPENMP
+#pragma omp critical(fftw_planner)
+#endif
+	if (m_fftPlan) fftw_destroy_plan(m_fftPlan);
+	if (m_fftBuffer) fftw_free(m_fftBuffer);
+	m_fftPlan = nullptr;
+	m_fftBuffer = nullptr;
+}
+
 bool ophTri::loadMeshData(const char* fileName, const char* ext)
 {
-	meshData = new OphMeshData;
+	// a new mesh (e.g. the next item of generateBatch) replaces the previous one
+	if (meshData)
+		releaseMeshData();
+	else {
+		meshData = new OphMeshData;
+		meshData->face_idx = nullptr;
+		meshData->vertex = nullptr;
+		meshData->color = nullptr;
+	}
 	cout << "ext = " << ext << endl;
 
 	if (!strcmp(ext, "txt")) {
@@ -158,6 +243,11 @@ bool ophTri::loadMeshData(const char* fileName, const char* ext)
 
 bool ophTri::readConfig(const char* fname)
 {
+	if (loadCachedConfig(fname)) {
+		initialize();
+		return true;
+	}
+
 	if (!ophGen::readConfig(fname))
 		return false;
 
@@ -220,6 +310,7 @@ bool ophTri::readConfig(const char* fname)
 	auto during = ((chrono::duration<Real>)(end - start)).count();
 	LOG("%lf (s)..done\n", during);
 
+	storeCachedConfig();
 	initialize();
 	return true;
 }
@@ -239,87 +330,119 @@ void ophTri::initializeAS()
 	const uint pnXY = context_.pixel_number[_X] * context_.pixel_number[_Y];
 	const int N = meshData->n_faces;
 
-	if (normalizedMeshData) {
-		delete[] normalizedMeshData;
-		normalizedMeshData = nullptr;
-	}
-	normalizedMeshData = new Real[N * 9];
-	memset(normalizedMeshData, 0, sizeof(Real) * N * 9);
-
-	if (scaledMeshData) {
-		delete[] scaledMeshData;
-		scaledMeshData = nullptr;
-	}
-	scaledMeshData = new Real[N * 9];
-	memset(scaledMeshData, 0, sizeof(Real) * N * 9);
+	prepareMeshBuffers(N);
 
-	if (angularSpectrum) {
+	// per-pixel buffers only grow, so the next hologram of the same size (e.g. in generateBatch) reuses them
+	if (pnXY > m_nPixelCapacity) {
 		delete[] angularSpectrum;
-		angularSpectrum = nullptr;
-	}
-	angularSpectrum = new Complex<Real>[pnXY];
-	memset(angularSpectrum, 0, sizeof(Complex<Real>) * pnXY);
-
-	if (refAS) {
 		delete[] refAS;
-		refAS = nullptr;
-	}
-	refAS = new Complex<Real>[pnXY];
-	memset(refAS, 0, sizeof(Complex<Real>) * pnXY);
-
-	if (ASTerm) {
 		delete[] ASTerm;
-		ASTerm = nullptr;
-	}
-	ASTerm = new Complex<Real>[pnXY];
-	memset(ASTerm, 0, sizeof(Complex<Real>) * pnXY);
-
-	if (randTerm) {
 		delete[] randTerm;
-		randTerm = nullptr;
-	}
-	randTerm = new Complex<Real>[pnXY];
-	memset(randTerm, 0, sizeof(Complex<Real>) * pnXY);
-
-
-	if (phaseTerm) {
 		delete[] phaseTerm;
-		phaseTerm = nullptr;
-	}
-	phaseTerm = new Complex<Real>[pnXY];
-	memset(phaseTerm, 0, sizeof(Complex<Real>) * pnXY);
-
-
-	if (convol) {
 		delete[] convol;
-		convol = nullptr;
+		delete[] fx;
+		delete[] fy;
+		delete[] fz;
+		delete[] flx;
+		delete[] fly;
+		delete[] flz;
+		delete[] freqTermX;
+		delete[] freqTermY;
+
+		angularSpectrum = new Complex<Real>[pnXY];
+		refAS = new Complex<Real>[pnXY];
+		ASTerm = new Complex<Real>[pnXY];
+		randTerm = new Complex<Real>[pnXY];
+		phaseTerm = new Complex<Real>[pnXY];
+		convol = new Complex<Real>[pnXY];
+		fx = new Real[pnXY];
+		fy = new Real[pnXY];
+		fz = new Real[pnXY];
+		flx = new Real[pnXY];
+		fly = new Real[pnXY];
+		flz = new Real[pnXY];
+		freqTermX = new Real[pnXY];
+		freqTermY = new Real[pnXY];
+		m_nPixelCapacity = pnXY;
 	}
-	convol = new Complex<Real>[pnXY];
+	memset(angularSpectrum, 0, sizeof(Complex<Real>) * pnXY);
+	memset(refAS, 0, sizeof(Complex<Real>) * pnXY);
+	memset(ASTerm, 0, sizeof(Complex<Real>) * pnXY);
+	memset(randTerm, 0, sizeof(Complex<Real>) * pnXY);
+	memset(phaseTerm, 0, sizeof(Complex<Real>) * pnXY);
 	memset(convol, 0, sizeof(Complex<Real>) * pnXY);
+}
 
-
-	if (no) {
+void ophTri::prepareMeshBuffers(int N)
+{
+	// per-face buffers only grow as well
+	if ((ulonglong)N > m_nFaceCapacity) {
+		delete[] normalizedMeshData;
+		delete[] scaledMeshData;
 		delete[] no;
-		no = nullptr;
+		delete[] na;
+		delete[] nv;
+
+		normalizedMeshData = new Real[N * 9];
+		scaledMeshData = new Real[N * 9];
+		no = new vec3[N];
+		na = new vec3[N];
+		nv = new vec3[N * 3];
+		m_nFaceCapacity = N;
 	}
-	no = new vec3[N];
+	memset(normalizedMeshData, 0, sizeof(Real) * N * 9);
+	memset(scaledMeshData, 0, sizeof(Real) * N * 9);
 	memset(no, 0, sizeof(vec3) * N);
+	memset(na, 0, sizeof(vec3) * N);
+	memset(nv, 0, sizeof(vec3) * N * 3);
+}
 
+void ophTri::fftAngularSpectrum()
+{
+	const int pnX = context_.pixel_number[_X];
+	const int pnY = context_.pixel_number[_Y];
+	const int hX = pnX / 2;
+	const int hY = pnY / 2;
+
+	// the inverse FFT is planned once per resolution and reused by the following holograms
+	if (!m_fftPlan || m_fftSize != context_.pixel_number) {
+		if (m_fftBuffer) fftw_free(m_fftBuffer);
+		m_fftBuffer = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * pnX * pnY);
+		// the FFTW planner is not thread safe. The plan runs alone, so it keeps the planner thread count of Openholo
+#ifdef _OPENMP
+#pragma omp critical(fftw_planner)
+#endif
+		{
+			if (m_fftPlan) fftw_destroy_plan(m_fftPlan);
+			m_fftPlan = fftw_plan_dft_2d(pnY, pnX, m_fftBuffer, m_fftBuffer, OPH_BACKWARD, OPH_ESTIMATE);
+		}
+		m_fftSize = context_.pixel_number;
+	}
 
-	if (na) {
-		delete[] na;
-		na = nullptr;
+	Complex<Real>* buf = (Complex<Real>*)m_fftBuffer;
+	Complex<Real>* dst = complex_H[0];
+	int y;
+
+	// same result as fftwShift(angularSpectrum, complex_H[0], pnX, pnY, OPH_BACKWARD)
+#ifdef _OPENMP
+#pragma omp parallel for private(y)
+#endif
+	for (y = 0; y < pnY; y++) {
+		const Complex<Real>* src = angularSpectrum + ((y + hY) % pnY) * pnX;
+		memcpy(buf + y * pnX, src + hX, sizeof(Complex<Real>) * (pnX - hX));
+		memcpy(buf + y * pnX + pnX - hX, src, sizeof(Complex<Real>) * hX);
 	}
-	na = new vec3[N];
-	memset(na, 0, sizeof(vec3) * N);
 
+	fftw_execute(m_fftPlan);
 
-	if (nv) {
-		delete[] nv;
-		nv = nullptr;
+#ifdef _OPENMP
+#pragma omp parallel for private(y)
+#endif
+	for (y = 0; y < pnY; y++) {
+		const Complex<Real>* src = buf + ((y + hY) % pnY) * pnX;
+		memcpy(dst + y * pnX, src + hX, sizeof(Complex<Real>) * (pnX - hX));
+		memcpy(dst + y * pnX + pnX - hX, src, sizeof(Complex<Real>) * hX);
 	}
-	nv = new vec3[N * 3];
-	memset(nv, 0, sizeof(vec3) * N * 3);
 }
 
 
@@ -376,7 +499,10 @@ void ophTri::objNormCenter()
 	for (i = 0; i < N * 9; i++) {
 		normalizedMeshData[i] = centered[i] / del;
 	}
-	delete[] centered, x_point, y_point, z_point;
+	delete[] centered;
+	delete[] x_point;
+	delete[] y_point;
+	delete[] z_point;
 }
 
 
@@ -422,7 +548,6 @@ void ophTri::objScaleShift()
 	if (is_ViewingWindow) {
 		delete[] pMesh;
 	}
-	delete[] normalizedMeshData;
 
 	cout << "Object Scaling and Shifting Finishied.." << endl;
 
@@ -437,7 +562,7 @@ void ophTri::objScaleShift(vec3 objSize_, vector<Real> objShift_)
 	setObjSize(objSize_);
 	setObjShift(objShift_);
 
-	scaledMeshData = new Real[meshData->n_faces * 9];
+	prepareMeshBuffers(meshData->n_faces);
 
 	objNormCenter();
 	Real *pMesh = nullptr;
@@ -476,7 +601,6 @@ void ophTri::objScaleShift(vec3 objSize_, vector<Real> objShift_)
 	if (is_ViewingWindow) {
 		delete[] pMesh;
 	}
-	delete[] normalizedMeshData;
 	cout << "Object Scaling and Shifting Finishied.." << endl;
 
 #ifndef _OPENMP
@@ -489,7 +613,7 @@ void ophTri::objScaleShift(vec3 objSize_, vec3 objShift_)
 	setObjSize(objSize_);
 	setObjShift(objShift_);
 
-	scaledMeshData = new Real[meshData->n_faces * 9];
+	prepareMeshBuffers(meshData->n_faces);
 
 	objNormCenter();
 	Real *pMesh = nullptr;
@@ -527,7 +651,6 @@ void ophTri::objScaleShift(vec3 objSize_, vec3 objShift_)
 	if (is_ViewingWindow) {
 		delete[] pMesh;
 	}
-	delete[] normalizedMeshData;
 	cout << "Object Scaling and Shifting Finishied.." << endl;
 }
 
@@ -567,9 +690,7 @@ void ophTri::generateHologram(uint SHADING_FLAG)
 	(is_CPU) ? generateAS(SHADING_FLAG) : generateAS_GPU(SHADING_FLAG);
 
 	if (is_CPU) {
-		fft2(context_.pixel_number, angularSpectrum, OPH_BACKWARD, OPH_ESTIMATE);
-		fftwShift(angularSpectrum, (*complex_H), context_.pixel_number[_X], context_.pixel_number[_Y], OPH_BACKWARD);
-		/*fftExecute((*complex_H));*/
+		fftAngularSpectrum();
 	}
 	//fresnelPropagation(*(complex_H), *(complex_H), objShift[_Z]);
 
@@ -587,13 +708,6 @@ void ophTri::generateAS(uint SHADING_FLAG)
 
 	calGlobalFrequency();
 
-	flx = new Real[pnXY];
-	fly = new Real[pnXY];
-	flz = new Real[pnXY];
-
-	freqTermX = new Real[pnXY];
-	freqTermY = new Real[pnXY];
-
 
 	findNormals(SHADING_FLAG);
 	int sum = 0;
@@ -644,8 +758,6 @@ void ophTri::generateAS(uint SHADING_FLAG)
 	}
 #endif
 	LOG("Angular Spectrum Generated...\n");
-
-	delete[] scaledMeshData, fx, fy, fz, flx, fly, flz, freqTermX, freqTermY, refAS, ASTerm, randTerm, phaseTerm, convol;
 }
 
 
@@ -808,9 +920,6 @@ void ophTri::calGlobalFrequency()
 
 	Real dfx = 1 / ppX / pnX;
 	Real dfy = 1 / ppY / pnY;
-	fx = new Real[pnXY];
-	fy = new Real[pnXY];
-	fz = new Real[pnXY];
 	uint k = 0;
 
 	int startX = pnX / 2;
@@ -846,38 +955,34 @@ bool ophTri::calFrequencyTerm()
 	// p.s. 1äη 
 	const uint pnXY = context_.pixel_number[_X] * context_.pixel_number[_Y];
 
-	Real* flxShifted = new Real[pnXY];
-	Real* flyShifted = new Real[pnXY];
 	Real waveLength = context_.wave_length[0];
 	Real w = 1 / waveLength;
 	Real ww = w * w;
 
-	int i;
-	for (i = 0; i < pnXY; i++) {
-		flx[i] = geom.glRot[0] * fx[i] + geom.glRot[1] * fy[i] + geom.glRot[2] * fz[i];
-		fly[i] = geom.glRot[3] * fx[i] + geom.glRot[4] * fy[i] + geom.glRot[5] * fz[i];
-		flz[i] = sqrt(ww - flx[i] * flx[i] - fly[i] * fly[i]);
-
-		flxShifted[i] = flx[i] - w * (geom.glRot[0] * carrierWave[_X] + geom.glRot[1] * carrierWave[_Y] + geom.glRot[2] + carrierWave[_Z]);
-		flyShifted[i] = fly[i] - w * (geom.glRot[3] * carrierWave[_X] + geom.glRot[4] * carrierWave[_Y] + geom.glRot[5] + carrierWave[_Z]);
-	}
+	// carrier wave in the local frame, the same for every frequency
+	Real carrierX = w * (geom.glRot[0] * carrierWave[_X] + geom.glRot[1] * carrierWave[_Y] + geom.glRot[2] + carrierWave[_Z]);
+	Real carrierY = w * (geom.glRot[3] * carrierWave[_X] + geom.glRot[4] * carrierWave[_Y] + geom.glRot[5] + carrierWave[_Z]);
 
 	Real det = geom.loRot[0] * geom.loRot[3] - geom.loRot[1] * geom.loRot[2];
 
-	Real* invLoRot = new Real[4];
+	Real invLoRot[4];
 	invLoRot[0] = (1 / det)*geom.loRot[3];
 	invLoRot[1] = -(1 / det)*geom.loRot[2];
 	invLoRot[2] = -(1 / det)*geom.loRot[1];
 	invLoRot[3] = (1 / det)*geom.loRot[0];
 
+	int i;
 	for (i = 0; i < pnXY; i++) {
-		freqTermX[i] = invLoRot[0] * flxShifted[i] + invLoRot[1] * flyShifted[i];
-		freqTermY[i] = invLoRot[2] * flxShifted[i] + invLoRot[3] * flyShifted[i];
+		flx[i] = geom.glRot[0] * fx[i] + geom.glRot[1] * fy[i] + geom.glRot[2] * fz[i];
+		fly[i] = geom.glRot[3] * fx[i] + geom.glRot[4] * fy[i] + geom.glRot[5] * fz[i];
+		flz[i] = sqrt(ww - flx[i] * flx[i] - fly[i] * fly[i]);
+
+		Real flxShifted = flx[i] - carrierX;
+		Real flyShifted = fly[i] - carrierY;
+		freqTermX[i] = invLoRot[0] * flxShifted + invLoRot[1] * flyShifted;
+		freqTermY[i] = invLoRot[2] * flxShifted + invLoRot[3] * flyShifted;
 	}
 
-	delete[] flxShifted;
-	delete[] flyShifted;
-	delete[] invLoRot;
 	return true;
 }
 
@@ -134,6 +134,15 @@ private:
 	vec3 illumination;						/// Position of the light source (for shading effect) / No-illumination : {0, 0, 0}
 	int SHADING_TYPE;						/// SHADING_FLAT, SHADING_CONTINUOUS
 
+protected:
+	virtual void serializeConfig(OphConfigArchive& ar) { ar & objSize & objShift & illumination; }
+	virtual bool loadBatchInput(const OphBatchJob& job)
+	{
+		return !job.inputs.empty() && loadMeshData(job.inputs[0].c_str(), job.inputs.size() > 1 ? job.inputs[1].c_str() : "ply");
+	}
+	virtual void generateBatchItem(void) { generateHologram(SHADING_TYPE); }
+	virtual void ophFree(void);
+
 public:
 	void setObjSize(vec3 in) { objSize = in; }
 	void setObjShift(vec3 in) { objShift[_X] = in[_X]; objShift[_Y] = in[_Y]; objShift[_Z] = in[_Z]; }
@@ -225,6 +234,9 @@ private:
 	/// not used for users
 
 	void initializeAS();
+	void prepareMeshBuffers(int N);
+	void releaseMeshData();
+	void fftAngularSpectrum();
 	void objNormCenter();
 
 	bool checkValidity(vec3 no);
@@ -292,6 +304,12 @@ private:
 	bool is_ViewingWindow;
 	bool bSinglePrecision;
 
+	ulonglong m_nFaceCapacity;				/// Faces the per-face buffers can hold (they only grow)
+	uint m_nPixelCapacity;					/// Pixels the per-pixel buffers can hold (they only grow)
+	fftw_complex* m_fftBuffer;				/// In-place buffer of the inverse FFT of the angular spectrum
+	fftw_plan m_fftPlan;					/// Inverse FFT plan, kept while the resolution is unchanged
+	ivec2 m_fftSize;
+
 };
 
 
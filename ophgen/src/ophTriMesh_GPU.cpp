@@ -51,43 +51,7 @@ void ophTri::initialize_GPU()
 	const uint pnXY = context_.pixel_number[_X] * context_.pixel_number[_Y];
 	const int N = meshData->n_faces;
 
-	if (normalizedMeshData) {
-		delete[] normalizedMeshData;
-		normalizedMeshData = nullptr;
-	}
-	normalizedMeshData = new Real[N * 9];
-	memset(normalizedMeshData, 0, sizeof(Real) * N * 9);
-
-	if (scaledMeshData) {
-		delete[] scaledMeshData;
-		scaledMeshData = nullptr;
-	}
-	scaledMeshData = new Real[N * 9];
-	memset(scaledMeshData, 0, sizeof(Real) * N * 9);
-
-
-	if (no) {
-		delete[] no;
-		no = nullptr;
-	}
-	no = new vec3[N];
-	memset(no, 0, sizeof(vec3) * N);
-
-
-	if (na) {
-		delete[] na;
-		na = nullptr;
-	}
-	na = new vec3[N];
-	memset(na, 0, sizeof(vec3) * N);
-
-
-	if (nv) {
-		delete[] nv;
-		nv = nullptr;
-	}
-	nv = new vec3[N * 3];
-	memset(nv, 0, sizeof(vec3) * N * 3);
+	prepareMeshBuffers(N);
 
 	if (!streamTriMesh)
 		cudaStreamCreate(&streamTriMesh);
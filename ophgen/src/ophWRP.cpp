@@ -51,9 +51,15 @@ ophWRP::ophWRP(void)
 	: ophGen()
 	, scaledVertex(nullptr)
 	, bSinglePrecision(false)
+	, is_PatchCache(false)
+	, patchBin(0)
+	, patchSub(1)
+	, tfSize_(0)
+	, tfPitch_(0)
 {
 	n_points = -1;
 	p_wrp_ = nullptr;
+	p_mwrp_ = nullptr;
 	is_CPU = true;
 	is_ViewingWindow = false;
 	LOG("*** WRP : BUILD DATE: %s %s ***\n\n", __DATE__, __TIME__);
@@ -163,6 +169,11 @@ int ophWRP::loadPointCloud(const char* pc_file)
 
 bool ophWRP::readConfig(const char* fname)
 {
+	if (loadCachedConfig(fname)) {
+		initialize();
+		return true;
+	}
+
 	if (!ophGen::readConfig(fname))
 		return false;
 
@@ -218,6 +229,7 @@ bool ophWRP::readConfig(const char* fname)
 	auto during = ((chrono::duration<Real>)(end - start)).count();
 	LOG("%lf (s)..done\n", during);
 
+	storeCachedConfig();
 	initialize();
 	return true;
 }
@@ -324,6 +336,140 @@ void ophWRP::setMode(bool isCPU)
 	is_CPU = isCPU;
 }
 
+void ophWRP::setPatchCache(bool is_PatchCache, Real binWidth, int subPixel)
+{
+	this->is_PatchCache = is_PatchCache;
+	patchBin = binWidth > 0 ? binWidth : 0;
+	patchSub = subPixel > 1 ? subPixel : 1;
+}
+
+void ophWRP::recordWRPPatch(Complex<Real>* wrp, Real wrp_d, uint ch, const int* pts, int nPts)
+{
+	const int pnX = context_.pixel_number[_X];
+	const int pnY = context_.pixel_number[_Y];
+	const Real ppX = context_.pixel_pitch[_X];
+	const Real ppY = context_.pixel_pitch[_Y];
+	const int pnX_h = pnX >> 1;
+	const int pnY_h = pnY >> 1;
+	const Real lambda = context_.wave_length[ch];
+	const Real k = 2 * M_PI / lambda;
+	const Real bin = patchBin > 0 ? patchBin : lambda / 16;
+	const int nSub = patchSub;
+	const uint nAdd = (context_.waveNum == 1) ? 0 : ch;
+	OphPointCloudData pc = obj_;
+
+	// key of each point : (depth bin * nSub + sub-pixel y) * nSub + sub-pixel x
+	vector<pair<long long, int>> keys(nPts);
+	int i;
+#ifdef _OPENMP
+#pragma omp parallel for private(i)
+#endif
+	for (i = 0; i < nPts; i++) {
+		int idxPt = pts ? pts[i] : i;
+		uint idx = 3 * idxPt;
+		long long b = (long long)floor((wrp_d - scaledVertex[idx + _Z]) / bin + 0.5);
+		long long sx = 0, sy = 0;
+		if (nSub > 1) {
+			Real fx = scaledVertex[idx + _X] / ppX;
+			Real fy = scaledVertex[idx + _Y] / ppY;
+			sx = (long long)((fx - floor(fx)) * nSub);
+			sy = (long long)((fy - floor(fy)) * nSub);
+			if (sx >= nSub) sx = nSub - 1;
+			if (sy >= nSub) sy = nSub - 1;
+		}
+		keys[i] = make_pair((b * nSub + sy) * nSub + sx, idxPt);
+	}
+	sort(keys.begin(), keys.end());
+
+	vector<int> runs;
+	for (i = 0; i < nPts; i++) {
+		if (i == 0 || keys[i].first != keys[i - 1].first)
+			runs.push_back(i);
+	}
+	runs.push_back(nPts);
+	int nRun = (int)runs.size() - 1;
+
+	int j;
+#ifdef _OPENMP
+#pragma omp parallel
+	{
+#endif
+		Complex<Real>* patch = nullptr;
+		int patchSize = 0;
+#ifdef _OPENMP
+#pragma omp for private(j) schedule(dynamic)
+#endif
+		for (j = 0; j < nRun; j++) {
+			long long key = keys[runs[j]].first;
+			int sx = (int)(((key % nSub) + nSub) % nSub);
+			key = (key - sx) / nSub;
+			int sy = (int)(((key % nSub) + nSub) % nSub);
+			long long b = (key - sy) / nSub;
+
+			Real dz = b * bin;
+			int w = (int)fabs(lambda * dz / ppX / ppX / 2 + 0.5) * 2 - 1;
+			if (w <= 0)
+				continue;
+
+			int side = 2 * w;
+			if (side * side > patchSize) {
+				delete[] patch;
+				patchSize = side * side;
+				patch = new Complex<Real>[patchSize];
+			}
+
+			// build the patch of the bin once
+			Real ox = (nSub > 1) ? (sx + 0.5) / nSub : 0;
+			Real oy = (nSub > 1) ? (sy + 0.5) / nSub : 0;
+			Real sign = (dz > 0.0) ? (1.0) : (-1.0);
+			for (int wy = -w; wy < w; wy++) {
+				for (int wx = -w; wx < w; wx++) {
+					Real dx = (wx - ox) * ppX;
+					Real dy = (wy - oy) * ppY;
+					Real r = sign * sqrt(dx * dx + dy * dy + dz * dz);
+					Complex<Real>& p = patch[(wy + w) * side + wx + w];
+					p[_RE] = (cosf(k * r) * cosf(k * lambda * rand(0, 1))) / r;
+					p[_IM] = (-sinf(k * r) * sinf(k * lambda * rand(0, 1))) / r;
+				}
+			}
+
+			// scaled, shifted patch add of every point in the bin
+			for (int n = runs[j]; n < runs[j + 1]; n++) {
+				int idxPt = keys[n].second;
+				uint idx = 3 * idxPt;
+				Real amplitude = pc.color[pc.n_colors * idxPt + nAdd];
+				Real fx = scaledVertex[idx + _X] / ppX;
+				Real fy = scaledVertex[idx + _Y] / ppY;
+				int tx = ((nSub > 1) ? (int)floor(fx) : (int)fx) + pnX_h;
+				int ty = ((nSub > 1) ? (int)floor(fy) : (int)fy) + pnY_h;
+
+				int y0 = (-w > -ty) ? -w : -ty;
+				int y1 = (w < pnY - ty) ? w : pnY - ty;
+				int x0 = (-w > -tx) ? -w : -tx;
+				int x1 = (w < pnX - tx) ? w : pnX - tx;
+
+				for (int wy = y0; wy < y1; wy++) {
+					const Complex<Real>* src = patch + (wy + w) * side + w;
+					uint adr = (ty + wy) * pnX + tx;
+					for (int wx = x0; wx < x1; wx++) {
+#ifdef _OPENMP
+#pragma omp atomic
+						wrp[adr + wx][_RE] += amplitude * src[wx][_RE];
+#pragma omp atomic
+						wrp[adr + wx][_IM] += amplitude * src[wx][_IM];
+#else
+						wrp[adr + wx] += src[wx] * amplitude;
+#endif
+					}
+				}
+			}
+		}
+		delete[] patch;
+#ifdef _OPENMP
+	}
+#endif
+}
+
 double ophWRP::calculateWRPCPU(void)
 {
 	auto begin = CUR_TIME;
@@ -363,6 +509,17 @@ double ophWRP::calculateWRPCPU(void)
 		Real k = context_.k = 2 * M_PI / lambda;
 		uint nAdd = bIsGrayScale ? 0 : ch;
 		int i;
+		if (wrp_config_.num_wrp > 1) {
+			calculateMWRP(ch);
+			propagateMWRP(complex_H[ch], ch);
+			continue;
+		}
+		if (is_PatchCache) {
+			recordWRPPatch(p_wrp_, wrp_d, ch, nullptr, n_points);
+			fresnelPropagation(p_wrp_, complex_H[ch], distance, ch);
+			memset(p_wrp_, 0.0, sizeof(Complex<Real>) * pnXY);
+			continue;
+		}
 #ifdef _OPENMP
 #pragma omp parallel
 		{
@@ -470,35 +627,285 @@ void ophWRP::generateHologram(void)
 	LOG("Total Elapsed Time: %lf (s)\n", m_elapsedTime);
 }
 
-Complex<Real>** ophWRP::calculateMWRP(void)
+void ophWRP::recordWRPDirect(Complex<Real>* wrp, Real wrp_d, uint ch, const int* pts, int nPts)
+{
+	const int pnX = context_.pixel_number[_X];
+	const int pnY = context_.pixel_number[_Y];
+	const Real ppX = context_.pixel_pitch[_X];
+	const Real ppY = context_.pixel_pitch[_Y];
+	const int pnX_h = pnX >> 1;
+	const int pnY_h = pnY >> 1;
+	const Real lambda = context_.wave_length[ch];
+	const Real k = 2 * M_PI / lambda;
+	const uint nAdd = (context_.waveNum == 1) ? 0 : ch;
+	OphPointCloudData pc = obj_;
+
+	for (int i = 0; i < nPts; i++) {
+		int idxPt = pts ? pts[i] : i;
+		uint idx = 3 * idxPt;
+
+		Real x = scaledVertex[idx + _X];
+		Real y = scaledVertex[idx + _Y];
+		Real z = scaledVertex[idx + _Z];
+		Real amplitude = pc.color[pc.n_colors * idxPt + nAdd];
+
+		float dz = wrp_d - z;
+		int w = (int)fabs(lambda * dz / ppX / ppX / 2 + 0.5) * 2 - 1;
+
+		int tx = (int)(x / ppX) + pnX_h;
+		int ty = (int)(y / ppY) + pnY_h;
+
+		int y0 = (-w > -ty) ? -w : -ty;
+		int y1 = (w < pnY - ty) ? w : pnY - ty;
+		int x0 = (-w > -tx) ? -w : -tx;
+		int x1 = (w < pnX - tx) ? w : pnX - tx;
+
+		double sign = (dz > 0.0) ? (1.0) : (-1.0);
+		for (int wy = y0; wy < y1; wy++) {
+			for (int wx = x0; wx < x1; wx++) {
+				double dx = wx * ppX;
+				double dy = wy * ppY;
+				double r = sign * sqrt(dx * dx + dy * dy + (double)dz * dz);
+
+				uint adr = (ty + wy) * pnX + tx + wx;
+				wrp[adr][_RE] += (amplitude * cosf(k * r) * cosf(k * lambda * rand(0, 1))) / r;
+				wrp[adr][_IM] += (-amplitude * sinf(k * r) * sinf(k * lambda * rand(0, 1))) / r;
+			}
+		}
+	}
+}
+
+Complex<Real>** ophWRP::calculateMWRP(uint ch)
 {
+	auto begin = CUR_TIME;
+
 	int wrp_num = wrp_config_.num_wrp;
 
-	if (wrp_num < 1)
+	if (wrp_num < 1 || scaledVertex == nullptr || n_points < 1)
 		return nullptr;
 
-	Complex<Real>** wrp_list = nullptr;
+	const uint pnXY = context_.pixel_number[_X] * context_.pixel_number[_Y];
 
-	Real k = context_.k;   // wave_number
-	Real lambda = context_.wave_length[0];  //wave_length
+	if (p_mwrp_ == nullptr || mwrp_loc_.size() != wrp_num) {
+		releaseMWRP();
+		p_mwrp_ = new Complex<Real>*[wrp_num];
+		for (int p = 0; p < wrp_num; p++)
+			p_mwrp_[p] = new Complex<Real>[pnXY];
+		mwrp_loc_.resize(wrp_num);
+	}
+	for (int p = 0; p < wrp_num; p++)
+		memset(p_mwrp_[p], 0.0, sizeof(Complex<Real>) * pnXY);
+
+	// partition the points by depth into slabs, each recorded to the plane in front of it
+	Real zmin = scaledVertex[_Z];
+	Real zmax = scaledVertex[_Z];
+	for (int i = 1; i < n_points; i++) {
+		Real z = scaledVertex[3 * i + _Z];
+		if (z < zmin) zmin = z;
+		if (z > zmax) zmax = z;
+	}
+	Real thick = (zmax - zmin) / wrp_num;
+	Real gap = wrp_config_.wrp_location - zmax;
+
+	for (int p = 0; p < wrp_num; p++)
+		mwrp_loc_[p] = zmin + (p + 1) * thick + gap;
+
+	vector<int> plane(n_points);
+	vector<int> start(wrp_num + 1, 0);
+	for (int i = 0; i < n_points; i++) {
+		int p = (thick > 0) ? (int)((scaledVertex[3 * i + _Z] - zmin) / thick) : wrp_num - 1;
+		if (p < 0) p = 0;
+		if (p > wrp_num - 1) p = wrp_num - 1;
+		plane[i] = p;
+		start[p + 1]++;
+	}
+	for (int p = 0; p < wrp_num; p++)
+		start[p + 1] += start[p];
 
-	const uint pnX = context_.pixel_number[_X]; //slm_pixelNumberX
-	const uint pnY = context_.pixel_number[_Y]; //slm_pixelNumberY
-	const uint pnXY = pnX * pnY;
-	const Real ppX = context_.pixel_pitch[_X];//wrp pitch
+	vector<int> order(n_points);
+	vector<int> fill(start.begin(), start.end() - 1);
+	for (int i = 0; i < n_points; i++)
+		order[fill[plane[i]]++] = i;
+
+	int num_threads = 1;
+	if (is_PatchCache) {
+		for (int p = 0; p < wrp_num; p++)
+			recordWRPPatch(p_mwrp_[p], mwrp_loc_[p], ch, order.data() + start[p], start[p + 1] - start[p]);
+	}
+	else {
+		int p;
+#ifdef _OPENMP
+#pragma omp parallel
+		{
+			num_threads = omp_get_num_threads();
+#pragma omp for private(p) schedule(dynamic)
+#endif
+			for (p = 0; p < wrp_num; p++) {
+				recordWRPDirect(p_mwrp_[p], mwrp_loc_[p], ch, order.data() + start[p], start[p + 1] - start[p]);
+			}
+#ifdef _OPENMP
+		}
+#endif
+	}
+
+	auto end = CUR_TIME;
+	LOG("\n%s : %lf(s) <%d threads>\n\n",
+		__FUNCTION__,
+		((chrono::duration<Real>)(end - begin)).count(),
+		num_threads);
+
+	return p_mwrp_;
+}
+
+const Complex<Real>* ophWRP::getTransferFunc(Real distance, Real lambda)
+{
+	const int pnX = context_.pixel_number[_X];
+	const int pnY = context_.pixel_number[_Y];
+	const Real ppX = context_.pixel_pitch[_X];
 	const Real ppY = context_.pixel_pitch[_Y];
+	const int Nx = pnX * 2;
+	const int Ny = pnY * 2;
 
-	Complex<Real>* wrp = new Complex<Real>[pnXY];
+	if (tfSize_[_X] != Nx || tfSize_[_Y] != Ny || tfPitch_[_X] != ppX || tfPitch_[_Y] != ppY) {
+		releaseTransferFunc();
+		tfSize_ = ivec2(Nx, Ny);
+		tfPitch_ = vec2(ppX, ppY);
+	}
 
-	OphPointCloudData pc = obj_;
+	for (size_t i = 0; i < tfCache_.size(); i++) {
+		if (tfCache_[i].distance == distance && tfCache_[i].lambda == lambda)
+			return tfCache_[i].H;
+	}
 
-	for (int i = 0; i<wrp_num; i++)
-	{
-//		wrp = calSubWRP(wrp_d, wrp, &pc);
-		wrp_list[i] = wrp;
+	// keep the transfer functions of the latest planes only
+	size_t nMax = (size_t)(wrp_config_.num_wrp * context_.waveNum);
+	if (nMax > 0 && tfCache_.size() >= nMax) {
+		delete[] tfCache_.front().H;
+		tfCache_.erase(tfCache_.begin());
+	}
+
+	// stored in the FFT order, so the WRP spectrum is multiplied without shifting
+	Complex<Real>* H = new Complex<Real>[Nx * Ny];
+	Real lambda2 = 1 / (lambda * lambda);
+	int y;
+#ifdef _OPENMP
+#pragma omp parallel for private(y)
+#endif
+	for (y = 0; y < Ny; y++) {
+		Real fy = ((y < pnY) ? y : y - Ny) / (Ny * ppY);
+		for (int x = 0; x < Nx; x++) {
+			Real fx = ((x < pnX) ? x : x - Nx) / (Nx * ppX);
+			Real sqrtPart = lambda2 - fx * fx - fy * fy;
+			Complex<Real>& h = H[y * Nx + x];
+			if (sqrtPart < 0) {
+				h[_RE] = 0;
+				h[_IM] = 0;
+			}
+			else {
+				Real phase = 2 * M_PI * distance * sqrt(sqrtPart);
+				h[_RE] = cos(phase);
+				h[_IM] = sin(phase);
+			}
+		}
+	}
+
+	TransferFunc tf;
+	tf.distance = distance;
+	tf.lambda = lambda;
+	tf.H = H;
+	tfCache_.push_back(tf);
+
+	return H;
+}
+
+void ophWRP::propagateMWRP(Complex<Real>* out, uint ch)
+{
+	auto begin = CUR_TIME;
+
+	const int pnX = context_.pixel_number[_X];
+	const int pnY = context_.pixel_number[_Y];
+	const int Nx = pnX * 2;
+	const int Ny = pnY * 2;
+	const int N = Nx * Ny;
+	const Real lambda = context_.wave_length[ch];
+	const Real hologram = wrp_config_.wrp_location + wrp_config_.propagation_distance;
+	const int wrp_num = (int)mwrp_loc_.size();
+
+	Complex<Real>* buf = (Complex<Real>*)fftw_malloc(sizeof(fftw_complex) * N);
+	Complex<Real>* acc = (Complex<Real>*)fftw_malloc(sizeof(fftw_complex) * N);
+	memset(acc, 0, sizeof(fftw_complex) * N);
+
+	fftw_plan fwd = fftw_plan_dft_2d(Ny, Nx, (fftw_complex*)buf, (fftw_complex*)buf, OPH_FORWARD, OPH_ESTIMATE);
+	fftw_plan bwd = fftw_plan_dft_2d(Ny, Nx, (fftw_complex*)acc, (fftw_complex*)acc, OPH_BACKWARD, OPH_ESTIMATE);
+
+	// the spectra of all planes are summed, then transformed back once
+	for (int p = 0; p < wrp_num; p++) {
+		const Complex<Real>* H = getTransferFunc(hologram - mwrp_loc_[p], lambda);
+		const Complex<Real>* wrp = p_mwrp_[p];
+
+		memset(buf, 0, sizeof(fftw_complex) * N);
+		int y;
+#ifdef _OPENMP
+#pragma omp parallel for private(y)
+#endif
+		for (y = 0; y < pnY; y++) {
+			Complex<Real>* dst = buf + ((y - pnY / 2 + Ny) % Ny) * Nx;
+			for (int x = 0; x < pnX; x++) {
+				dst[(x - pnX / 2 + Nx) % Nx] = wrp[y * pnX + x];
+			}
+		}
+
+		fftw_execute(fwd);
+
+		int i;
+#ifdef _OPENMP
+#pragma omp parallel for private(i)
+#endif
+		for (i = 0; i < N; i++) {
+			acc[i] += buf[i] * H[i];
+		}
 	}
 
-	return wrp_list;
+	fftw_execute(bwd);
+
+	int y;
+#ifdef _OPENMP
+#pragma omp parallel for private(y)
+#endif
+	for (y = 0; y < pnY; y++) {
+		const Complex<Real>* src = acc + ((y - pnY / 2 + Ny) % Ny) * Nx;
+		for (int x = 0; x < pnX; x++) {
+			out[y * pnX + x] = src[(x - pnX / 2 + Nx) % Nx];
+		}
+	}
+
+	fftw_destroy_plan(fwd);
+	fftw_destroy_plan(bwd);
+	fftw_free(buf);
+	fftw_free(acc);
+
+	auto end = CUR_TIME;
+	LOG("\n%s : %lf(s)\n\n",
+		__FUNCTION__,
+		((chrono::duration<Real>)(end - begin)).count());
+}
+
+void ophWRP::releaseMWRP(void)
+{
+	if (p_mwrp_) {
+		for (size_t p = 0; p < mwrp_loc_.size(); p++)
+			delete[] p_mwrp_[p];
+		delete[] p_mwrp_;
+		p_mwrp_ = nullptr;
+	}
+	mwrp_loc_.clear();
+}
+
+void ophWRP::releaseTransferFunc(void)
+{
+	for (size_t i = 0; i < tfCache_.size(); i++)
+		delete[] tfCache_[i].H;
+	tfCache_.clear();
 }
 
 void ophWRP::ophFree(void)
@@ -511,6 +918,8 @@ void ophWRP::ophFree(void)
 		delete[] obj_.color;
 		obj_.color = nullptr;
 	}
+	releaseMWRP();
+	releaseTransferFunc();
 }
 
 void ophWRP::transVW(Real* dst, Real* src, int size)
@@ -183,6 +183,17 @@ public:
 	void setPrecision(bool bPrecision) { bSinglePrecision = bPrecision; }
 	bool getPrecision() { return bSinglePrecision; }
 
+	/**
+	* @brief Function for setting the depth-quantized patch cache of the CPU WRP recording
+	* @details Points whose distance to the WRP falls into the same depth bin share one precomputed sub-hologram patch,
+	*          so each point is recorded as a patch scaled by its amplitude and shifted to its position.
+	* @param[in] is_PatchCache the value for specifying whether the patch cache is used
+	* @param[in] binWidth width of a depth bin. If 0, (wave length / 16) of each channel is used.
+	* @param[in] subPixel number of sub-pixel positions per axis. If 1, points are snapped to the pixel grid as in the direct method.
+	*/
+	void setPatchCache(bool is_PatchCache, Real binWidth = 0, int subPixel = 1);
+	bool getPatchCache() { return is_PatchCache; }
+
 
 	double calculateWRPCPU(void);
 	double calculateWRPGPU(void);
@@ -196,9 +207,17 @@ public:
 	void generateHologram(void);
 	/**
 	* @brief Generate multiple wavefront recording planes, main funtion.
-	* @return multiple WRP (sec)
+	* @details The depth range of the scaled points is divided into num_wrp slabs,
+	*          and the points of each slab are recorded to the plane in front of it.
+	*          The nearest plane is located at LocationOfWRP, and the others keep the same gap to their slabs.
+	*          The planes are recorded in parallel, each to its own buffer.
+	* @param[in] ch index of the color channel
+	* @return Type: <B>Complex<Real>**</B>\n
+	*				num_wrp WRP buffers, owned by this object and valid until the next call.\n
+	*				If the points are not scaled yet, the return value is <B>nullptr</B>.
 	*/
-	Complex<Real>** calculateMWRP(void);
+	Complex<Real>** calculateMWRP(uint ch = 0);
+	const vector<Real>& getMWRPLocation(void) { return mwrp_loc_; }
 
 	inline Complex<Real>* getWRPBuff(void) { return p_wrp_; };
 
@@ -225,6 +244,46 @@ private:
 	void addPixel2WRP(int x, int y, oph::Complex<Real> temp);
 	void addPixel2WRP(int x, int y, oph::Complex<Real> temp, oph::Complex<Real>* wrp);
 
+	/**
+	* @brief Record the points to the WRP with the depth-quantized patch cache
+	* @param[out] wrp WRP buffer
+	* @param[in] wrp_d location of the WRP
+	* @param[in] ch index of the color channel
+	* @param[in] pts indices of the points to record. If nullptr, the first nPts points are recorded.
+	* @param[in] nPts number of the points to record
+	*/
+	void recordWRPPatch(Complex<Real>* wrp, Real wrp_d, uint ch, const int* pts, int nPts);
+
+	/**
+	* @brief Record the points to the WRP directly, without atomic operations
+	* @param[out] wrp WRP buffer owned by the calling thread
+	* @param[in] wrp_d location of the WRP
+	* @param[in] ch index of the color channel
+	* @param[in] pts indices of the points to record. If nullptr, the first nPts points are recorded.
+	* @param[in] nPts number of the points to record
+	*/
+	void recordWRPDirect(Complex<Real>* wrp, Real wrp_d, uint ch, const int* pts, int nPts);
+
+	/**
+	* @brief Propagate the multiple WRPs to the hologram plane and sum them
+	* @details The spectra of the planes are summed with the cached transfer functions, and transformed back once.
+	* @param[out] out hologram buffer
+	* @param[in] ch index of the color channel
+	*/
+	void propagateMWRP(Complex<Real>* out, uint ch);
+
+	/**
+	* @brief Get the angular spectrum transfer function of a propagation distance, computed once and cached
+	* @param[in] distance propagation distance
+	* @param[in] lambda wave length
+	* @return Type: <B>const Complex<Real>*</B>\n
+	*				transfer function of (pixel_number * 2) size in the FFT order.
+	*/
+	const Complex<Real>* getTransferFunc(Real distance, Real lambda);
+
+	void releaseMWRP(void);
+	void releaseTransferFunc(void);
+
 	virtual void ophFree(void);
 	inline Real transVW(Real pt) {
 		Real fieldLens = this->getFieldLens();
@@ -237,15 +296,31 @@ protected:
 	int n_points;                 ///< numbers of points
 
 	Complex<Real>* p_wrp_;   ///< wrp buffer - complex type
+	Complex<Real>** p_mwrp_; ///< multiple wrp buffers - complex type
+	vector<Real> mwrp_loc_;  ///< locations of the multiple wrp
 
 	OphPointCloudData obj_;       ///< Input Pointcloud Data
 	Real *scaledVertex;
 	OphWRPConfig wrp_config_;      ///< structure variable for WRP hologram configuration
 
+	virtual void serializeConfig(OphConfigArchive& ar) { ar & wrp_config_; }
+
 private:
 	bool is_ViewingWindow;
 	bool is_CPU;
 	bool bSinglePrecision;
+	bool is_PatchCache;
+	Real patchBin;                ///< width of a depth bin of the patch cache
+	int patchSub;                 ///< sub-pixel positions per axis of the patch cache
+
+	struct TransferFunc {
+		Real distance;
+		Real lambda;
+		Complex<Real>* H;
+	};
+	vector<TransferFunc> tfCache_; ///< cached transfer functions of the multiple wrp
+	ivec2 tfSize_;                 ///< size of the cached transfer functions
+	vec2 tfPitch_;                 ///< pixel pitch of the cached transfer functions
 	Real zmax_;
 	uint m_nProgress;
 
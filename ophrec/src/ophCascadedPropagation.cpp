@@ -177,6 +177,8 @@ void ophCascadedPropagation::deallocateMem()
 
 	for (oph::uint i = 0; i < getNumColors(); i++)
 		delete[] complex_H[i];
+
+	releaseMasks();
 }
 
 // read in hologram data
@@ -397,44 +399,184 @@ bool ophCascadedPropagation::readConfig(const wchar_t* fname)
 	return true;
 }
 
-bool ophCascadedPropagation::propagateSlmToPupil()
+void ophCascadedPropagation::prepareMasks()
 {
-	auto start_time = CUR_TIME;
 	oph::uint numColors = getNumColors();
 	oph::uint nx = getResX();
 	oph::uint ny = getResY();
-	oph::Complex<Real>* buf = new oph::Complex<Real>[nx * ny];
+	Real f = getFieldLensFocalLength();
+	Real dObj = getDistObjectToPupil();
+	Real dRet = getDistPupilToRetina();
+	Real diameter = getPupilDiameter();
+	Real dx = getPixelPitchX();
+	Real f_eye = (f - dObj) * dRet / (f - dObj + dRet);
+
+	// entries of colors that are no longer used own a plan and FFT buffers
+	for (size_t i = numColors; i < masks.size(); i++)
+	{
+		if (masks[i].plan) fftw_destroy_plan(masks[i].plan);
+		if (masks[i].fft_in) fftw_free(masks[i].fft_in);
+		if (masks[i].fft_out) fftw_free(masks[i].fft_out);
+	}
+	masks.resize(numColors);
+
+	// with several colors the plans run concurrently from the color loop, so each one is single-threaded
+	int nPlannerThreads = setFFTWPlannerThreads(1);
+	int nPlanThreads = (numColors > 1) ? 1 : nPlannerThreads;
+	setFFTWPlannerThreads(nPlanThreads);
+
 	for (oph::uint color = 0; color < numColors; color++)
 	{
-		fftwShift(getSlmWavefield(color), buf, nx, ny, OPH_FORWARD, false);
+		OphCascadedPropagationMask& m = masks[color];
+		Real lambda = getWavelengths()[color];
+		bool sizeChanged = (m.nx != nx) || (m.ny != ny);
+		if (sizeChanged || !m.plan || m.plan_threads != nPlanThreads)
+		{
+			if (m.plan) fftw_destroy_plan(m.plan);
+			if (sizeChanged || !m.fft_in)
+			{
+				if (m.fft_in) fftw_free(m.fft_in);
+				if (m.fft_out) fftw_free(m.fft_out);
+				m.fft_in = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * nx * ny);
+				m.fft_out = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * nx * ny);
+			}
+			m.plan = fftw_plan_dft_2d(ny, nx, m.fft_in, m.fft_out, OPH_FORWARD, OPH_ESTIMATE);
+			m.plan_threads = nPlanThreads;
+		}
+
+		if (!sizeChanged && m.wavelength == lambda && m.field_lens_focal_length == f &&
+			m.dist_reconstruction_plane_to_pupil == dObj && m.dist_pupil_to_retina == dRet &&
+			m.pupil_diameter == diameter && m.dx == dx)
+			continue;
 
-		Real k = 2 * M_PI / getWavelengths()[color];
-		Real vw = getWavelengths()[color] * getFieldLensFocalLength() / getPixelPitchX();
+		Real k = 2 * M_PI / lambda;
+		Real vw = lambda * f / dx;
 		Real dx1 = vw / (Real)nx;
 		Real dy1 = vw / (Real)ny;
+
+		// exp(j * a * (X1^2 + Y1^2)) = exp(j * a * X1^2) * exp(j * a * Y1^2)
+		Real aPupil = k / 2 / f - k / 2 / f_eye;
+		Real aRetina = k / 2 / dRet;
+		oph::Complex<Real> t2(0, lambda * f);
+		m.pupil_row.resize(ny);
+		m.retina_row.resize(ny);
 		for (oph::uint row = 0; row < ny; row++)
 		{
 			Real Y1 = ((Real)row - ((Real)ny - 1) * 0.5f) * dy1;
+			m.pupil_row[row] = oph::Complex<Real>(0, aPupil * Y1 * Y1).exp() / t2;
+			m.retina_row[row] = oph::Complex<Real>(0, aRetina * Y1 * Y1).exp();
+		}
+		m.pupil_col.resize(nx);
+		m.retina_col.resize(nx);
+		for (oph::uint col = 0; col < nx; col++)
+		{
+			Real X1 = ((Real)col - ((Real)nx - 1) * 0.5f) * dx1;
+			m.pupil_col[col] = oph::Complex<Real>(0, aPupil * X1 * X1).exp();
+			m.retina_col[col] = oph::Complex<Real>(0, aRetina * X1 * X1).exp();
+		}
+
+		// the aperture is convex, so it covers one run of columns per row; the lower half is blocked
+		m.aperture_begin.assign(ny, 0);
+		m.aperture_end.assign(ny, 0);
+		for (oph::uint row = 0; row + 1 < ny / 2; row++)
+		{
+			Real Y1 = ((Real)row - ((Real)ny - 1) * 0.5f) * dy1;
+			int begin = -1, end = -1;
 			for (oph::uint col = 0; col < nx; col++)
 			{
 				Real X1 = ((Real)col - ((Real)nx - 1) * 0.5f) * dx1;
+				if (sqrt(X1 * X1 + Y1 * Y1) < diameter / 2)
+				{
+					if (begin < 0) begin = col;
+					end = col + 1;
+				}
+			}
+			if (begin >= 0)
+			{
+				m.aperture_begin[row] = begin;
+				m.aperture_end[row] = end;
+			}
+		}
 
-				// 1st propagation
-				oph::Complex<Real> t1 = oph::Complex<Real>(0, k / 2 / getFieldLensFocalLength() * (X1 * X1 + Y1 * Y1)).exp();
-				oph::Complex<Real> t2(0, getWavelengths()[color] * getFieldLensFocalLength());
-				buf[row * nx + col] = t1 / t2 * buf[row * nx + col];
+		m.wavelength = lambda;
+		m.field_lens_focal_length = f;
+		m.dist_reconstruction_plane_to_pupil = dObj;
+		m.dist_pupil_to_retina = dRet;
+		m.pupil_diameter = diameter;
+		m.dx = dx;
+		m.nx = nx;
+		m.ny = ny;
+	}
 
-				// applying aperture: need some optimization later
-				if ((sqrt(X1 * X1 + Y1 * Y1) >= getPupilDiameter() / 2) || (row >= ny / 2 - 1))
-					buf[row * nx + col] = 0;
+	setFFTWPlannerThreads(nPlannerThreads);
+}
 
-				Real f_eye = (getFieldLensFocalLength() - getDistObjectToPupil()) * getDistPupilToRetina() / (getFieldLensFocalLength() - getDistObjectToPupil() + getDistPupilToRetina());
-				oph::Complex<Real> t3 = oph::Complex<Real>(0, -k / 2 / f_eye * (X1 * X1 + Y1 * Y1)).exp();
-				buf[row * nx + col] *= t3;
-			}
+void ophCascadedPropagation::releaseMasks()
+{
+	for (auto& m : masks)
+	{
+		if (m.plan) fftw_destroy_plan(m.plan);
+		if (m.fft_in) fftw_free(m.fft_in);
+		if (m.fft_out) fftw_free(m.fft_out);
+	}
+	masks.clear();
+}
+
+bool ophCascadedPropagation::propagateSlmToPupil()
+{
+	auto start_time = CUR_TIME;
+	int numColors = (int)getNumColors();
+	int nx = (int)getResX();
+	int ny = (int)getResY();
+	int hnx = nx / 2;
+	int hny = ny / 2;
+
+	prepareMasks();
+
+	int color;
+#ifdef _OPENMP
+#pragma omp parallel for private(color) if (numColors > 1)
+#endif
+	for (color = 0; color < numColors; color++)
+	{
+		OphCascadedPropagationMask& m = masks[color];
+		const oph::Complex<Real>* src = getSlmWavefield(color);
+		oph::Complex<Real>* in = (oph::Complex<Real>*)m.fft_in;
+		const oph::Complex<Real>* out = (const oph::Complex<Real>*)m.fft_out;
+		oph::Complex<Real>* dst = getPupilWavefield(color);
+		int row;
+
+		// fftShift into the FFT input
+#ifdef _OPENMP
+#pragma omp parallel for private(row)
+#endif
+		for (row = 0; row < ny; row++)
+		{
+			const oph::Complex<Real>* srcRow = src + ((row + hny) % ny) * nx;
+			oph::Complex<Real>* inRow = in + row * nx;
+			memcpy(inRow, srcRow + hnx, sizeof(oph::Complex<Real>) * (nx - hnx));
+			memcpy(inRow + nx - hnx, srcRow, sizeof(oph::Complex<Real>) * hnx);
 		}
 
-		memcpy(getPupilWavefield(color), buf, sizeof(oph::Complex<Real>) * nx * ny);
+		fftw_execute(m.plan);
+
+		// fftShift back, fused with the field lens / eye lens phase and the pupil aperture
+#ifdef _OPENMP
+#pragma omp parallel for private(row)
+#endif
+		for (row = 0; row < ny; row++)
+		{
+			const oph::Complex<Real>* outRow = out + ((row + hny) % ny) * nx;
+			oph::Complex<Real>* dstRow = dst + row * nx;
+			int begin = m.aperture_begin[row];
+			int end = m.aperture_end[row];
+			memset(dstRow, 0, sizeof(oph::Complex<Real>) * nx);
+			for (int col = begin; col < end; col++)
+			{
+				int sc = col + hnx; if (sc >= nx) sc -= nx;
+				dstRow[col] = outRow[sc] * (m.pupil_row[row] * m.pupil_col[col]);
+			}
+		}
 	}
 
 	auto end_time = CUR_TIME;
@@ -443,39 +585,61 @@ bool ophCascadedPropagation::propagateSlmToPupil()
 
 	LOG("SLM to Pupil propagation - Implement time : %.5lf sec\n", during_time);
 
-	delete[] buf;
 	return true;
 }
 
 bool ophCascadedPropagation::propagatePupilToRetina()
 {
 	auto start_time = CUR_TIME;
-	oph::uint numColors = getNumColors();
-	oph::uint nx = getResX();
-	oph::uint ny = getResY();
-	oph::Complex<Real>* buf = new oph::Complex<Real>[nx * ny];
-	for (oph::uint color = 0; color < numColors; color++)
+	int numColors = (int)getNumColors();
+	int nx = (int)getResX();
+	int ny = (int)getResY();
+	int hnx = nx / 2;
+	int hny = ny / 2;
+
+	prepareMasks();
+
+	int color;
+#ifdef _OPENMP
+#pragma omp parallel for private(color) if (numColors > 1)
+#endif
+	for (color = 0; color < numColors; color++)
 	{
-		memcpy(buf, getPupilWavefield(color), sizeof(oph::Complex<Real>) * nx * ny);
-
-		Real k = 2 * M_PI / getWavelengths()[color];
-		Real vw = getWavelengths()[color] * getFieldLensFocalLength() / getPixelPitchX();
-		Real dx1 = vw / (Real)nx;
-		Real dy1 = vw / (Real)ny;
-		for (oph::uint row = 0; row < ny; row++)
+		OphCascadedPropagationMask& m = masks[color];
+		const oph::Complex<Real>* src = getPupilWavefield(color);
+		oph::Complex<Real>* in = (oph::Complex<Real>*)m.fft_in;
+		const oph::Complex<Real>* out = (const oph::Complex<Real>*)m.fft_out;
+		oph::Complex<Real>* dst = getRetinaWavefield(color);
+		int row;
+
+		// 2nd propagation phase, fused with the fftShift into the FFT input
+#ifdef _OPENMP
+#pragma omp parallel for private(row)
+#endif
+		for (row = 0; row < ny; row++)
 		{
-			Real Y1 = ((Real)row - ((Real)ny - 1) * 0.5f) * dy1;
-			for (oph::uint col = 0; col < nx; col++)
+			int sr = (row + hny) % ny;
+			const oph::Complex<Real>* srcRow = src + sr * nx;
+			oph::Complex<Real>* inRow = in + row * nx;
+			for (int col = 0; col < nx; col++)
 			{
-				Real X1 = ((Real)col - ((Real)nx - 1) * 0.5f) * dx1;
-
-				// 2nd propagation
-				oph::Complex<Real> t1 = oph::Complex<Real>(0, k / 2 / getDistPupilToRetina() * (X1 * X1 + Y1 * Y1)).exp();
-				buf[row * nx + col] *= t1;
+				int sc = col + hnx; if (sc >= nx) sc -= nx;
+				inRow[col] = srcRow[sc] * (m.retina_row[sr] * m.retina_col[sc]);
 			}
 		}
 
-		fftwShift(buf, getRetinaWavefield(color), nx, ny, OPH_FORWARD, false);
+		fftw_execute(m.plan);
+
+#ifdef _OPENMP
+#pragma omp parallel for private(row)
+#endif
+		for (row = 0; row < ny; row++)
+		{
+			const oph::Complex<Real>* outRow = out + ((row + hny) % ny) * nx;
+			oph::Complex<Real>* dstRow = dst + row * nx;
+			memcpy(dstRow, outRow + hnx, sizeof(oph::Complex<Real>) * (nx - hnx));
+			memcpy(dstRow + nx - hnx, outRow, sizeof(oph::Complex<Real>) * hnx);
+		}
 	}
 
 	auto end_time = CUR_TIME;
@@ -484,7 +648,6 @@ bool ophCascadedPropagation::propagatePupilToRetina()
 
 	LOG("Pupil to Retina propagation - Implement time : %.5lf sec\n", during_time);
 
-	delete[] buf;
 	return true;
 }
 
@@ -121,6 +121,71 @@ struct OphCascadedPropagationConfig {
 	Real nor;
 };
 
+/**
+* @brief Per-color propagation masks and FFT resources of ophCascadedPropagation
+* @details The lens and eye-lens phases are quadratic in X and Y, so each mask is stored as a row factor and a column factor.
+*          The pupil aperture is stored as a [begin, end) column span per row.
+*          The masks are rebuilt only when the wavelength or the geometry they were built for changes.
+*/
+struct OphCascadedPropagationMask {
+	OphCascadedPropagationMask()
+		: wavelength(0.0),
+		field_lens_focal_length(0.0),
+		dist_reconstruction_plane_to_pupil(0.0),
+		dist_pupil_to_retina(0.0),
+		pupil_diameter(0.0),
+		dx(0.0),
+		nx(0),
+		ny(0),
+		fft_in(nullptr),
+		fft_out(nullptr),
+		plan(nullptr),
+		plan_threads(0)
+		{}
+
+	/**
+	* @param geometry the masks were built for
+	*/
+	Real wavelength;
+	Real field_lens_focal_length;
+	Real dist_reconstruction_plane_to_pupil;
+	Real dist_pupil_to_retina;
+	Real pupil_diameter;
+	Real dx;
+	oph::uint nx;
+	oph::uint ny;
+
+	/**
+	* @param pupil_row, pupil_col: field lens and eye lens phase at the pupil plane, including 1 / (j * lambda * f)
+	*/
+	vector<oph::Complex<Real>> pupil_row;
+	vector<oph::Complex<Real>> pupil_col;
+
+	/**
+	* @param retina_row, retina_col: quadratic phase of the propagation from pupil to retina
+	*/
+	vector<oph::Complex<Real>> retina_row;
+	vector<oph::Complex<Real>> retina_col;
+
+	/**
+	* @param aperture_begin, aperture_end: columns inside the pupil aperture for each row
+	*/
+	vector<int> aperture_begin;
+	vector<int> aperture_end;
+
+	/**
+	* @param fft_in, fft_out, plan: forward 2D FFT planned once for this color
+	*/
+	fftw_complex* fft_in;
+	fftw_complex* fft_out;
+	fftw_plan plan;
+
+	/**
+	* @param plan_threads: number of threads the plan was created with
+	*/
+	int plan_threads;
+};
+
 /**
 * @addtogroup casprop
 //@{
@@ -228,6 +293,11 @@ class RECON_DLL ophCascadedPropagation : public ophRec {
 		*/
 		vector<oph::Complex<Real>*> wavefield_retina;
 
+		/**
+		* @param masks: cached propagation masks and FFT plans, one per color
+		*/
+		vector<OphCascadedPropagationMask> masks;
+
 		/**
 		* @param ready_to_propagate: indicates if configurations and input wavefield are all loaded succesfully
 		*/
@@ -273,6 +343,16 @@ class RECON_DLL ophCascadedPropagation : public ophRec {
 		*/
 		oph::uchar* getIntensityfields(vector<oph::Complex<Real>*> wavefields);
 
+		/**
+		* @brief Builds the propagation masks and FFT plan of each color if the geometry changed since the last call
+		*/
+		void prepareMasks();
+
+		/**
+		* @brief Releases the cached masks and FFT plans
+		*/
+		void releaseMasks();
+
 
 	public:
 		/**
@@ -361,6 +441,21 @@ class RECON_DLL ophCascadedPropagation : public ophRec {
 		//virtual bool SetSlmWavefield(Complex<Real>* srcHologram) = 0; // set input wavefield (for later use)
 		//virtual bool SetSlmWavefield(ophGen& srcHologram) = 0; // set input wavefield (for later use)
 
+		/**
+		* @brief Sets distance from reconstruction plane to pupil plane in meter
+		*/
+		void setDistObjectToPupil(Real dist) { config_.dist_reconstruction_plane_to_pupil = dist; }
+
+		/**
+		* @brief Sets distance from pupil plane to retina plane in meter
+		*/
+		void setDistPupilToRetina(Real dist) { config_.dist_pupil_to_retina = dist; }
+
+		/**
+		* @brief Sets diameter of pupil in meter
+		*/
+		void setPupilDiameter(Real diameter) { config_.pupil_diameter = diameter; }
+
 		/**
 		* @brief Calculates 1st propagation (from SLM plane to pupil plane)
 		* @return true if successful
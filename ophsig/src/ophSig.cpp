@@ -45,6 +45,14 @@
 
 #include "ophSig.h"
 #include "include.h"
+#include <thread>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 
 ophSig::ophSig(void)
@@ -54,6 +62,12 @@ ophSig::ophSig(void)
 	//, _radius(0)
 {
 	_foc = new Real_t[3];
+	_sfSearch = SF_SEARCH_GRID;
+	fwd_plan = nullptr;
+	bwd_plan = nullptr;
+	_planSize = ivec2(0, 0);
+	ComplexH = nullptr;
+	_wavelength_num = 0;
 }
 void ophSig::cField2Buffer(matrix<Complex<Real>>& src, Complex<Real> **dst,int nx,int ny) {
 	ivec2 bufferSize(nx, ny); //= src.getSize();
@@ -92,22 +106,51 @@ template<typename T>
 void ophSig::linInterp(vector<T> &X, matrix<Complex<T>> &src, vector<T> &Xq, matrix<Complex<T>> &dst)
 {
 	if (src.size != dst.size) {
-		dst.resize(src.size[_X], src.size[_Y]);
+		dst.resizeNoInit(src.size[_X], src.size[_Y]);
 	}
-	int size = src.size[_Y];
 
-	for (int i = 0, j = 0; j < dst.size[_Y]; j++)
+	for (int r = 0; r < src.size[_X]; r++)
 	{
-		if ((Xq[j]) >= (X[size - 2]))
-		{
-			i = size - 2;
-		}
-		else
+		linInterp(X.data(), src[r], src.size[_Y], Xq.data(), dst[r], dst.size[_Y]);
+	}
+}
+
+template<typename T>
+void ophSig::linInterp(const T *X, const Complex<T> *src, int n, const T *Xq, Complex<T> *dst, int m)
+{
+	if (n < 2) {
+		for (int j = 0; j < m; j++) dst[j] = (n == 1) ? src[0] : Complex<T>(0, 0);
+		return;
+	}
+
+	bool sorted = true;
+	for (int j = 1; (j < m) & sorted; j++) sorted = (Xq[j] >= Xq[j - 1]);
+
+	// each block locates its first query by binary search, then walks forward
+	const int block = 4096;
+	const int nBlock = (m + block - 1) / block;
+	int b;
+#ifdef _OPENMP
+#pragma omp parallel for private(b) if (nBlock > 1)
+#endif
+	for (b = 0; b < nBlock; b++)
+	{
+		const int jEnd = (b + 1) * block < m ? (b + 1) * block : m;
+		int i = -1;	// X[i] < Xq[j] <= X[i + 1]
+		for (int j = b * block; j < jEnd; j++)
 		{
-			while ((Xq[j]) >(X[i + 1])) i++;
+			if (!sorted || j == b * block)
+				i = (int)(std::lower_bound(X, X + n, Xq[j]) - X) - 1;
+			else
+				while ((i < n - 1) && (X[i + 1] < Xq[j])) i++;
+
+			// the end intervals are extended for queries outside the samples
+			const int k = (i < 0) ? 0 : ((i > n - 2) ? n - 2 : i);
+			const T w = (Xq[j] - X[k]);
+			const T dx = (X[k + 1] - X[k]);
+			dst[j]._Val[_RE] = src[k]._Val[_RE] + (src[k + 1]._Val[_RE] - src[k]._Val[_RE]) / dx * w;
+			dst[j]._Val[_IM] = src[k]._Val[_IM] + (src[k + 1]._Val[_IM] - src[k]._Val[_IM]) / dx * w;
 		}
-		dst(0, j)._Val[_RE] = src(0, i).real() + (src(0, i + 1).real() - src(0, i).real()) / (X[i + 1] - X[i]) * (Xq[j] - X[i]);
-		dst(0, j)._Val[_IM] = src(0, i).imag() + (src(0, i + 1).imag() - src(0, i).imag()) / (X[i + 1] - X[i]) * (Xq[j] - X[i]);
 	}
 }
 
@@ -115,7 +158,7 @@ template<typename T>
 void ophSig::fft1(matrix<Complex<T>> &src, matrix<Complex<T>> &dst, int sign, uint flag)
 {
 	if (src.size != dst.size) {
-		dst.resize(src.size[_X], src.size[_Y]);
+		dst.resizeNoInit(src.size[_X], src.size[_Y]);
 	}
 	fftw_complex *fft_in = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * src.size[_Y]);
 	fftw_complex *fft_out = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * src.size[_Y]);
@@ -125,7 +168,12 @@ void ophSig::fft1(matrix<Complex<T>> &src, matrix<Complex<T>> &dst, int sign, ui
 		fft_in[i][_IM] = src(0, i).imag();
 	}
 
-	fftw_plan plan = fftw_plan_dft_1d(src.size[_Y], fft_in, fft_out, sign, flag);
+	// the FFTW planner is not thread safe, fft1/fft2 may be called from parallel regions
+	fftw_plan plan;
+#ifdef _OPENMP
+#pragma omp critical(fftw_planner)
+#endif
+	plan = fftw_plan_dft_1d(src.size[_Y], fft_in, fft_out, sign, flag);
 
 	fftw_execute(plan);
 	if (sign == OPH_FORWARD)
@@ -143,6 +191,9 @@ void ophSig::fft1(matrix<Complex<T>> &src, matrix<Complex<T>> &dst, int sign, ui
 		}
 	}
 
+#ifdef _OPENMP
+#pragma omp critical(fftw_planner)
+#endif
 	fftw_destroy_plan(plan);
 	fftw_free(fft_in);
 	fftw_free(fft_out);
@@ -151,7 +202,7 @@ template<typename T>
 void ophSig::fft2(matrix<Complex<T>> &src, matrix<Complex<T>> &dst, int sign, uint flag)
 {
 	if (src.size != dst.size) {
-		dst.resize(src.size[_X], src.size[_Y]);
+		dst.resizeNoInit(src.size[_X], src.size[_Y]);
 	}
 
 	fftw_complex *fft_in = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * src.size[_X] * src.size[_Y]);
@@ -164,7 +215,11 @@ void ophSig::fft2(matrix<Complex<T>> &src, matrix<Complex<T>> &dst, int sign, ui
 		}
 	}
 
-	fftw_plan plan = fftw_plan_dft_2d(src.size[_X], src.size[_Y], fft_in, fft_out, sign, flag);
+	fftw_plan plan;
+#ifdef _OPENMP
+#pragma omp critical(fftw_planner)
+#endif
+	plan = fftw_plan_dft_2d(src.size[_X], src.size[_Y], fft_in, fft_out, sign, flag);
 
 	fftw_execute(plan);
 	if (sign == OPH_FORWARD)
@@ -187,11 +242,41 @@ void ophSig::fft2(matrix<Complex<T>> &src, matrix<Complex<T>> &dst, int sign, ui
 		}
 	}
 
+#ifdef _OPENMP
+#pragma omp critical(fftw_planner)
+#endif
 	fftw_destroy_plan(plan);
 	fftw_free(fft_in);
 	fftw_free(fft_out);
 }
 
+void ophSig::prepareFFT2(int nx, int ny)
+{
+	if (fwd_plan && _planSize[_X] == nx && _planSize[_Y] == ny) return;
+
+	// the buffer is only used for planning, the plans run on the fields through fftw_execute_dft
+	fftw_complex *buf = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * nx * ny);
+#ifdef _OPENMP
+#pragma omp critical(fftw_planner)
+#endif
+	{
+		if (fwd_plan) fftw_destroy_plan(fwd_plan);
+		if (bwd_plan) fftw_destroy_plan(bwd_plan);
+		fwd_plan = fftw_plan_dft_2d(nx, ny, buf, buf, OPH_FORWARD, OPH_ESTIMATE);
+		bwd_plan = fftw_plan_dft_2d(nx, ny, buf, buf, OPH_BACKWARD, OPH_ESTIMATE);
+	}
+	fftw_free(buf);
+	_planSize = ivec2(nx, ny);
+}
+
+void ophSig::fft2InPlace(OphComplexField &field, int sign)
+{
+	prepareFFT2(field.size[_X], field.size[_Y]);
+
+	fftw_complex *data = reinterpret_cast<fftw_complex*>(field.data());
+	fftw_execute_dft(sign == OPH_FORWARD ? fwd_plan : bwd_plan, data, data);
+}
+
 
 
 
@@ -226,6 +311,33 @@ bool ophSig::loadAsOhc(const char *fname)
 	return true;
 }
 */
+bool ophSig::loadAsOhcRegion(const char *fname, const ivec2 origin, const ivec2 size)
+{
+	if (!Openholo::loadAsOhcRegion(fname, origin, size)) return false;
+
+	const int nWave = context_.waveNum;
+	if (ComplexH == nullptr || _wavelength_num != nWave) {
+		delete[] ComplexH;
+		ComplexH = new OphComplexField[nWave];
+		_wavelength_num = nWave;
+	}
+
+	// channels are kept in the reverse order of the file, as saveAsOhc writes them
+	for (int i = 0; i < nWave / 2; i++)
+	{
+		Real w = context_.wave_length[i];
+		context_.wave_length[i] = context_.wave_length[(nWave - 1) - i];
+		context_.wave_length[(nWave - 1) - i] = w;
+	}
+	for (int i = 0; i < nWave; i++)
+	{
+		// the region is x-major like the file, which is also the storage order of ComplexH
+		ComplexH[i].resizeNoInit(size[_X], size[_Y]);
+		memcpy(ComplexH[i].data(), complex_H[(nWave - 1) - i], sizeof(Complex<Real>) * ComplexH[i].numel());
+	}
+	return true;
+}
+
 bool ophSig::saveAsOhc(const char *fname)
 {
 	std::string fullname = fname;
@@ -356,13 +468,13 @@ bool ophSig::load(const char *real, const char *imag)
 	{
 		meanOfMat(realMat[z], realout); meanOfMat(imagMat[z], imagout);
 		
-		realMat[z] / realout; imagMat[z] / imagout;
+		realMat[z] /= realout; imagMat[z] /= imagout;
 		absMat(realMat[z], realMat[z]);
 		absMat(imagMat[z], imagMat[z]);
 		realout = maxOfMat(realMat[z]); imagout = maxOfMat(imagMat[z]);
-		realMat[z] / realout; imagMat[z] / imagout;
+		realMat[z] /= realout; imagMat[z] /= imagout;
 		realout = minOfMat(realMat[z]); imagout = minOfMat(imagMat[z]);
-		realMat[z] - realout; imagMat[z] - imagout;
+		realMat[z] -= realout; imagMat[z] -= imagout;
 
 		ComplexH[z].resize(context_.pixel_number[_X], context_.pixel_number[_Y]);
 
@@ -501,14 +613,14 @@ bool ophSig::save(const char *real, const char *imag)
 			{
 				for (int j = 0; j < _width; j++)
 				{
-					if (ComplexH[0].mat[_height - i - 1][j]._Val[_RE] < 0)
+					if (ComplexH[0](_height - i - 1, j)._Val[_RE] < 0)
 					{
-						ComplexH[0].mat[_height - i - 1][j]._Val[_RE] = 0;
+						ComplexH[0](_height - i - 1, j)._Val[_RE] = 0;
 					}
 
-					if (ComplexH[0].mat[_height - i - 1][j]._Val[_IM] < 0)
+					if (ComplexH[0](_height - i - 1, j)._Val[_IM] < 0)
 					{
-						ComplexH[0].mat[_height - i - 1][j]._Val[_IM] = 0;
+						ComplexH[0](_height - i - 1, j)._Val[_IM] = 0;
 					}
 				}
 			}
@@ -837,6 +949,11 @@ bool ophSig::propagationHolo(float depth) {
 	return true;
 }
 
+void ophSig::setSFSearch(uint mode)
+{
+	_sfSearch = mode;
+}
+
 double ophSig::sigGetParamSF(float zMax, float zMin, int sampN, float th) {
 	auto start_time = CUR_TIME;
 	double out = 0;
@@ -862,42 +979,79 @@ bool ophSig::cvtOffaxis_CPU(Real angleX, Real angleY) {
 	
 	int nx = context_.pixel_number[_X];
 	int ny = context_.pixel_number[_Y];
-	OphRealField H1(nx,ny);
-	Real x, y;
-	Complex<Real> F;
-	H1.resize(nx, ny);
 
+	auto start_time = CUR_TIME;
+
+	// the carrier exp(jk(x sin(angleX) + y sin(angleY))) is the product of a row and a column factor
+	Real k = (2 * M_PI) / *context_.wave_length;
+	Real sinX = sin(angleX);
+	Real sinY = sin(angleY);
+	vector<Complex<Real>> Fy(nx);
+	vector<Complex<Real>> Fx(ny);
 	for (int i = 0; i < nx; i++)
 	{
-		y = (_cfgSig.height / (nx - 1)*i - _cfgSig.height / 2);
+		Real y = (_cfgSig.height / (nx - 1)*i - _cfgSig.height / 2);
+		Fy[i] = Complex<Real>(cos(k*y*sinY), sin(k*y*sinY));
+	}
+	for (int j = 0; j < ny; j++)
+	{
+		Real x = (_cfgSig.width / (ny - 1)*j - _cfgSig.width / 2);
+		Fx[j] = Complex<Real>(cos(k*x*sinX), sin(k*x*sinX));
+	}
+
+	auto kernel_time = CUR_TIME;
+
+	// real part of the modulated field, with the min / max of each row gathered in the same pass
+	vector<Real> rowMin(nx);
+	vector<Real> rowMax(nx);
+	int i;
+#ifdef _OPENMP
+#pragma omp parallel for private(i)
+#endif
+	for (i = 0; i < nx; i++)
+	{
+		Complex<Real>* row = (*ComplexH)[i];
+		Real lo = MAX_DOUBLE;
+		Real hi = -MAX_DOUBLE;
 		for (int j = 0; j < ny; j++)
 		{
-			x = (_cfgSig.width / (ny - 1)*j - _cfgSig.width / 2);
-
-			//(*ComplexH)(i, j)._Val[_RE] = cos(((2 * M_PI) / *context_.wave_length)*(x*sin(angle[_X]) + y *sin(angle[_Y])));
-			//(*ComplexH)(i, j)._Val[_IM] = sin(((2 * M_PI) / *context_.wave_length)*(x*sin(angle[_X]) + y *sin(angle[_Y])));
-			F._Val[_RE] = cos(((2 * M_PI) / *context_.wave_length)*(x*sin(angleX) + y *sin(angleY)));
-			F._Val[_IM] = sin(((2 * M_PI) / *context_.wave_length)*(x*sin(angleX) + y *sin(angleY)));
-			H1(i, j) = ((*ComplexH)(i, j) * F)._Val[_RE];
+			Complex<Real> F = Fy[i] * Fx[j];
+			Real h = (row[j] * F)._Val[_RE];
+			row[j]._Val[_RE] = h;
+			row[j]._Val[_IM] = 0;
+			lo = (h < lo) ? h : lo;
+			hi = (h > hi) ? h : hi;
 		}
+		rowMin[i] = lo;
+		rowMax[i] = hi;
 	}
-	double out = minOfMat(H1);
-	H1 - out;
-	out = maxOfMat(H1);
-	H1 / out;
-	//normalizeMat(H1, H1);
 
+	Real minH = MAX_DOUBLE;
+	Real maxH = -MAX_DOUBLE;
+	for (i = 0; i < nx; i++)
+	{
+		minH = (rowMin[i] < minH) ? rowMin[i] : minH;
+		maxH = (rowMax[i] > maxH) ? rowMax[i] : maxH;
+	}
 
-	for (int i = 0; i < nx; i++)
+	Real range = maxH - minH;
+#ifdef _OPENMP
+#pragma omp parallel for private(i)
+#endif
+	for (i = 0; i < nx; i++)
 	{
+		Complex<Real>* row = (*ComplexH)[i];
 		for (int j = 0; j < ny; j++)
 		{
-			(*ComplexH)(i, j)._Val[_RE] = H1(i, j);
-			(*ComplexH)(i, j)._Val[_IM] = 0;
+			row[j]._Val[_RE] = (row[j]._Val[_RE] - minH) / range;
 		}
 	}
 
-	
+	auto end_time = CUR_TIME;
+
+	LOG("sigConvertOffaxis : kernel %.5lf sec, transform %.5lf sec\n",
+		((std::chrono::duration<Real>)(kernel_time - start_time)).count(),
+		((std::chrono::duration<Real>)(end_time - kernel_time)).count());
 
 	return true;
 }
@@ -912,37 +1066,50 @@ bool ophSig::sigConvertHPO_CPU(Real depth, Real_t redRate) {
 	Real NA = _cfgSig.width/(2*depth);
 
 	int xshift = nx / 2;
-	int yshift = ny / 2;
-
-	Real  y;
 
 	Real_t NA_g = NA * redRate;
 
-	OphComplexField F1(nx, ny);
-	OphComplexField FH(nx, ny);
-
-
 	Real Rephase = -(1 / (4 * M_PI)*pow((wl / NA_g), 2));
 	Real Imphase = ((1 / (4 * M_PI))*depth*wl);
 
-	for (int i = 0; i < ny; i++)
+	auto start_time = CUR_TIME;
+
+	// the filter only varies along _X : one factor per fftshifted row,
+	// with the 1/(nx*ny) of the inverse FFT folded in
+	Real norm = 1.0 / ((Real)nx * ny);
+	vector<Complex<Real>> F1(nx);
+	for (int j = 0; j < nx; j++)
 	{
-		int ii = (i + yshift) % ny;
-		
-		for (int j = 0; j < nx; j++)
+		Real y = (2 * M_PI * (j) / _cfgSig.height - M_PI * (nx - 1) / _cfgSig.height);
+		Real y2 = y * y;
+		int jj = (j + xshift) % nx;
+		Real amp = std::exp(Rephase*y2) * norm;
+		F1[jj] = Complex<Real>(amp*cos(Imphase*y2), amp*sin(Imphase*y2));
+	}
+	prepareFFT2(nx, ny);
+
+	auto kernel_time = CUR_TIME;
+
+	fft2InPlace(*ComplexH, OPH_FORWARD);
+	int i;
+#ifdef _OPENMP
+#pragma omp parallel for private(i)
+#endif
+	for (i = 0; i < nx; i++)
+	{
+		Complex<Real>* row = (*ComplexH)[i];
+		for (int j = 0; j < ny; j++)
 		{
-			y = (2 * M_PI * (j) / _cfgSig.height - M_PI * (nx - 1) / _cfgSig.height);
-			int jj = (j + xshift) % nx;
-			F1(jj, ii)._Val[_RE] = std::exp(Rephase*pow(y, 2))*cos(Imphase*pow(y, 2));
-			F1(jj, ii)._Val[_IM] = std::exp(Rephase*pow(y, 2))*sin(Imphase*pow(y, 2));
+			row[j] *= F1[i];
 		}
 	}
-	fft2((*ComplexH), FH, OPH_FORWARD);
-	F1.mulElem(FH);
-	fft2(F1, (*ComplexH), OPH_BACKWARD);
+	fft2InPlace(*ComplexH, OPH_BACKWARD);
 
-	
+	auto end_time = CUR_TIME;
 
+	LOG("sigConvertHPO : kernel %.5lf sec, transform %.5lf sec\n",
+		((std::chrono::duration<Real>)(kernel_time - start_time)).count(),
+		((std::chrono::duration<Real>)(end_time - kernel_time)).count());
 
 	return true;
 
@@ -950,8 +1117,6 @@ bool ophSig::sigConvertHPO_CPU(Real depth, Real_t redRate) {
 
 bool ophSig::sigConvertCAC_CPU(double red, double green, double blue) {
 	
-	Real x, y;
-	//OphComplexField  exp, conj, FH_CAC;
 	int nx = context_.pixel_number[_X];
 	int ny = context_.pixel_number[_Y];
 
@@ -964,35 +1129,61 @@ bool ophSig::sigConvertCAC_CPU(double red, double green, double blue) {
 	context_.wave_length[0] = blue;
 	context_.wave_length[1] = green;
 	context_.wave_length[2] = red;
-	
-	OphComplexField FFZP(nx, ny);
-	OphComplexField FH(nx, ny);
-	
+
+	auto start_time = CUR_TIME;
+
+	// conj(exp(j sigmaf (x^2 + y^2))) is separable : per channel one factor per fftshifted row
+	// (carrying the 1/(nx*ny) of the inverse FFT) and one per fftshifted column
+	int xshift = nx / 2;
+	int yshift = ny / 2;
+	Real norm = 1.0 / ((Real)nx * ny);
+	vector<vector<Complex<Real>>> Fx(_wavelength_num, vector<Complex<Real>>(nx));
+	vector<vector<Complex<Real>>> Fy(_wavelength_num, vector<Complex<Real>>(ny));
 	for (int z = 0; z < _wavelength_num; z++)
 	{
 		double sigmaf = ((_foc[2] - _foc[z]) * context_.wave_length[z]) / (4 * M_PI);
-		int xshift = nx / 2;
-		int yshift = ny / 2;
-
+		for (int j = 0; j < nx; j++)
+		{
+			Real x = (2 * M_PI * j) / _radius - (M_PI*(nx - 1)) / _radius;
+			int jj = (j + xshift) % nx;
+			Fx[z][jj] = Complex<Real>(cos(sigmaf * x * x) * norm, -sin(sigmaf * x * x) * norm);
+		}
 		for (int i = 0; i < ny; i++)
 		{
+			Real y = (2 * M_PI * i) / _radius - (M_PI*(ny - 1)) / _radius;
 			int ii = (i + yshift) % ny;
-			y = (2 * M_PI * i) / _radius - (M_PI*(ny - 1)) / _radius;
-			for (int j = 0; j < nx; j++)
+			Fy[z][ii] = Complex<Real>(cos(sigmaf * y * y), -sin(sigmaf * y * y));
+		}
+	}
+	prepareFFT2(nx, ny);
+
+	auto kernel_time = CUR_TIME;
+
+	// channels run one after another so the cached (multi-threaded) plans are not executed from a parallel region
+	for (int z = 0; z < _wavelength_num; z++)
+	{
+		fft2InPlace(ComplexH[z], OPH_FORWARD);
+		int jj;
+#ifdef _OPENMP
+#pragma omp parallel for private(jj)
+#endif
+		for (jj = 0; jj < nx; jj++)
+		{
+			Complex<Real>* row = ComplexH[z][jj];
+			for (int ii = 0; ii < ny; ii++)
 			{
-				x = (2 * M_PI * j) / _radius - (M_PI*(nx - 1)) / _radius;
-				
-				int jj = (j + xshift) % nx;
-			
-				FFZP(jj, ii)._Val[_RE] = cos(sigmaf * (pow(x, 2) + pow(y, 2)));
-				FFZP(jj, ii)._Val[_IM] = -sin(sigmaf * (pow(x, 2) + pow(y, 2))); //conjugate   -
+				row[ii] *= Fx[z][jj] * Fy[z][ii];
 			}
 		}
-		fft2(ComplexH[z], FH, OPH_FORWARD);
-		FH.mulElem(FFZP);
-		fft2(FH, ComplexH[z], OPH_BACKWARD);
+		fft2InPlace(ComplexH[z], OPH_BACKWARD);
 	}
 
+	auto end_time = CUR_TIME;
+
+	LOG("sigConvertCAC : kernel %.5lf sec, transform %.5lf sec\n",
+		((std::chrono::duration<Real>)(kernel_time - start_time)).count(),
+		((std::chrono::duration<Real>)(end_time - kernel_time)).count());
+
 	return true;
 }
 
@@ -1148,67 +1339,75 @@ double ophSig::sigGetParamAT_CPU() {
 	int nx = context_.pixel_number[_X];
 	int ny = context_.pixel_number[_Y];
 
-	OphComplexField Flr(nx, ny);
-	OphComplexField Fli(nx, ny);
-	OphComplexField Hsyn(nx, ny);
-
-	OphComplexField Fo(nx, ny);
 	OphComplexField Fon, yn, Ab_yn;
 
 	OphRealField Ab_yn_half;
-	OphRealField G(nx, ny);
-	Real x = 1, y = 1;
 	vector<Real> t, tn;
 
-	for (i = 0; i < nx; i++)
-	{
-		for (j = 0; j < ny; j++)
-		{
-
-			x = (2 * M_PI*(i) / _cfgSig.height - M_PI*(nx - 1) / _cfgSig.height);
-			y = (2 * M_PI*(j) / _cfgSig.width - M_PI*(ny - 1) / _cfgSig.width);
-			G(i, j) = std::exp(-M_PI * pow((*context_.wave_length) / (2 * M_PI * NA_g), 2) * (pow(y, 2) + pow(x, 2)));
-			Flr(i, j)._Val[_RE] = (*ComplexH)(i, j)._Val[_RE];
-			Fli(i, j)._Val[_RE] = (*ComplexH)(i, j)._Val[_IM];
-			Flr(i, j)._Val[_IM] = 0;
-			Fli(i, j)._Val[_IM] = 0;
-		}
-	}
-
-	fft2(Flr, Flr);
-	fft2(Fli, Fli);
-
 	int xshift = nx / 2;
 	int yshift = ny / 2;
 
+	// Only row nx / 2 - 1 of the fftshifted Fo = Hsyn^2 / |Hsyn|^2 is used, so the spectra of the real
+	// and imaginary parts are evaluated on its source row u alone : a DFT over x for every column,
+	// followed by a 1D FFT along y. G is evaluated on the same samples.
+	int u = (nx / 2 - 1 - xshift + nx) % nx;
+
+	vector<Real> twr(nx), twi(nx);
 	for (i = 0; i < nx; i++)
 	{
-		int ii = (i + xshift) % nx;
-		for (j = 0; j < ny; j++)
-		{
-			int jj = (j + yshift) % ny;
-			Hsyn(i, j)._Val[_RE] = Flr(i, j)._Val[_RE] * G(i, j);
-			Hsyn(i, j)._Val[_IM] = Fli(i, j)._Val[_RE] * G(i, j);
-			/*Hsyn_copy1(i, j) = Hsyn(i, j);
-			Hsyn_copy2(i, j) = Hsyn_copy1(i, j) * Hsyn(i, j);
-			Hsyn_copy3(i, j) = pow(sqrt(Hsyn(i, j)._Val[_RE] * Hsyn(i, j)._Val[_RE] + Hsyn(i, j)._Val[_IM] * Hsyn(i, j)._Val[_IM]), 2) + pow(10, -300);
-			Fo(ii, jj)._Val[_RE] = Hsyn_copy2(i, j)._Val[0] / Hsyn_copy3(i, j);
-			Fo(ii, jj)._Val[_IM] = Hsyn_copy2(i, j)._Val[1] / Hsyn_copy3(i, j);*/
-			Fo(ii, jj) = pow(Hsyn(i, j), 2) / (pow(abs(Hsyn(i, j)), 2) + pow(10, -300));
+		Real phase = -2 * M_PI * (Real)(((long long)u * i) % nx) / nx;
+		twr[i] = cos(phase);
+		twi[i] = sin(phase);
+	}
 
+	OphComplexField Flr(1, ny);
+	OphComplexField Fli(1, ny);
+	const int block = 256;
+	int nBlock = (ny + block - 1) / block;
+	int b;
+#ifdef _OPENMP
+#pragma omp parallel for private(b)
+#endif
+	for (b = 0; b < nBlock; b++)
+	{
+		int jBegin = b * block;
+		int jEnd = (jBegin + block < ny) ? jBegin + block : ny;
+		Complex<Real>* fr = Flr[0];
+		Complex<Real>* fi = Fli[0];
+		for (int x = 0; x < nx; x++)
+		{
+			const Complex<Real>* h = (*ComplexH)[x];
+			for (int y = jBegin; y < jEnd; y++)
+			{
+				fr[y]._Val[_RE] += h[y]._Val[_RE] * twr[x];
+				fr[y]._Val[_IM] += h[y]._Val[_RE] * twi[x];
+				fi[y]._Val[_RE] += h[y]._Val[_IM] * twr[x];
+				fi[y]._Val[_IM] += h[y]._Val[_IM] * twi[x];
+			}
 		}
 	}
+	fft1(Flr, Flr);
+	fft1(Fli, Fli);
 
 	t = linspace(0., 1., nx / 2 + 1);
 	tn.resize(t.size());
 	Fon.resize(1, t.size());
 
+	Real gFactor = M_PI * pow((*context_.wave_length) / (2 * M_PI * NA_g), 2);
+	Real x = (2 * M_PI*(u) / _cfgSig.height - M_PI*(nx - 1) / _cfgSig.height);
 	for (int i = 0; i < tn.size(); i++)
 	{
 		tn.at(i) = pow(t.at(i), 0.5);
-		Fon(0, i)._Val[_RE] = Fo(nx / 2 - 1, nx / 2 - 1 + i)._Val[_RE];
+
+		int v = (nx / 2 - 1 + i - yshift + ny) % ny;
+		Real y = (2 * M_PI*(v) / _cfgSig.width - M_PI*(ny - 1) / _cfgSig.width);
+		Real G = std::exp(-gFactor * (y * y + x * x));
+		Real re = Flr(0, v)._Val[_RE] * G;
+		Real im = Fli(0, v)._Val[_RE] * G;
+		Fon(0, i)._Val[_RE] = (re * re - im * im) / (re * re + im * im + 1e-300);
 		Fon(0, i)._Val[_IM] = 0;
 	}
+
 	yn.resize(1, tn.size());
 	linInterp(t, Fon, tn, yn);
 	fft1(yn, yn);
@@ -1237,218 +1436,506 @@ double ophSig::sigGetParamAT_CPU() {
 	return index;
 }
 
+Real ophSig::sigSharpness(const fftw_complex* spectrum, const Real* radius2, Real_t depth, float th, fftw_complex* work, fftw_plan plan)
+{
+	const int nx = context_.pixel_number[_X];
+	const int ny = context_.pixel_number[_Y];
+	const int N = nx * ny;
+	const Real sigmaf = (depth * (*context_.wave_length)) / (4 * M_PI);
+	const Real scale = 1.0 / N;
+
+	// apply the Fresnel kernel to the shared spectrum
+	for (int k = 0; k < N; k++)
+	{
+		Real phase = sigmaf * radius2[k];
+		Real c = cos(phase);
+		Real s = sin(phase);
+		work[k][_RE] = c * spectrum[k][_RE] - s * spectrum[k][_IM];
+		work[k][_IM] = s * spectrum[k][_RE] + c * spectrum[k][_IM];
+	}
+
+	fftw_execute(plan);
+
+	// sharpness of the real part, normalized while reading the inverse FFT output
+	Real f = 0;
+	for (int i = 0; i < nx - 2; i++)
+	{
+		const fftw_complex* row = work + i * ny;
+		const fftw_complex* row2 = work + (i + 2) * ny;
+		for (int j = 0; j < ny - 2; j++)
+		{
+			Real ret1 = abs(row2[j][_RE] - row[j][_RE]) * scale;
+			Real ret2 = abs(row[j + 2][_RE] - row[j][_RE]) * scale;
+			if (ret1 >= th) { f += ret1 * ret1; }
+			else if (ret2 >= th) { f += ret2 * ret2; }
+		}
+	}
+	return f;
+}
+
 double ophSig::sigGetParamSF_CPU(float zMax, float zMin, int sampN, float th) {
 	
 	int nx = context_.pixel_number[_X];
 	int ny = context_.pixel_number[_Y];
+	const int N = nx * ny;
 
-	OphComplexField I(nx, ny);
-	vector<Real> F;
 	Real dz = (zMax - zMin) / sampN;
-	Real f;
-	Real_t z = 0;
-	Real depth = 0;
+	Real_t depth = 0;
 	Real max = MIN_DOUBLE;
 	int i, j, n = 0;
-	Real ret1;
-	Real ret2;
+	int nEval = 0;
 
-	for (n = 0; n < sampN + 1; n++)
+	// the hologram spectrum is the same for every candidate depth
+	fftw_complex* spectrum = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * N);
+	memcpy(spectrum, ComplexH->data(), sizeof(fftw_complex) * N);
+	fftw_plan plan = fftw_plan_dft_2d(nx, ny, spectrum, spectrum, OPH_FORWARD, OPH_ESTIMATE);
+	fftw_execute(plan);
+	fftw_destroy_plan(plan);
+
+	// x^2 + y^2 of the propagation kernel at the (shifted) spectrum position
+	Real* radius2 = new Real[N];
+	int xshift = nx / 2;
+	int yshift = ny / 2;
+	for (i = 0; i < ny; i++)
 	{
-		z = ((n)* dz + zMin);
-		f = 0;
-		I = propagationHolo((*ComplexH), z);
+		int ii = (i + yshift) % ny;
+		Real y = (2 * M_PI * (i)) / _cfgSig.width - (M_PI*(ny - 1)) / (_cfgSig.width);
+		for (j = 0; j < nx; j++)
+		{
+			Real x = (2 * M_PI * (j)) / _cfgSig.height - (M_PI*(nx - 1)) / (_cfgSig.height);
+			int jj = (j + xshift) % nx;
+			radius2[jj * ny + ii] = pow(x, 2) + pow(y, 2);
+		}
+	}
 
-		for (i = 0; i < nx - 2; i++)
+	// workspace and inverse plan per thread (planning is not thread safe).
+	// The plans run concurrently from the search loop, so each one is single-threaded.
+	// No more threads than depths evaluated per pass : each workspace holds a whole field.
+	int nThread = 1;
+#ifdef _OPENMP
+	nThread = omp_get_max_threads();
+	int nDepth = (_sfSearch == SF_SEARCH_GRID) ? sampN + 1 : SF_COARSE_STEP + 1;
+	if (nThread > nDepth) nThread = nDepth;
+	if (nThread < 1) nThread = 1;
+#endif
+	fftw_complex** work = new fftw_complex*[nThread];
+	fftw_plan* bwd = new fftw_plan[nThread];
+	int nPlannerThreads = setFFTWPlannerThreads(1);
+	for (i = 0; i < nThread; i++)
+	{
+		work[i] = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * N);
+		bwd[i] = fftw_plan_dft_2d(nx, ny, work[i], work[i], OPH_BACKWARD, OPH_ESTIMATE);
+	}
+	setFFTWPlannerThreads(nPlannerThreads);
+
+	if (_sfSearch == SF_SEARCH_GRID)
+	{
+		vector<Real> F(sampN + 1);
+#ifdef _OPENMP
+#pragma omp parallel for private(n) schedule(dynamic) num_threads(nThread)
+#endif
+		for (n = 0; n < sampN + 1; n++)
+		{
+			int tid = 0;
+#ifdef _OPENMP
+			tid = omp_get_thread_num();
+#endif
+			Real_t z = ((n)* dz + zMin);
+			F[n] = sigSharpness(spectrum, radius2, z, th, work[tid], bwd[tid]);
+		}
+		nEval = sampN + 1;
+
+		for (n = 0; n < sampN + 1; n++)
+		{
+			if (F[n] > max) {
+				max = F[n];
+				depth = ((n)* dz + zMin);
+			}
+		}
+	}
+	else
+	{
+		const int nCoarse = SF_COARSE_STEP;
+		Real lo = (zMin < zMax) ? zMin : zMax;
+		Real hi = (zMin < zMax) ? zMax : zMin;
+		Real fdz = abs(dz);
+		Real step = 0;
+		vector<Real> F(nCoarse + 1);
+		vector<Real_t> Z(nCoarse + 1);
+
+		// coarse grid, refined around the best depth until the grid spacing reaches (zMax - zMin) / sampN
+		while (true)
 		{
-			for (j = 0; j < ny - 2; j++)
+			int m = nCoarse;
+			if ((hi - lo) / m < fdz) m = (int)ceil((hi - lo) / fdz);
+			if (m < 1) m = 1;
+			step = (hi - lo) / m;
+
+#ifdef _OPENMP
+#pragma omp parallel for private(n) schedule(dynamic) num_threads(nThread)
+#endif
+			for (n = 0; n < m + 1; n++)
 			{
-				ret1 = abs(I(i + 2, j)._Val[_RE] - I(i, j)._Val[_RE]);
-				ret2 = abs(I(i, j + 2)._Val[_RE] - I(i, j)._Val[_RE]);
-				if (ret1 >= th) { f += ret1 * ret1; }
-				else if (ret2 >= th) { f += ret2 * ret2; }
+				int tid = 0;
+#ifdef _OPENMP
+				tid = omp_get_thread_num();
+#endif
+				Z[n] = (Real_t)(lo + n * step);
+				F[n] = sigSharpness(spectrum, radius2, Z[n], th, work[tid], bwd[tid]);
 			}
+			nEval += m + 1;
+
+			for (n = 0; n < m + 1; n++)
+			{
+				if (F[n] > max) {
+					max = F[n];
+					depth = Z[n];
+				}
+			}
+			if (max <= MIN_DOUBLE || step <= fdz || _sfSearch == SF_SEARCH_GOLDEN) break;
+
+			if (depth - step > lo) lo = depth - step;
+			if (depth + step < hi) hi = depth + step;
 		}
-		//cout << (float)n / sampN * 100 << " %" << endl;
 
-		if (f > max) {
-			max = f;
-			depth = z;
+		if (_sfSearch == SF_SEARCH_GOLDEN && max > MIN_DOUBLE)
+		{
+			// golden-section search inside the bracket of the best coarse depth
+			const Real gr = (sqrt(5.0) - 1) / 2;
+			Real a = (depth - step > lo) ? depth - step : lo;
+			Real b = (depth + step < hi) ? depth + step : hi;
+			Real_t c = (Real_t)(b - gr * (b - a));
+			Real_t d = (Real_t)(a + gr * (b - a));
+			Real fc = sigSharpness(spectrum, radius2, c, th, work[0], bwd[0]);
+			Real fd = sigSharpness(spectrum, radius2, d, th, work[0], bwd[0]);
+			nEval += 2;
+
+			while (b - a > fdz)
+			{
+				if (fc > fd) {
+					b = d; d = c; fd = fc;
+					c = (Real_t)(b - gr * (b - a));
+					fc = sigSharpness(spectrum, radius2, c, th, work[0], bwd[0]);
+				}
+				else {
+					a = c; c = d; fc = fd;
+					d = (Real_t)(a + gr * (b - a));
+					fd = sigSharpness(spectrum, radius2, d, th, work[0], bwd[0]);
+				}
+				nEval++;
+			}
+			if (fc > max) { max = fc; depth = c; }
+			if (fd > max) { max = fd; depth = d; }
 		}
 	}
+	LOG("sigGetParamSF : %d depths evaluated\n", nEval);
 
+	for (i = 0; i < nThread; i++)
+	{
+		fftw_destroy_plan(bwd[i]);
+		fftw_free(work[i]);
+	}
+	delete[] work;
+	delete[] bwd;
+	delete[] radius2;
+	fftw_free(spectrum);
 
 	return depth;
 }
 
-bool ophSig::getComplexHFromPSDH(const char * fname0, const char * fname90, const char * fname180, const char * fname270)
+bool ophSig::readPSDHBmp(const char* fname, int defaultHeight, int defaultWidth, bitmapinfoheader& hInfo, vector<uchar>& data)
 {
-	auto start_time = CUR_TIME;
-	string fname0str = fname0;
-	string fname90str = fname90;
-	string fname180str = fname180;
-	string fname270str = fname270;
-	int checktype = static_cast<int>(fname0str.rfind("."));
-	OphRealField f0Mat[3], f90Mat[3], f180Mat[3], f270Mat[3];
-
-	std::string f0type = fname0str.substr(checktype + 1, fname0str.size());
-
-	uint16_t bitsperpixel;
+	FILE *fp;
 	fileheader hf;
-	bitmapinfoheader hInfo;
+	fopen_s(&fp, fname, "rb");
+	if (!fp) return false;
 
-	if (f0type == "bmp")
+	if (fread(&hf, sizeof(fileheader), 1, fp) != 1 ||
+		fread(&hInfo, sizeof(bitmapinfoheader), 1, fp) != 1)
 	{
-		FILE *f0, *f90, *f180, *f270;
-		fopen_s(&f0, fname0str.c_str(), "rb"); fopen_s(&f90, fname90str.c_str(), "rb");
-		fopen_s(&f180, fname180str.c_str(), "rb"); fopen_s(&f270, fname270str.c_str(), "rb");
-		if (!f0)
+		LOG("bmp header is truncated!\n");
+		fclose(fp);
+		return false;
+	}
+
+	if (hf.signature[0] != 'B' || hf.signature[1] != 'M') { LOG("Not BMP File!\n"); }
+	if ((hInfo.height == 0) || (hInfo.width == 0))
+	{
+		LOG("bmp header is empty!\n");
+		hInfo.height = defaultHeight;
+		hInfo.width = defaultWidth;
+		if (hInfo.height == 0 || hInfo.width == 0)
 		{
-			LOG("bmp file open fail! (phase shift = 0)\n");
+			LOG("check your parameter file!\n");
+			fclose(fp);
 			return false;
 		}
-		if (!f90)
+	}
+	if (hInfo.bitsperpixel == 8)
+	{
+		rgbquad palette[256];
+		if (fread(palette, sizeof(rgbquad), 256, fp) != 256)
 		{
-			LOG("bmp file open fail! (phase shift = 90)\n");
+			LOG("bmp palette is truncated!\n");
+			fclose(fp);
 			return false;
 		}
-		if (!f180)
+	}
+
+	// rows are padded to 4 bytes in the file and kept that way, see combinePSDH.
+	// The buffer keeps its capacity, so a sequence of same size frames never reallocates
+	size_t size = (size_t)(((hInfo.width * (hInfo.bitsperpixel / 8)) + 3) & ~3) * hInfo.height;
+	data.resize(size);
+	size_t nRead = fread(data.data(), sizeof(uchar), size, fp);
+	fclose(fp);
+	if (nRead != size)
+	{
+		LOG("bmp pixel data is truncated!\n");
+		return false;
+	}
+
+	return true;
+}
+
+void ophSig::preparePSDHField(const bitmapinfoheader& hInfo)
+{
+	if ((context_.pixel_number[_Y] != hInfo.height) || (context_.pixel_number[_X] != hInfo.width)) {
+		LOG("image size is different!\n");
+		context_.pixel_number[_Y] = hInfo.height;
+		context_.pixel_number[_X] = hInfo.width;
+		LOG("changed parameter of size %d x %d\n", context_.pixel_number[_X], context_.pixel_number[_Y]);
+	}
+
+	int channels = (hInfo.bitsperpixel == 8) ? 1 : 3;
+	if (ComplexH == nullptr || _wavelength_num != channels)
+	{
+		_wavelength_num = channels;
+		delete[] ComplexH;
+		ComplexH = new OphComplexField[channels];
+	}
+	for (int z = 0; z < channels; z++)
+		ComplexH[z].resize(hInfo.height, hInfo.width);
+}
+
+void ophSig::combinePSDH(const uchar* f0, const uchar* f90, const uchar* f180, const uchar* f270, const bitmapinfoheader& hInfo)
+{
+	const int height = hInfo.height;
+	const int width = hInfo.width;
+	const int bpp = hInfo.bitsperpixel / 8;
+	const size_t stride = ((width * bpp) + 3) & ~3;
+	const double normalizefactor = 1. / 256.;
+
+	// bitmap rows are stored bottom-up, 4-byte aligned
+	int i;
+#ifdef _OPENMP
+#pragma omp parallel for private(i)
+#endif
+	for (i = 0; i < height; i++)
+	{
+		const size_t offset = (height - i - 1) * stride;
+		const uchar* p0 = f0 + offset;
+		const uchar* p90 = f90 + offset;
+		const uchar* p180 = f180 + offset;
+		const uchar* p270 = f270 + offset;
+		for (int z = 0; z < _wavelength_num; z++)
+		{
+			Complex<Real>* row = ComplexH[z][i];
+			for (int j = 0; j < width; j++)
+			{
+				row[j]._Val[_RE] = ((double)p0[bpp*j + z] - (double)p180[bpp*j + z])*normalizefactor;
+				row[j]._Val[_IM] = ((double)p90[bpp*j + z] - (double)p270[bpp*j + z])*normalizefactor;
+			}
+		}
+	}
+}
+
+bool ophSig::getComplexHFromPSDH(const char * fname0, const char * fname90, const char * fname180, const char * fname270)
+{
+	auto start_time = CUR_TIME;
+	string fname0str = fname0;
+	int checktype = static_cast<int>(fname0str.rfind("."));
+
+	std::string f0type = fname0str.substr(checktype + 1, fname0str.size());
+	if (f0type != "bmp")
+	{
+		LOG("wrong type (only BMP supported)\n");
+		return false;
+	}
+
+	// the four bitmaps are decoded in parallel
+	const char* fnames[4] = { fname0, fname90, fname180, fname270 };
+	const int shift[4] = { 0, 90, 180, 270 };
+	bitmapinfoheader hInfo[4];
+	vector<uchar> data[4];
+	bool bOK[4];
+	int defaultHeight = context_.pixel_number[_X];
+	int defaultWidth = context_.pixel_number[_Y];
+	int n;
+#ifdef _OPENMP
+#pragma omp parallel for private(n)
+#endif
+	for (n = 0; n < 4; n++)
+	{
+		bOK[n] = readPSDHBmp(fnames[n], defaultHeight, defaultWidth, hInfo[n], data[n]);
+	}
+	for (n = 0; n < 4; n++)
+	{
+		if (!bOK[n])
 		{
-			LOG("bmp file open fail! (phase shift = 180)\n");
+			LOG("bmp file open fail! (phase shift = %d)\n", shift[n]);
 			return false;
 		}
-		if (!f270)
+		if (hInfo[n].width != hInfo[0].width || hInfo[n].height != hInfo[0].height ||
+			hInfo[n].bitsperpixel != hInfo[0].bitsperpixel)
 		{
-			LOG("bmp file open fail! (phase shift = 270)\n");
+			LOG("image size is different! (phase shift = %d)\n", shift[n]);
 			return false;
 		}
-		fread(&hf, sizeof(fileheader), 1, f0);
-		fread(&hInfo, sizeof(bitmapinfoheader), 1, f0);
+	}
+	LOG("PSDH file load complete!\n");
+
+	// calculation complexH from 4 psdh and then normalize
+	preparePSDHField(hInfo[0]);
+	combinePSDH(data[0].data(), data[1].data(), data[2].data(), data[3].data(), hInfo[0]);
+	LOG("complex field obtained from 4 psdh\n");
 
-		if (hf.signature[0] != 'B' || hf.signature[1] != 'M') { LOG("Not BMP File!\n"); }
-		if ((hInfo.height == 0) || (hInfo.width == 0))
+	auto end_time = CUR_TIME;
+
+	auto during_time = ((std::chrono::duration<Real>)(end_time - start_time)).count();
+
+	LOG("Implement time : %.5lf sec\n", during_time);
+
+	return true;
+}
+
+int ophSig::getComplexHFromPSDHSequence(const vector<string>& fnames, std::function<bool(int)> callback, float depth, uint ringSize)
+{
+	auto start_time = CUR_TIME;
+
+	int nFrame = (int)(fnames.size() / 4);
+	if (nFrame == 0) return 0;
+	if (ringSize == 0) ringSize = 1;
+
+	// ring of decoded frames shared with the reader thread
+	struct Slot {
+		int frame;
+		bool bOK;
+		bitmapinfoheader hInfo[4];
+		vector<uchar> data[4];
+	};
+	vector<Slot> ring(ringSize);
+	vector<int> freeSlot;
+	std::deque<int> ready;
+	bool bStop = false;
+	std::mutex lock;
+	std::condition_variable cvReady;
+	std::condition_variable cvFree;
+	for (uint i = 0; i < ringSize; i++)
+		freeSlot.push_back(i);
+
+	int defaultHeight = context_.pixel_number[_X];
+	int defaultWidth = context_.pixel_number[_Y];
+
+	std::thread reader([&]() {
+		for (int f = 0; f < nFrame; f++)
 		{
-			LOG("bmp header is empty!\n");
-			hInfo.height = context_.pixel_number[_X];
-			hInfo.width = context_.pixel_number[_Y];
-			if (hInfo.height == 0 || hInfo.width == 0)
+			int slot;
+			{
+				std::unique_lock<std::mutex> lk(lock);
+				cvFree.wait(lk, [&] { return bStop || !freeSlot.empty(); });
+				if (bStop) return;
+				slot = freeSlot.back();
+				freeSlot.pop_back();
+			}
+
+			// the four bitmaps of a frame are decoded in parallel, as in getComplexHFromPSDH
+			Slot& s = ring[slot];
+			s.frame = f;
+			bool bOK[4];
+			int n;
+#ifdef _OPENMP
+#pragma omp parallel for private(n)
+#endif
+			for (n = 0; n < 4; n++)
 			{
-				LOG("check your parameter file!\n");
-				return false;
+				bOK[n] = readPSDHBmp(fnames[4 * f + n].c_str(), defaultHeight, defaultWidth, s.hInfo[n], s.data[n]);
 			}
+			s.bOK = true;
+			for (n = 0; n < 4; n++)
+			{
+				if (!bOK[n] || s.hInfo[n].width != s.hInfo[0].width || s.hInfo[n].height != s.hInfo[0].height ||
+					s.hInfo[n].bitsperpixel != s.hInfo[0].bitsperpixel)
+					s.bOK = false;
+			}
+
+			{
+				std::lock_guard<std::mutex> lk(lock);
+				ready.push_back(slot);
+			}
+			cvReady.notify_one();
 		}
-		if ((context_.pixel_number[_Y] != hInfo.height) || (context_.pixel_number[_X] != hInfo.width)) {
-			LOG("image size is different!\n");
-			context_.pixel_number[_Y] = hInfo.height;
-			context_.pixel_number[_X] = hInfo.width;
-			LOG("changed parameter of size %d x %d\n", context_.pixel_number[_X], context_.pixel_number[_Y]);
+	});
+
+	int nDone = 0;
+	for (int f = 0; f < nFrame; f++)
+	{
+		int slot;
+		{
+			std::unique_lock<std::mutex> lk(lock);
+			cvReady.wait(lk, [&] { return !ready.empty(); });
+			slot = ready.front();
+			ready.pop_front();
 		}
-		bitsperpixel = hInfo.bitsperpixel;
-		if (hInfo.bitsperpixel == 8)
+
+		Slot& s = ring[slot];
+		int frame = s.frame;
+		bool bContinue = s.bOK;
+		if (!s.bOK)
 		{
-			_wavelength_num = 1;
-			rgbquad palette[256];
-			fread(palette, sizeof(rgbquad), 256, f0);
-			fread(palette, sizeof(rgbquad), 256, f90);
-			fread(palette, sizeof(rgbquad), 256, f180);
-			fread(palette, sizeof(rgbquad), 256, f270);
-
-			f0Mat[0].resize(hInfo.height, hInfo.width);
-			f90Mat[0].resize(hInfo.height, hInfo.width);
-			f180Mat[0].resize(hInfo.height, hInfo.width);
-			f270Mat[0].resize(hInfo.height, hInfo.width);
-			ComplexH = new OphComplexField;
-			ComplexH[0].resize(hInfo.height, hInfo.width);
+			LOG("PSDH frame %d : bmp file open fail or image size is different!\n", frame);
 		}
 		else
 		{
-			_wavelength_num = 3;
-			ComplexH = new OphComplexField[3];
-			f0Mat[0].resize(hInfo.height, hInfo.width);
-			f90Mat[0].resize(hInfo.height, hInfo.width);
-			f180Mat[0].resize(hInfo.height, hInfo.width);
-			f270Mat[0].resize(hInfo.height, hInfo.width);
-			ComplexH[0].resize(hInfo.height, hInfo.width);
-
-			f0Mat[1].resize(hInfo.height, hInfo.width);
-			f90Mat[1].resize(hInfo.height, hInfo.width);
-			f180Mat[1].resize(hInfo.height, hInfo.width);
-			f270Mat[1].resize(hInfo.height, hInfo.width);
-			ComplexH[1].resize(hInfo.height, hInfo.width);
-
-			f0Mat[2].resize(hInfo.height, hInfo.width);
-			f90Mat[2].resize(hInfo.height, hInfo.width);
-			f180Mat[2].resize(hInfo.height, hInfo.width);
-			f270Mat[2].resize(hInfo.height, hInfo.width);
-			ComplexH[2].resize(hInfo.height, hInfo.width);
+			preparePSDHField(s.hInfo[0]);
+			combinePSDH(s.data[0].data(), s.data[1].data(), s.data[2].data(), s.data[3].data(), s.hInfo[0]);
 		}
 
-		uchar* f0data = (uchar*)malloc(sizeof(uchar)*hInfo.width*hInfo.height*(hInfo.bitsperpixel / 8));
-		uchar* f90data = (uchar*)malloc(sizeof(uchar)*hInfo.width*hInfo.height*(hInfo.bitsperpixel / 8));
-		uchar* f180data = (uchar*)malloc(sizeof(uchar)*hInfo.width*hInfo.height*(hInfo.bitsperpixel / 8));
-		uchar* f270data = (uchar*)malloc(sizeof(uchar)*hInfo.width*hInfo.height*(hInfo.bitsperpixel / 8));
-
-		fread(f0data, sizeof(uchar), hInfo.width*hInfo.height*(hInfo.bitsperpixel / 8), f0);
-		fread(f90data, sizeof(uchar), hInfo.width*hInfo.height*(hInfo.bitsperpixel / 8), f90);
-		fread(f180data, sizeof(uchar), hInfo.width*hInfo.height*(hInfo.bitsperpixel / 8), f180);
-		fread(f270data, sizeof(uchar), hInfo.width*hInfo.height*(hInfo.bitsperpixel / 8), f270);
-
-		fclose(f0);
-		fclose(f90);
-		fclose(f180);
-		fclose(f270);
-
-		for (int i = hInfo.height - 1; i >= 0; i--)
 		{
-			for (int j = 0; j < static_cast<int>(hInfo.width); j++)
-			{
-				for (int z = 0; z < (hInfo.bitsperpixel / 8); z++)
-				{
-					f0Mat[z](hInfo.height - i - 1, j) = (double)f0data[i*hInfo.width*(hInfo.bitsperpixel / 8) + (hInfo.bitsperpixel / 8)*j + z];
-					f90Mat[z](hInfo.height - i - 1, j) = (double)f90data[i*hInfo.width*(hInfo.bitsperpixel / 8) + (hInfo.bitsperpixel / 8)*j + z];
-					f180Mat[z](hInfo.height - i - 1, j) = (double)f180data[i*hInfo.width*(hInfo.bitsperpixel / 8) + (hInfo.bitsperpixel / 8)*j + z];
-					f270Mat[z](hInfo.height - i - 1, j) = (double)f270data[i*hInfo.width*(hInfo.bitsperpixel / 8) + (hInfo.bitsperpixel / 8)*j + z];
-				}
-			}
+			std::lock_guard<std::mutex> lk(lock);
+			freeSlot.push_back(slot);
 		}
-		LOG("PSDH file load complete!\n");
-
-		free(f0data);
-		free(f90data);
-		free(f180data);
-		free(f270data);
+		cvFree.notify_one();
 
-	}
-	else
-	{
-		LOG("wrong type (only BMP supported)\n");
+		if (bContinue)
+		{
+			if (depth != 0) propagationHolo(depth);
+			nDone++;
+			if (callback) bContinue = callback(frame);
+		}
+		if (!bContinue) break;
 	}
 
-	// calculation complexH from 4 psdh and then normalize
-	double normalizefactor = 1. / 256.;
-	for (int z = 0; z < (hInfo.bitsperpixel / 8); z++)
 	{
-		for (int i = 0; i < context_.pixel_number[_X]; i++)
-		{
-			for (int j = 0; j < context_.pixel_number[_Y]; j++)
-			{
-				ComplexH[z][j][i]._Val[_RE] = (f0Mat[z][j][i] - f180Mat[z][j][i])*normalizefactor;
-				ComplexH[z][j][i]._Val[_IM] = (f90Mat[z][j][i] - f270Mat[z][j][i])*normalizefactor;
-
-			}
-		}
+		std::lock_guard<std::mutex> lk(lock);
+		bStop = true;
 	}
-	LOG("complex field obtained from 4 psdh\n");
+	cvFree.notify_all();
+	reader.join();
 
 	auto end_time = CUR_TIME;
 
 	auto during_time = ((std::chrono::duration<Real>)(end_time - start_time)).count();
 
-	LOG("Implement time : %.5lf sec\n", during_time);
+	LOG("PSDH sequence : %d frames, %.3f frames/sec\n", nDone, nDone / during_time);
 
-	return true;
+	return nDone;
 }
 
 void ophSig::ophFree(void) {
+	if (fwd_plan) fftw_destroy_plan(fwd_plan);
+	if (bwd_plan) fftw_destroy_plan(bwd_plan);
+	fwd_plan = nullptr;
+	bwd_plan = nullptr;
+	_planSize = ivec2(0, 0);
 
 }
\ No newline at end of file
@@ -50,6 +50,7 @@
 #include "tinyxml2.h"
 #include "Openholo.h"
 #include "sys.h"
+#include <functional>
 
 
 
@@ -59,6 +60,14 @@
 #define SIG_DLL __declspec(dllimport)
 #endif
 
+/**
+* @brief depth search of the sharpness function autofocus (sigGetParamSF)
+*/
+#define SF_SEARCH_GRID				0	// sampN + 1 equally spaced depths
+#define SF_SEARCH_COARSE_TO_FINE	1	// coarse grid refined around the best depth
+#define SF_SEARCH_GOLDEN			2	// coarse grid followed by a golden-section search
+#define SF_COARSE_STEP				8
+
 struct SIG_DLL ophSigConfig {
 	int cols;
 	int rows;
@@ -461,7 +470,8 @@ protected:
 	bool is_CPU;
 	ophSigConfig _cfgSig;
 	OphComplexField* ComplexH;
-	fftw_plan bwd_plan, fwd_plan;
+	fftw_plan bwd_plan, fwd_plan;	///< in-place 2D plans cached by prepareFFT2 for fft2InPlace
+	ivec2 _planSize;
 
 	//float _width;
 	//float _height;
@@ -476,6 +486,7 @@ protected:
 	float _redRate;*/
 	Real_t _radius;
 	Real_t* _foc;
+	uint _sfSearch;
 
 
 
@@ -563,6 +574,32 @@ protected:
 	* @return			Result distance
 	*/
 	double sigGetParamSF_GPU(float zMax, float zMin, int sampN, float th);
+	/**
+	* @ingroup getSF
+	* @brief			Sharpness of the hologram propagated to a depth, from its precomputed spectrum
+	* @param spectrum	Forward FFT of the hologram
+	* @param radius2	x^2 + y^2 of the propagation kernel for each spectrum sample
+	* @param depth		Candidate depth
+	* @param th			Threshold value
+	* @param work		Workspace of the inverse FFT
+	* @param plan		In-place inverse FFT plan on work
+	* @return			Sharpness value
+	*/
+	Real sigSharpness(const fftw_complex* spectrum, const Real* radius2, Real_t depth, float th, fftw_complex* work, fftw_plan plan);
+
+	/**
+	* @brief			Build the cached in-place 2D FFT plans (fwd_plan, bwd_plan) for a nx x ny field.
+	*					Plans are kept until the size changes. They are multi-threaded, so call fft2InPlace
+	*					from outside OpenMP parallel regions.
+	* @param nx, ny		Size of the field
+	*/
+	void prepareFFT2(int nx, int ny);
+	/**
+	* @brief			In-place 2D FFT with the cached plans. The inverse is not normalized.
+	* @param field		Field to transform
+	* @param sign		OPH_FORWARD or OPH_BACKWARD
+	*/
+	void fft2InPlace(OphComplexField& field, int sign);
 
 	/**
 	* @brief			Function for propagation hologram by using CPU
@@ -604,6 +641,16 @@ public:
 	*/
 	//bool loadAsOhc(const char *fname);
 	/**
+	* @brief          Load a region of an ohc file into ComplexH through the mapped reader
+	* @details        The file stays mapped between calls and only the tiles of the region are decoded,
+	*                 so a field larger than memory can be processed region by region.
+	* @param fname    File name
+	* @param origin   Top-left pixel of the region
+	* @param size     Number of pixels of the region
+	* @return         true if the region is loaded
+	*/
+	bool loadAsOhcRegion(const char *fname, const ivec2 origin, const ivec2 size);
+	/**
 	* @brief          Save data as ohc file
 	* @param fname    File name
 	* @return         If works well return 0  or error occurs return -1
@@ -619,6 +666,17 @@ public:
 	template<typename T>
 	void linInterp(vector<T> &X, matrix<Complex<T>> &src, vector<T> &Xq, matrix<Complex<T>> &dst);
 	/**
+	* @brief          Linear interpolation on contiguous spans, extrapolating linearly outside [X[0], X[n - 1]]
+	* @details        X must be ascending. Ascending queries are located by a merge walk (O(n + m)),
+	*				  other queries by binary search. Large query spans are split over threads.
+	* @param X		  Sample points (n)
+	* @param src      Sample values (n)
+	* @param Xq       Query points (m)
+	* @param dst      Query values (m)
+	*/
+	template<typename T>
+	void linInterp(const T *X, const Complex<T> *src, int n, const T *Xq, Complex<T> *dst, int m);
+	/**
 	* @brief           Generate linearly spaced vector
 	* @param first     First number of vector
 	* @param last      Last number of vector
@@ -640,13 +698,13 @@ public:
 	template<typename T>
 	void absMat(matrix<Complex<T>>& src, matrix<T>& dst) {
 		if (src.size != dst.size) {
-			dst.resize(src.size[_X], src.size[_Y]);
+			dst.resizeNoInit(src.size[_X], src.size[_Y]);
 		}
 		for (int i = 0; i < src.size[_X]; i++)
 		{
 			for (int j = 0; j < src.size[_Y]; j++)
 			{
-				dst.mat[i][j] = sqrt(src.mat[i][j]._Val[_RE] * src.mat[i][j]._Val[_RE] + src.mat[i][j]._Val[_IM] * src.mat[i][j]._Val[_IM]);
+				dst(i, j) = sqrt(src(i, j)._Val[_RE] * src(i, j)._Val[_RE] + src(i, j)._Val[_IM] * src(i, j)._Val[_IM]);
 			}
 		}
 	}
@@ -658,13 +716,13 @@ public:
 	template<typename T>
 	void absMat(matrix<T>& src, matrix<T>& dst) {
 		if (src.size != dst.size) {
-			dst.resize(src.size[_X], src.size[_Y]);
+			dst.resizeNoInit(src.size[_X], src.size[_Y]);
 		}
 		for (int i = 0; i < src.size[_X]; i++)
 		{
 			for (int j = 0; j < src.size[_Y]; j++)
 			{
-				dst.mat[i][j] = abs(src.mat[i][j]);
+				dst(i, j) = abs(src(i, j));
 			}
 		}
 	}
@@ -676,7 +734,7 @@ public:
 	template<typename T>
 	void angleMat(matrix<Complex<T>>& src, matrix<T>& dst) {
 		if (src.size != dst.size) {
-			dst.resize(src.size[_X], src.size[_Y]);
+			dst.resizeNoInit(src.size[_X], src.size[_Y]);
 		}
 		for (int i = 0; i < src.size[_X]; i++)
 		{
@@ -694,7 +752,7 @@ public:
 	template<typename T>
 	void conjMat(matrix<Complex<T>>& src, matrix<Complex<T>>& dst) {
 		if (src.size != dst.size) {
-			dst.resize(src.size[_X], src.size[_Y]);
+			dst.resizeNoInit(src.size[_X], src.size[_Y]);
 		}
 		for (int i = 0; i < src.size[_X]; i++)
 		{
@@ -713,14 +771,14 @@ public:
 	template<typename T>
 	void expMat(matrix<Complex<T>>& src, matrix<Complex<T>>& dst) {
 		if (src.size != dst.size) {
-			dst.resize(src.size[_X], src.size[_Y]);
+			dst.resizeNoInit(src.size[_X], src.size[_Y]);
 		}
 		for (int i = 0; i < src.size[_X]; i++)
 		{
 			for (int j = 0; j < src.size[_Y]; j++)
 			{
-				dst.mat[i][j]._Val[_RE] = exp(src.mat[i][j]._Val[_RE]) * cos(src.mat[i][j]._Val[_IM]);
-				dst.mat[i][j]._Val[_IM] = exp(src.mat[i][j]._Val[_RE]) * sin(src.mat[i][j]._Val[_IM]);
+				dst(i, j)._Val[_RE] = exp(src(i, j)._Val[_RE]) * cos(src(i, j)._Val[_IM]);
+				dst(i, j)._Val[_IM] = exp(src(i, j)._Val[_RE]) * sin(src(i, j)._Val[_IM]);
 			}
 		}
 	}
@@ -732,13 +790,13 @@ public:
 	template<typename T>
 	void expMat(matrix<T>& src, matrix<T>& dst) {
 		if (src.size != dst.size) {
-			dst.resize(src.size[_X], src.size[_Y]);
+			dst.resizeNoInit(src.size[_X], src.size[_Y]);
 		}
 		for (int i = 0; i < src.size[_X]; i++)
 		{
 			for (int j = 0; j < src.size[_Y]; j++)
 			{
-				dst.mat[i][j] = exp(src.mat[i][j]);
+				dst(i, j) = exp(src(i, j));
 			}
 		}
 	}
@@ -832,7 +890,7 @@ public:
 	void ophSig::fftShift(matrix<Complex<Real>> &src, matrix<Complex<Real>> &dst)
 	{
 		if (src.size != dst.size) {
-			dst.resize(src.size[_X], src.size[_Y]);
+			dst.resizeNoInit(src.size[_X], src.size[_Y]);
 		}
 		int xshift = src.size[_X] / 2;
 		int yshift = src.size[_Y] / 2;
@@ -842,8 +900,8 @@ public:
 			for (int j = 0; j < src.size[_Y]; j++)
 			{
 				int jj = (j + yshift) % src.size[_Y];
-				dst.mat[ii][jj]._Val[_RE] = src.mat[i][j].real();
-				dst.mat[ii][jj]._Val[_IM] = src.mat[i][j].imag();
+				dst(ii, jj)._Val[_RE] = src(i, j).real();
+				dst(ii, jj)._Val[_IM] = src(i, j).imag();
 			}
 		}
 	}
@@ -936,6 +994,13 @@ public:
 	* @return			Result distance
 	*/
 	double sigGetParamSF(float zMax, float zMin, int sampN, float th);
+	/**
+	* @ingroup getSF
+	* @brief			Select the depth search of sigGetParamSF
+	* @param mode		SF_SEARCH_GRID, SF_SEARCH_COARSE_TO_FINE or SF_SEARCH_GOLDEN.
+	*					The refined searches stop at the grid spacing (zMax - zMin) / sampN
+	*/
+	void setSFSearch(uint mode);
 
 	/**
 	* @brief			Function for select device
@@ -980,6 +1045,37 @@ public:
 	*/
 	bool getComplexHFromPSDH(const char* fname0, const char* fname90, const char* fname180, const char* fname270);
 
+	/**
+	* @ingroup PSDH
+	* @brief Extraction of complex fields from a sequence of 4 phase shifted interference patterns
+	* @details A reader thread decodes the bitmaps of upcoming frames into a ring of reusable buffers
+	*			while the complex field of the current frame is computed into ComplexH, so memory does not grow with the sequence.
+	* @param fnames		4 image files per frame, in the order 0, 90, 180, 270
+	* @param callback	Called with the frame index once ComplexH holds the frame; return false to stop the sequence
+	* @param depth		If not 0, each field is reconstructed by propagationHolo(depth) before the callback
+	* @param ringSize	Number of frames decoded ahead
+	* @return			Number of frames delivered to the callback
+	*/
+	int getComplexHFromPSDHSequence(const vector<string>& fnames, std::function<bool(int)> callback, float depth = 0, uint ringSize = 2);
+
+protected:
+	/**
+	* @ingroup PSDH
+	* @brief Read the pixel data of a PSDH bitmap as stored (bottom-up rows)
+	* @param defaultHeight, defaultWidth	Size used when the bitmap header is empty
+	*/
+	bool readPSDHBmp(const char* fname, int defaultHeight, int defaultWidth, bitmapinfoheader& hInfo, vector<uchar>& data);
+	/**
+	* @ingroup PSDH
+	* @brief Update the hologram size from a PSDH bitmap and (re)allocate ComplexH for its channels
+	*/
+	void preparePSDHField(const bitmapinfoheader& hInfo);
+	/**
+	* @ingroup PSDH
+	* @brief ComplexH = ((I0 - I180) + j(I90 - I270)) / 256 in one pass over the four bitmaps
+	*/
+	void combinePSDH(const uchar* f0, const uchar* f90, const uchar* f180, const uchar* f270, const bitmapinfoheader& hInfo);
+
 
 };
 
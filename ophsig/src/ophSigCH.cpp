@@ -1,4 +1,319 @@
 #include "ophSigCH.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/**
+* @brief		out = kernel * in (or conj(kernel) * in for the adjoint), optionally accumulated into out
+*/
+template<typename K>
+static void chMulKernel(const K* kernel, const fftw_complex* in, fftw_complex* out, size_t n, bool bAdjoint, bool bAccum)
+{
+	const Real sign = bAdjoint ? -1.0 : 1.0;
+	for (size_t i = 0; i < n; i++)
+	{
+		Real kr = kernel[2 * i];
+		Real ki = sign * kernel[2 * i + 1];
+		Real re = kr * in[i][_RE] - ki * in[i][_IM];
+		Real im = kr * in[i][_IM] + ki * in[i][_RE];
+		if (bAccum) {
+			out[i][_RE] += re;
+			out[i][_IM] += im;
+		}
+		else {
+			out[i][_RE] = re;
+			out[i][_IM] = im;
+		}
+	}
+}
+
+ophSigCHOperator::ophSigCHOperator(void)
+	: nr(0)
+	, nc(0)
+	, nr2(0)
+	, nc2(0)
+	, iStart(0)
+	, jStart(0)
+	, height(0)
+	, width(0)
+	, wavelength(0)
+	, bFloat(false)
+	, kernel(nullptr)
+	, kernelF(nullptr)
+	, nThread(0)
+	, work(nullptr)
+	, accum(nullptr)
+	, fwd_plan(nullptr)
+	, bwd_plan(nullptr)
+{
+}
+
+ophSigCHOperator::~ophSigCHOperator(void)
+{
+	release();
+}
+
+void ophSigCHOperator::release(void)
+{
+	if (fwd_plan || bwd_plan)
+	{
+#ifdef _OPENMP
+#pragma omp critical(fftw_planner)
+#endif
+		{
+			if (fwd_plan) fftw_destroy_plan(fwd_plan);
+			if (bwd_plan) fftw_destroy_plan(bwd_plan);
+		}
+		fwd_plan = nullptr;
+		bwd_plan = nullptr;
+	}
+	for (int t = 0; t < nThread; t++)
+	{
+		if (work && work[t]) fftw_free(work[t]);
+		if (accum && accum[t]) fftw_free(accum[t]);
+	}
+	delete[] work;
+	delete[] accum;
+	work = nullptr;
+	accum = nullptr;
+	nThread = 0;
+
+	delete[] kernel;
+	delete[] kernelF;
+	kernel = nullptr;
+	kernelF = nullptr;
+	Z.clear();
+	nr = nc = nr2 = nc2 = 0;
+}
+
+bool ophSigCHOperator::isReady(int nr, int nc, Real height, Real width, Real wavelength, const vector<Real>& z, bool bFloat) const
+{
+	return fwd_plan != nullptr &&
+		this->nr == nr && this->nc == nc &&
+		this->height == height && this->width == width &&
+		this->wavelength == wavelength &&
+		this->bFloat == bFloat && Z == z;
+}
+
+bool ophSigCHOperator::init(int nr, int nc, Real height, Real width, Real wavelength, const vector<Real>& z, bool bFloat)
+{
+	release();
+
+	this->nr = nr;
+	this->nc = nc;
+	this->height = height;
+	this->width = width;
+	this->wavelength = wavelength;
+	this->bFloat = bFloat;
+	Z = z;
+
+	// same zero padding as propagationHoloAS (prevents circular convolution artifacts)
+	nr2 = 2 * nr;
+	nc2 = 2 * nc;
+	iStart = nr / 2 - 1;
+	jStart = nc / 2 - 1;
+
+	const int nz = (int)Z.size();
+	const size_t N = (size_t)nr2 * nc2;
+
+	nThread = 1;
+#ifdef _OPENMP
+	nThread = omp_get_max_threads();
+#endif
+	work = new fftw_complex*[nThread];
+	accum = new fftw_complex*[nThread];
+	bool bAlloc = true;
+	for (int t = 0; t < nThread; t++)
+	{
+		work[t] = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * N);
+		accum[t] = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * N);
+		if (!work[t] || !accum[t]) bAlloc = false;
+	}
+	if (!bAlloc) {
+		LOG("ophSigCHOperator : workspace allocation failed\n");
+		release();
+		return false;
+	}
+
+	if (bFloat) kernelF = new Real_t[2 * N * nz];
+	else kernel = new Real[2 * N * nz];
+
+	// propagationHoloAS computes shift(IFFT(shift(K * shift(FFT(shift(x)))))).
+	// With even nr2, nc2 the spatial shifts cancel against the frequency ones,
+	// so it equals IFFT(shift(K) * FFT(x)) : only the kernel has to be shifted.
+	const double dr = height / nr;
+	const double dc = width / nc;
+	const double dfr = 1.0 / (((double)nr2)*dr);
+	const double dfc = 1.0 / (((double)nc2)*dc);
+	const double invN = 1.0 / (double)N;	// normalization of the inverse FFT
+	const int xshift = nr2 / 2;
+	const int yshift = nc2 / 2;
+
+	int k;
+#ifdef _OPENMP
+#pragma omp parallel for private(k)
+#endif
+	for (k = 0; k < nz; k++)
+	{
+		const float depth = static_cast<float>(Z[k]);
+		for (int i = 0; i < nr2; i++)
+		{
+			const int ii = (i + xshift) % nr2;
+			for (int j = 0; j < nc2; j++)
+			{
+				const int jj = (j + yshift) % nc2;
+				double fz = sqrt(pow(1.0 / wavelength, 2) - pow((i - nr2 / 2.0 + 1.0)*dfr, 2) - pow((j - nc2 / 2.0 + 1.0)*dfc, 2));
+				size_t idx = 2 * (N * k + (size_t)ii * nc2 + jj);
+				double re = cos(2 * M_PI*depth*fz) * invN;
+				double im = sin(2 * M_PI*depth*fz) * invN;
+				if (bFloat) {
+					kernelF[idx] = (Real_t)re;
+					kernelF[idx + 1] = (Real_t)im;
+				}
+				else {
+					kernel[idx] = re;
+					kernel[idx + 1] = im;
+				}
+			}
+		}
+	}
+
+	// one in-place plan pair, executed on every workspace with fftw_execute_dft.
+	// Threads run them concurrently, so they are planned single-threaded.
+#ifdef _OPENMP
+#pragma omp critical(fftw_planner)
+#endif
+	{
+		int nPlannerThreads = Openholo::setFFTWPlannerThreads(1);
+		fwd_plan = fftw_plan_dft_2d(nr2, nc2, work[0], work[0], OPH_FORWARD, OPH_ESTIMATE);
+		bwd_plan = fftw_plan_dft_2d(nr2, nc2, work[0], work[0], OPH_BACKWARD, OPH_ESTIMATE);
+		Openholo::setFFTWPlannerThreads(nPlannerThreads);
+	}
+
+	return true;
+}
+
+void ophSigCHOperator::mulKernel(int k, const fftw_complex* in, fftw_complex* out, bool bAdjoint, bool bAccum)
+{
+	const size_t N = (size_t)nr2 * nc2;
+	if (bFloat)
+		chMulKernel(kernelF + 2 * N * k, in, out, N, bAdjoint, bAccum);
+	else
+		chMulKernel(kernel + 2 * N * k, in, out, N, bAdjoint, bAccum);
+}
+
+void ophSigCHOperator::apply(matrix<Real>& realimagvolumeinput, matrix<Real>& realimagplaneoutput)
+{
+	const int nz = (int)Z.size();
+	const size_t N = (size_t)nr2 * nc2;
+
+	for (int t = 0; t < nThread; t++)
+		memset(accum[t], 0, sizeof(fftw_complex) * N);
+
+	// the propagated planes are summed in the frequency domain,
+	// so the whole volume costs nz forward FFTs and a single inverse FFT
+	int k;
+#ifdef _OPENMP
+#pragma omp parallel for private(k) schedule(static)
+#endif
+	for (k = 0; k < nz; k++)
+	{
+		int tid = 0;
+#ifdef _OPENMP
+		tid = omp_get_thread_num();
+#endif
+		fftw_complex* w = work[tid];
+		memset(w, 0, sizeof(fftw_complex) * N);
+		for (int i = 0; i < nr; i++)
+		{
+			const Real* re = realimagvolumeinput[i] + k*nc;
+			const Real* im = realimagvolumeinput[i + nr] + k*nc;
+			fftw_complex* row = w + (size_t)(i + iStart) * nc2 + jStart;
+			for (int j = 0; j < nc; j++)
+			{
+				row[j][_RE] = re[j];
+				row[j][_IM] = im[j];
+			}
+		}
+		fftw_execute_dft(fwd_plan, w, w);
+		mulKernel(k, w, accum[tid], false, true);
+	}
+
+	// per-thread partial spectra are added in thread order
+	fftw_complex* sum = accum[0];
+	for (int t = 1; t < nThread; t++)
+	{
+		const fftw_complex* part = accum[t];
+		for (size_t n = 0; n < N; n++)
+		{
+			sum[n][_RE] += part[n][_RE];
+			sum[n][_IM] += part[n][_IM];
+		}
+	}
+	fftw_execute_dft(bwd_plan, sum, sum);
+
+	for (int i = 0; i < nr; i++)
+	{
+		const fftw_complex* row = sum + (size_t)(i + iStart) * nc2 + jStart;
+		Real* re = realimagplaneoutput[i];
+		Real* im = realimagplaneoutput[i + nr];
+		for (int j = 0; j < nc; j++)
+		{
+			re[j] = row[j][_RE];
+			im[j] = row[j][_IM];
+		}
+	}
+}
+
+void ophSigCHOperator::applyAdjoint(matrix<Real>& realimagplaneinput, matrix<Real>& realimagvolumeoutput)
+{
+	const int nz = (int)Z.size();
+	const size_t N = (size_t)nr2 * nc2;
+
+	// the hologram spectrum is computed once and shared by every depth
+	fftw_complex* spectrum = accum[0];
+	memset(spectrum, 0, sizeof(fftw_complex) * N);
+	for (int i = 0; i < nr; i++)
+	{
+		const Real* re = realimagplaneinput[i];
+		const Real* im = realimagplaneinput[i + nr];
+		fftw_complex* row = spectrum + (size_t)(i + iStart) * nc2 + jStart;
+		for (int j = 0; j < nc; j++)
+		{
+			row[j][_RE] = re[j];
+			row[j][_IM] = im[j];
+		}
+	}
+	fftw_execute_dft(fwd_plan, spectrum, spectrum);
+
+	// conj(K(z)) equals K(-z), the back-propagation of plane2volume
+	int k;
+#ifdef _OPENMP
+#pragma omp parallel for private(k) schedule(static)
+#endif
+	for (k = 0; k < nz; k++)
+	{
+		int tid = 0;
+#ifdef _OPENMP
+		tid = omp_get_thread_num();
+#endif
+		fftw_complex* w = work[tid];
+		mulKernel(k, spectrum, w, true, false);
+		fftw_execute_dft(bwd_plan, w, w);
+
+		for (int i = 0; i < nr; i++)
+		{
+			const fftw_complex* row = w + (size_t)(i + iStart) * nc2 + jStart;
+			Real* re = realimagvolumeoutput[i] + k*nc;
+			Real* im = realimagvolumeoutput[i + nr] + k*nc;
+			for (int j = 0; j < nc; j++)
+			{
+				re[j] = row[j][_RE];
+				im[j] = row[j][_IM];
+			}
+		}
+	}
+}
 
 ophSigCH::ophSigCH(void) 
 	: Nz(0)
@@ -6,6 +321,7 @@ ophSigCH::ophSigCH(void)
 	, Tau(0)
 	, TolA(0)
 	, TvIter(0)
+	, bFloatKernel(false)
 {
 }
 
@@ -96,95 +412,64 @@ void ophSigCH::tvdenoise(matrix<Real>& input, double lam, int iters, matrix<Real
 	int nr = input.size(_X);
 	int nc = input.size(_Y);
 	matrix<Real> divp(nr, nc);
-	divp.zeros();
-		
-	matrix<Real> z(nr, nc);
-	matrix<Real> z1, z2;
-	z1.resize(nr, nc);
-	z2.resize(nr, nc);
-
-	matrix<Real> p1, p2;
-	p1.resize(nr, nc);
-	p2.resize(nr, nc);
-
-	matrix<Real> denom(nr, nc);
+	matrix<Real> p1(nr, nc);
+	matrix<Real> p2(nr, nc);
 
+	int i;
 	for (int iter = 0; iter < iters; iter++)
 	{
-		for (int i = 0; i < nr; i++)
-		{
-			for (int j = 0; j < nc; j++)
-			{
-				z(i,j) = divp(i, j) - input(i, j)*lam;
-			}
-		}
-
-		/////////////////////////
-		for (int i = 0; i < nr - 1; i++)
+		// z = divp - lam * input is formed on the fly from rows i and i + 1,
+		// and its gradient (z1, z2) updates p1, p2 in the same sweep
+#ifdef _OPENMP
+#pragma omp parallel for private(i)
+#endif
+		for (i = 0; i < nr; i++)
 		{
+			const Real* d0 = divp[i];
+			const Real* in0 = input[i];
+			const Real* d1 = (i < nr - 1) ? divp[i + 1] : d0;
+			const Real* in1 = (i < nr - 1) ? input[i + 1] : in0;
+			const bool lastRow = (i == nr - 1);
+			Real* q1 = p1[i];
+			Real* q2 = p2[i];
+
+			Real z = d0[0] - in0[0] * lam;
 			for (int j = 0; j < nc - 1; j++)
 			{
-				z1(i, j) = z(i, j + 1) - z(i, j);
-				z2(i, j) = z(i + 1, j) - z(i, j);
-				denom(i, j) = 1 + dt*sqrt(z1(i, j)*z1(i, j) + z2(i, j)*z2(i, j));
+				Real zr = d0[j + 1] - in0[j + 1] * lam;
+				Real z1 = zr - z;
+				Real z2 = lastRow ? 0.0 : (d1[j] - in1[j] * lam) - z;
+				Real denom = 1 + dt*sqrt(z1*z1 + z2*z2);
+				q1[j] = (q1[j] + dt*z1) / denom;
+				q2[j] = (q2[j] + dt*z2) / denom;
+				z = zr;
 			}
+			Real z2 = lastRow ? 0.0 : (d1[nc - 1] - in1[nc - 1] * lam) - z;
+			Real denom = 1 + dt*sqrt(z2*z2);
+			q1[nc - 1] = q1[nc - 1] / denom;
+			q2[nc - 1] = (q2[nc - 1] + dt*z2) / denom;
 		}
-		for (int i = 0; i < nr-1; i++)
-		{
-			z1(i, nc-1) = 0.0;
-			z2(i, nc-1) = z(i + 1, nc-1) - z(i, nc-1);
-			denom(i, nc-1) = 1 + dt*sqrt(z1(i, nc-1)*z1(i, nc-1) + z2(i, nc-1)*z2(i, nc-1));
-		}
-		for (int j = 0; j < nc - 1; j++)
-		{
-			z1(nr-1, j) = z(nr-1, j+1) - z(nr-1, j);
-			z2(nr-1, j) = 0.0;
-			denom(nr-1, j) = 1 + dt*sqrt(z1(nr-1, j)*z1(nr-1, j) + z2(nr-1, j)*z2(nr-1, j));
-		}
-		denom(nr-1, nc-1) = 1.0;
-		z1(nr - 1, nc - 1) = 0.0;
-		z2(nr - 1, nc - 1) = 0.0;
-		//////////////////////////
-
 
-		for (int i = 0; i < nr ; i++)
+		// divergence of p
+#ifdef _OPENMP
+#pragma omp parallel for private(i)
+#endif
+		for (i = 0; i < nr; i++)
 		{
-			for (int j = 0; j < nc; j++)
-			{
-				p1(i, j) = (p1(i, j) + dt*z1(i, j)) / denom(i, j);
-				p2(i, j) = (p2(i, j) + dt*z2(i, j)) / denom(i, j);
-			}
-		}
+			const Real* q1 = p1[i];
+			const Real* q2 = p2[i];
+			const Real* q2u = (i > 0) ? p2[i - 1] : q2;
+			Real* d = divp[i];
 
-		////////////////////////////////
-		for (int i = 1; i < nr; i++)
-		{
+			d[0] = q2[0] - q2u[0];
 			for (int j = 1; j < nc; j++)
 			{
-				divp(i, j) = p1(i, j) - p1(i, j - 1) + p2(i, j) - p2(i - 1, j);
+				d[j] = q1[j] - q1[j - 1] + q2[j] - q2u[j];
 			}
 		}
-		for (int i = 1; i < nr; i++)
-		{
-			divp(i, 0) = p2(i, 0) - p2(i-1, 0);
-		}
-		for (int j = 1; j < nc; j++)
-		{
-			divp(0, j) = p1(0, j) - p1(0, j - 1);
-		}
-		divp(0, 0) = 0.0;
-		//////////////////////////////
-
-	}
-
-	for (int i = 0; i < input.size[_X]; i++)
-	{
-		for (int j = 0; j < input.size[_Y]; j++)
-		{
-			output(i, j) = input(i,j) - divp(i, j)/lam;
-		}
 	}
 
+	output = input - divp / lam;
 }
 
 double ophSigCH::tvnorm(matrix<Real>& input)
@@ -193,16 +478,21 @@ double ophSigCH::tvnorm(matrix<Real>& input)
 	int nr = input.size[_X];
 	int nc = input.size[_Y];
 
-	for (int i = 0; i < nr-1; i++)
+	int i;
+#ifdef _OPENMP
+#pragma omp parallel for private(i) reduction(+:sqrtsum)
+#endif
+	for (i = 0; i < nr - 1; i++)
 	{
-		for (int j = 0; j < nc-1; j++)
+		const Real* row = input[i];
+		const Real* next = input[i + 1];
+		for (int j = 0; j < nc - 1; j++)
 		{
-			sqrtsum += sqrt((input(i,j)-input(i+1,j))*(input(i,j)-input(i+1,j)) + (input(i,j)-input(i,j+1))*(input(i,j)-input(i,j+1)));
+			Real dx = row[j] - next[j];
+			Real dy = row[j] - row[j + 1];
+			sqrtsum += sqrt(dx*dx + dy*dy);
 		}
-	}
-	for (int i = 0; i < nr-1; i++)
-	{
-		sqrtsum += sqrt(pow(input(i, nc-1) - input(i + 1, nc-1), 2) + pow(input(i, nc-1) - input(i, 0), 2));
+		sqrtsum += sqrt(pow(row[nc - 1] - next[nc - 1], 2) + pow(row[nc - 1] - row[0], 2));
 	}
 	for (int j = 0; j < nc - 1; j++)
 	{
@@ -244,12 +534,21 @@ void ophSigCH::volume2plane(matrix<Real>& realimagvolumeinput, vector<Real> z, m
 	int nr = realimagvolumeinput.size(_X) / 2;	// real imag
 	int nc = realimagvolumeinput.size(_Y) / nz;
 
-	matrix<Complex<Real>> complexTemp(nr,nc);
-	matrix<Complex<Real>> complexAccum(nr, nc);
-	complexAccum.zeros();
+	if (prepareCHOperator(nr, nc, z))
+	{
+		CHOperator.apply(realimagvolumeinput, realimagplaneoutput);
+		return;
+	}
 
-	for (int k = 0; k < nz; k++)
+	// depth planes are propagated in parallel, then summed in order
+	vector<matrix<Complex<Real>>> planes(nz);
+	int k;
+#ifdef _OPENMP
+#pragma omp parallel for private(k) schedule(dynamic)
+#endif
+	for (k = 0; k < nz; k++)
 	{
+		matrix<Complex<Real>> complexTemp(nr, nc);
 		for (int i = 0; i < nr; i++)
 		{
 			for (int j = 0; j < nc; j++)
@@ -258,7 +557,13 @@ void ophSigCH::volume2plane(matrix<Real>& realimagvolumeinput, vector<Real> z, m
 				complexTemp(i, j)._Val[_IM] = realimagvolumeinput(i + nr, j + k*nc);
 			}
 		}
-		complexAccum = complexAccum + propagationHoloAS(complexTemp, static_cast<float>(z.at(k)));
+		planes[k] = propagationHoloAS(complexTemp, static_cast<float>(z.at(k)));
+	}
+
+	matrix<Complex<Real>> complexAccum(nr, nc);
+	for (k = 0; k < nz; k++)
+	{
+		complexAccum += planes[k];
 	}
 	c2ri(complexAccum, realimagplaneoutput);
 }
@@ -270,6 +575,12 @@ void ophSigCH::plane2volume(matrix<Real>& realimagplaneinput, vector<Real> z, ma
 	int nc = realimagplaneinput.size(_Y);
 	int nz = z.size();
 
+	if (prepareCHOperator(nr, nc, z))
+	{
+		CHOperator.applyAdjoint(realimagplaneinput, realimagplaneoutput);
+		return;
+	}
+
 	matrix<Complex<Real>> complexplaneinput(nr, nc);
 	for (int i = 0; i < nr; i++)
 	{
@@ -280,11 +591,14 @@ void ophSigCH::plane2volume(matrix<Real>& realimagplaneinput, vector<Real> z, ma
 		}
 	}
 
-
-	matrix<Complex<Real>> temp(nr, nc);
-	for (int k = 0; k < nz; k++)
+	// each depth plane writes its own columns of the volume
+	int k;
+#ifdef _OPENMP
+#pragma omp parallel for private(k) schedule(dynamic)
+#endif
+	for (k = 0; k < nz; k++)
 	{
-		temp = propagationHoloAS(complexplaneinput, static_cast<float>(-z.at(k)));
+		matrix<Complex<Real>> temp = propagationHoloAS(complexplaneinput, static_cast<float>(-z.at(k)));
 		for (int i = 0; i < nr; i++)
 		{
 			for (int j = 0; j < nc; j++)
@@ -297,6 +611,21 @@ void ophSigCH::plane2volume(matrix<Real>& realimagplaneinput, vector<Real> z, ma
 
 }
 
+bool ophSigCH::prepareCHOperator(int nr, int nc, vector<Real>& z)
+{
+	Real wavelength = _cfgSig.wavelength[0];
+	if (CHOperator.isReady(nr, nc, _cfgSig.height, _cfgSig.width, wavelength, z, bFloatKernel))
+		return true;
+
+	auto start_time = CUR_TIME;
+	if (!CHOperator.init(nr, nc, _cfgSig.height, _cfgSig.width, wavelength, z, bFloatKernel))
+		return false;
+	auto end_time = CUR_TIME;
+
+	LOG("TwIST operator : %d depths cached (%.5lf sec)\n", (int)z.size(), ((std::chrono::duration<Real>)(end_time - start_time)).count());
+	return true;
+}
+
 void ophSigCH::convert3Dto2D(matrix<Complex<Real>>* complex3Dinput, int nz, matrix<Complex<Real>>& complex2Doutput)
 {
 	int nr = complex3Dinput[0].size(_X);
@@ -378,19 +707,15 @@ void ophSigCH::twist(matrix<Real>& realimagplaneinput, matrix<Real>& realimagvol
 
 	double criterion = 0.0;
 
+	auto start_time = CUR_TIME;
+
 	// initialization
 	plane2volume(realimagplaneinput, Z, realimagvolumeoutput);
 
 	// compute and sotre initial value of the objective function
 	matrix<Real> resid(nrp, ncp);
 	volume2plane(realimagvolumeoutput, Z, resid);
-	for (int i = 0; i < nrp; i++)
-	{
-		for (int j = 0; j < ncp; j++)
-		{
-			resid(i, j) = realimagplaneinput(i, j) - resid(i, j);
-		}
-	}
+	resid = realimagplaneinput - resid;
 	prev_f = 0.5*matrixEleSquareSum(resid) + tau*tvnorm(realimagvolumeoutput);
 
 	//
@@ -421,50 +746,36 @@ void ophSigCH::twist(matrix<Real>& realimagplaneinput, matrix<Real>& realimagvol
 		plane2volume(resid, Z, grad);
 		while (for_ever)
 		{
-			for (int i = 0; i < nrv; i++)
-			{
-				for (int j = 0; j < ncv; j++)
-				{
-					temp_volume(i, j) = xm1(i, j) + grad(i, j) / max_svd;
-				}
-			}
+			temp_volume = xm1 + grad / max_svd;
 			tvdenoise(temp_volume, 2.0 / (tau / max_svd), tv_iters, realimagvolumeoutput);
 			
 			if ((IST_iters >= 2) | (TwIST_iters != 0))
 			{
 				if (sparse)
 				{
-					for (int i = 0; i < nrv; i++)
+					const longlong n = (longlong)realimagvolumeoutput.numel();
+					Real* x = realimagvolumeoutput.data();
+					Real* x1 = xm1.data();
+					Real* x2 = xm2.data();
+					longlong i;
+#ifdef _OPENMP
+#pragma omp parallel for private(i)
+#endif
+					for (i = 0; i < n; i++)
 					{
-						for (int j = 0; j < ncv; j++)
+						if (x[i] == 0)
 						{
-							if (realimagvolumeoutput(i, j) == 0)
-							{
-								xm1(i, j) = 0.0;
-								xm2(i, j) = 0.0;
-							}
+							x1[i] = 0.0;
+							x2[i] = 0.0;
 						}
 					}
 						
 				}
 				// two step iteration
-				for (int i = 0; i < nrv; i++)
-				{
-					for (int j = 0; j < ncv; j++)
-					{
-						xm2(i, j) = (alpha - beta)*xm1(i, j) + (1.0 - alpha)*xm2(i, j) + beta*realimagvolumeoutput(i, j);
-					}
-				}
+				xm2 = (alpha - beta)*xm1 + (1.0 - alpha)*xm2 + beta*realimagvolumeoutput;
 				// compute residual
 				volume2plane(xm2, Z, resid);
-				
-				for (int i = 0; i < nrp; i++)
-				{
-					for (int j = 0; j < ncp; j++)
-					{
-						resid(i, j) = realimagplaneinput(i, j) - resid(i, j);
-					}
-				}
+				resid = realimagplaneinput - resid;
 				f = 0.5*matrixEleSquareSum(resid) + tau*tvnorm(xm2);
 				if ((f > prev_f) & (enforceMonotone))
 				{
@@ -485,13 +796,7 @@ void ophSigCH::twist(matrix<Real>& realimagplaneinput, matrix<Real>& realimagvol
 			else
 			{
 				volume2plane(realimagvolumeoutput, Z, resid);
-				for (int i = 0; i < nrp; i++)
-				{
-					for (int j = 0; j < ncp; j++)
-					{
-						resid(i, j) = realimagplaneinput(i, j) - resid(i, j);
-					}
-				}
+				resid = realimagplaneinput - resid;
 				f = 0.5*matrixEleSquareSum(resid) + tau*tvnorm(realimagvolumeoutput);
 				if (f > prev_f)
 				{
@@ -531,6 +836,10 @@ void ophSigCH::twist(matrix<Real>& realimagplaneinput, matrix<Real>& realimagvol
 		}
 	}
 
+	auto end_time = CUR_TIME;
+	auto during_time = ((std::chrono::duration<Real>)(end_time - start_time)).count();
+	LOG("TwIST : %d iterations, %.3f iterations/sec\n", iter, iter / during_time);
+
 	if (verbose)
 	{
 		double sum_abs_x=0.0;
@@ -551,12 +860,15 @@ void ophSigCH::twist(matrix<Real>& realimagplaneinput, matrix<Real>& realimagvol
 double ophSigCH::matrixEleSquareSum(matrix<Real>& input)
 {
 	double output = 0.0;
-	for (int i = 0; i < input.size(_X); i++)
+	const longlong n = (longlong)input.numel();
+	const Real* p = input.data();
+	longlong i;
+#ifdef _OPENMP
+#pragma omp parallel for private(i) reduction(+:output)
+#endif
+	for (i = 0; i < n; i++)
 	{
-		for (int j = 0; j < input.size(_Y); j++)
-		{
-			output += input(i, j)*input(i, j);
-		}
+		output += p[i] * p[i];
 	}
 	return output;
 }
@@ -825,7 +1137,7 @@ matrix<Complex<Real>> ophSigCH::propagationHoloAS(matrix<Complex<Real>> complexH
 	int nc2 = 2 * nc;
 
 	oph::matrix<oph::Complex<Real>> src2(nr2,nc2);	// prepare complex matrix with 2x size (to prevent artifacts caused by circular convolution)
-	src2 * 0;	// initialize to 0
+	src2.zeros();	// initialize to 0
 
 	int iStart = nr / 2 - 1;
 	int jStart = nc / 2 - 1;
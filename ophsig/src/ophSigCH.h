@@ -30,6 +30,65 @@ www.lx.it.pt/~bioucas/TwIST
 */
 //! @} CH
 
+/**
+* @ingroup CH
+* @brief	Multi-depth angular spectrum propagation operator of compressive holography.
+*			The transfer function of every depth (with the fftShifts and the 1/N of the inverse FFT folded in),
+*			the FFT plans and the per-thread workspaces are built once by init(),
+*			so apply / applyAdjoint only cost FFTs and pointwise complex products.
+*			Volumes and planes use the real-imag layout of ophSigCH (real part in the upper half rows).
+*/
+class SIG_DLL ophSigCHOperator
+{
+public:
+	ophSigCHOperator(void);
+	~ophSigCHOperator(void);
+
+	/**
+	* @brief		Build the transfer functions, plans and workspaces
+	* @param nr, nc	number of rows / columns of a plane
+	* @param height, width	physical size of a plane
+	* @param wavelength	wavelength
+	* @param z		depth of each plane
+	* @param bFloat	store the transfer functions in single precision to halve their memory
+	* @return		false if the workspaces could not be allocated
+	*/
+	bool init(int nr, int nc, Real height, Real width, Real wavelength, const vector<Real>& z, bool bFloat = false);
+	/**
+	* @brief		Check whether init() was called with the same geometry
+	*/
+	bool isReady(int nr, int nc, Real height, Real width, Real wavelength, const vector<Real>& z, bool bFloat) const;
+	void release(void);
+
+	/**
+	* @brief		Forward operator : propagate every plane of the volume and sum them on the hologram plane
+	*/
+	void apply(matrix<Real>& realimagvolumeinput, matrix<Real>& realimagplaneoutput);
+	/**
+	* @brief		Adjoint operator : back-propagate the hologram plane to every depth of the volume
+	*/
+	void applyAdjoint(matrix<Real>& realimagplaneinput, matrix<Real>& realimagvolumeoutput);
+
+private:
+	ophSigCHOperator(const ophSigCHOperator&) = delete;
+	ophSigCHOperator& operator=(const ophSigCHOperator&) = delete;
+
+	void mulKernel(int k, const fftw_complex* in, fftw_complex* out, bool bAdjoint, bool bAccum);
+
+	int nr, nc, nr2, nc2;
+	int iStart, jStart;
+	Real height, width, wavelength;
+	vector<Real> Z;
+	bool bFloat;
+
+	Real* kernel;			///< nz x nr2 x nc2 interleaved real/imag transfer functions (double)
+	Real_t* kernelF;		///< same, single precision
+	int nThread;
+	fftw_complex** work;	///< per-thread padded plane
+	fftw_complex** accum;	///< per-thread spectrum accumulator
+	fftw_plan fwd_plan, bwd_plan;
+};
+
 /**
 * @ingroup CH
 * @brief
@@ -50,6 +109,10 @@ public:
 	bool loadCHtemp(const char *real, const char *imag, uint8_t bitpixel);
 
 	matrix<Complex<Real>> propagationHoloAS(matrix<Complex<Real>> complexH, float depth);
+	/**
+	* @brief		Store the cached transfer functions of the TwIST operator in single precision
+	*/
+	void setFloatKernel(bool bFloat) { bFloatKernel = bFloat; }
 
 
 protected:
@@ -61,6 +124,7 @@ protected:
 	void ri2c(matrix<Real> &realimaginput, matrix<Complex<Real>> &complexoutput);
 	void volume2plane(matrix<Real>& realimagvolumeinput, vector<Real> z, matrix<Real>& realimagplaneoutput);
 	void plane2volume(matrix<Real>& realimagplaneinput, vector<Real> z, matrix<Real>& realimagplaneoutput);
+	bool prepareCHOperator(int nr, int nc, vector<Real>& z);
 	void convert3Dto2D(matrix<Complex<Real>> *complex3Dinput, int nz, matrix<Complex<Real>> &complex2Doutput);
 	void convert2Dto3D(matrix<Complex<Real>> &complex2Dinput, int nz, matrix<Complex<Real>> *complex3Doutput);
 	void twist(matrix<Real>& realimagplaneinput, matrix<Real>& realimagvolumeoutput);
@@ -80,6 +144,8 @@ protected:
 	int TvIter;
 	matrix<Real> NumRecRealImag;
 	vector<Real> Z;
+	bool bFloatKernel;
+	ophSigCHOperator CHOperator;
 
 };
 
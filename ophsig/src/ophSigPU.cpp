@@ -1,6 +1,12 @@
 #include "ophSigPU.h"
+#include <queue>
+#include <functional>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 ophSigPU::ophSigPU(void)
+	: FillMode(PU_FILL_BFS)
 {
 }
 
@@ -243,41 +249,32 @@ void ophSigPU::phaseResidues(matrix<Real>& outputResidue)
 	https://kr.mathworks.com/matlabcentral/fileexchange/22504-2d-phase-unwrapping-algorithms
 	*/
 
-	matrix<Real> below(Nr, Nc);
-	matrix<Real> right(Nr, Nc);
-	matrix<Real> belowright(Nr, Nc);
-	below.zeros(); right.zeros(); belowright.zeros();
-
-	for (int i = 0; i < Nr-1; i++)
-	{
-		for (int j = 0; j < Nc-1; j++)
-		{
-			below(i, j) = PhaseOriginal(i + 1, j);
-			right(i, j) = PhaseOriginal(i, j + 1);
-			belowright(i, j) = PhaseOriginal(i + 1, j + 1);
-		}
-	}
-	for (int i = 0; i < Nr-1; i++)
-	{
-		below(i, Nc-1) = PhaseOriginal(i + 1, Nc-1);
-	}
-	for (int j = 0; j < Nc - 1; j++)
-	{
-		right(Nr-1, j) = PhaseOriginal(Nr-1, j+1);
-	}
-
-	double res1, res2, res3, res4;
-	double temp_residue;
-	for (int i = 0; i < Nr; i++)
+	// residues on the border are discarded, so only interior pixels are evaluated
+	// and their below / right / below-right neighbours are read in place
+	int i;
+#ifdef _OPENMP
+#pragma omp parallel for private(i)
+#endif
+	for (i = 0; i < Nr; i++)
 	{
 		for (int j = 0; j < Nc; j++)
 		{
-			res1 = mod2pi(PhaseOriginal(i, j) - below(i, j));
-			res2 = mod2pi(below(i, j) - belowright(i,j));
-			res3 = mod2pi(belowright(i, j) - right(i, j));
-			res4 = mod2pi(right(i, j) - PhaseOriginal(i, j));
+			if ((i < 1) | (i > Nr - 2) | (j < 1) | (j > Nc - 2))
+			{
+				outputResidue(i, j) = 0;
+				continue;
+			}
+			double phase = PhaseOriginal(i, j);
+			double below = PhaseOriginal(i + 1, j);
+			double right = PhaseOriginal(i, j + 1);
+			double belowright = PhaseOriginal(i + 1, j + 1);
+
+			double res1 = mod2pi(phase - below);
+			double res2 = mod2pi(below - belowright);
+			double res3 = mod2pi(belowright - right);
+			double res4 = mod2pi(right - phase);
 
-			temp_residue = res1 + res2 + res3 + res4;
+			double temp_residue = res1 + res2 + res3 + res4;
 			if (temp_residue >= 6.)
 			{
 				outputResidue(i, j) = 1;
@@ -292,17 +289,6 @@ void ophSigPU::phaseResidues(matrix<Real>& outputResidue)
 			}
 		}
 	}
-
-	for (int i = 0; i < Nr; i++)
-	{
-		outputResidue(i, 0) = 0;
-		outputResidue(i, Nc - 1) = 0;
-	}
-	for (int j = 0; j < Nc; j++)
-	{
-		outputResidue(0, j) = 0;
-		outputResidue(Nr - 1, j) = 0;
-	}
 }
 
 void ophSigPU::branchCuts(matrix<Real>& inputResidue, matrix<Real>& outputBranchCuts)
@@ -329,10 +315,11 @@ void ophSigPU::branchCuts(matrix<Real>& inputResidue, matrix<Real>& outputBranch
 			}	
 		}
 	}
+	matrix<int> residueTable;
+	summedAreaTable(residueBinary, residueTable);
 	matrix<Real> residueBalanced(Nr, Nc);
 	residueBalanced.zeros();
-	matrix<int> adjacentResidue(Nr, Nc);
-	adjacentResidue.zeros();
+	vector<int> rAdjacent, cAdjacent;	// residues found around the active one, in scan order
 	int missedResidue = 0;
 
 	int adjacentResidueCount = 0;
@@ -349,19 +336,24 @@ void ophSigPU::branchCuts(matrix<Real>& inputResidue, matrix<Real>& outputBranch
 				int radius = 1;
 				int countNearbyResidueFlag = 1;
 				clusterCounter = 1;
-				adjacentResidue.zeros();
+				rAdjacent.clear();
+				cAdjacent.clear();
 				int chargeCounter = inputResidue(rActive, cActive);
 				if (residueBalanced(rActive, cActive) != 1)
 				{
 					while (chargeCounter != 0)
 					{
-						for (int m = rActive - radius; m < rActive + radius + 1; m++)
+						// a ring inside the border without residues changes nothing, so its scan is skipped
+						bool ringEmpty = (rActive - radius >= 1) & (rActive + radius < Nr - 1) & (cActive - radius >= 1) & (cActive + radius < Nc - 1) &&
+							boxSum(residueTable, rActive - radius, cActive - radius, rActive + radius, cActive + radius) ==
+							boxSum(residueTable, rActive - radius + 1, cActive - radius + 1, rActive + radius - 1, cActive + radius - 1);
+						for (int m = rActive - radius; (m < rActive + radius + 1) & !ringEmpty; m++)
 						{
 							for (int n = cActive - radius; n < cActive + radius + 1; n++)
 							{
 								if (((abs(m - rActive) == radius) | (abs(n - cActive) == radius)) & (chargeCounter != 0))
 								{
-									if ((m < 1) | (m >= Nr - 1) | (n < 1) | (m >= Nc - 1))
+									if ((m < 1) | (m >= Nr - 1) | (n < 1) | (n >= Nc - 1))
 									{
 										if (m >= Nr - 1) { m = Nr - 1; }
 										if (n >= Nc - 1) { n = Nc - 1; }
@@ -374,7 +366,11 @@ void ophSigPU::branchCuts(matrix<Real>& inputResidue, matrix<Real>& outputBranch
 									}
 									if (residueBinary(m, n))
 									{
-										if (countNearbyResidueFlag == 1) { adjacentResidue(m, n) = 1; }
+										if (countNearbyResidueFlag == 1)
+										{
+											rAdjacent.push_back(m);
+											cAdjacent.push_back(n);
+										}
 										placeBranchCutsInternal(outputBranchCuts, rActive, cActive, m, n);
 										clusterCounter += 1;
 										if (residueBalanced(m, n) == 0)
@@ -389,16 +385,8 @@ void ophSigPU::branchCuts(matrix<Real>& inputResidue, matrix<Real>& outputBranch
 							}
 						}
 
-						double sumAdjacentResidue = 0;
 						int adjacentSize = 0;
-						for (int ii = 0; ii < Nr; ii++)
-						{
-							for (int jj = 0; jj < Nc; jj++)
-							{
-								sumAdjacentResidue += adjacentResidue(ii, jj);
-							}
-						}
-						if (sumAdjacentResidue == 0)
+						if (rAdjacent.empty())
 						{
 							radius += 1;
 							rActive = i;
@@ -406,10 +394,8 @@ void ophSigPU::branchCuts(matrix<Real>& inputResidue, matrix<Real>& outputBranch
 						}
 						else
 						{
-							vector<int> rAdjacent, cAdjacent;
 							if (countNearbyResidueFlag == 1)
 							{
-								findNZ(adjacentResidue, rAdjacent, cAdjacent);
 								adjacentSize = rAdjacent.size();
 								rActive = rAdjacent[0];
 								cActive = cAdjacent[0];
@@ -430,7 +416,8 @@ void ophSigPU::branchCuts(matrix<Real>& inputResidue, matrix<Real>& outputBranch
 									radius += 1;
 									rActive = i;
 									cActive = j;
-									adjacentResidue.zeros();
+									rAdjacent.clear();
+									cAdjacent.clear();
 									countNearbyResidueFlag = 1;
 								}
 							}
@@ -456,7 +443,7 @@ void ophSigPU::branchCuts(matrix<Real>& inputResidue, matrix<Real>& outputBranch
 									{
 										if (((abs(m - rActive) == radius) | (abs(n - cActive) == radius) ))
 										{
-											if ((m < 1) | (m >= Nr - 1) | (n < 1) | (m >= Nc - 1))
+											if ((m < 1) | (m >= Nr - 1) | (n < 1) | (n >= Nc - 1))
 											{
 												if (m >= Nr - 1) { m = Nr - 1; }
 												if (n >= Nc - 1) { n = Nc - 1; }
@@ -526,143 +513,91 @@ void ophSigPU::floodFill(matrix<Real>& inputBranchCuts)
 	https://kr.mathworks.com/matlabcentral/fileexchange/22504-2d-phase-unwrapping-algorithms
 	*/
 
-	matrix<int> adjoin(Nr, Nc);
-	adjoin.zeros();
-
 	matrix<int> unwrappedBinary(Nr, Nc);
 	unwrappedBinary.zeros();
 	
 	// set ref phase
-	bool refPhaseFound = false;
-	for (int i = 1; (i < Nr - 1) & !refPhaseFound; i++)
+	int rRef = -1;
+	int cRef = -1;
+	for (int i = 1; (i < Nr - 1) & (rRef < 0); i++)
 	{
-		for (int j = 1; (j < Nc - 1) & !refPhaseFound; j++)
+		for (int j = 1; (j < Nc - 1) & (rRef < 0); j++)
 		{
 			if (inputBranchCuts(i, j) == 0)
 			{
-				adjoin(i - 1, j) = 1;
-				adjoin(i + 1, j) = 1;
-				adjoin(i, j - 1) = 1;
-				adjoin(i, j + 1) = 1;
-				unwrappedBinary(i, j) = 1;
-				PhaseUnwrapped(i, j) = PhaseOriginal(i, j);
-				refPhaseFound = true;
+				rRef = i;
+				cRef = j;
 			}
 		}
 	}
 
 	// floodfill
-	int countLimit = 0;
-	int adjoinStuck = 0;
-	vector<int> rAdjoin;
-	vector<int> cAdjoin;
-	int rActive = 0;
-	int cActive = 0;
-	double phaseRef = 0;
-	while ((matrixPartialSum(adjoin, 1, 1, Nr - 2, Nc - 2) > 0) & (countLimit < 100))
+	// Each pixel enters the frontier once and is unwrapped against the pixel that reached it.
+	// PU_FILL_BFS pops the frontier in FIFO order, PU_FILL_QUALITY pops the most reliable pixel first.
+	int unwrappedCount = 0;
+	if (rRef >= 0)
 	{
-		//while (countLimit < 100)
-		//{
-		LOG("%d\n", matrixPartialSum(adjoin, 1, 1, Nr - 2, Nc - 2));
-			findNZ(adjoin, rAdjoin, cAdjoin);
-			if (adjoinStuck == rAdjoin.size())
-			{
-				countLimit += 1;
-				LOG("countLimit %d\n", countLimit);
-			}
-			else
+		matrix<Real> quality;
+		if (FillMode == PU_FILL_QUALITY)
+		{
+			quality.resize(Nr, Nc);
+			phaseQuality(quality);
+		}
+
+		vector<int> frontier;
+		size_t frontierHead = 0;
+		priority_queue<pair<Real, int>, vector<pair<Real, int>>, greater<pair<Real, int>>> frontierQuality;
+		const int rStep[4] = { 1, -1, 0, 0 };
+		const int cStep[4] = { 0, 0, 1, -1 };
+
+		PhaseUnwrapped(rRef, cRef) = PhaseOriginal(rRef, cRef);
+		unwrappedBinary(rRef, cRef) = 1;
+		unwrappedCount = 1;
+
+		int index = rRef * Nc + cRef;
+		while (index >= 0)
+		{
+			int rActive = index / Nc;
+			int cActive = index % Nc;
+			for (int d = 0; d < 4; d++)
 			{
-				countLimit = 0;
+				int r = rActive + rStep[d];
+				int c = cActive + cStep[d];
+				if ((r < 1) | (r > Nr - 2) | (c < 1) | (c > Nc - 2)) continue;
+				if ((unwrappedBinary(r, c) == 1) | (inputBranchCuts(r, c) != 0)) continue;
+
+				PhaseUnwrapped(r, c) = unwrap(PhaseUnwrapped(rActive, cActive), PhaseOriginal(r, c));
+				unwrappedBinary(r, c) = 1;
+				unwrappedCount++;
+				if (FillMode == PU_FILL_QUALITY)
+					frontierQuality.push(make_pair(quality(r, c), r * Nc + c));
+				else
+					frontier.push_back(r * Nc + c);
 			}
-			adjoinStuck = rAdjoin.size();
-			for (int i = 0; i < rAdjoin.size(); i++)
+
+			if (FillMode == PU_FILL_QUALITY)
 			{
-				rActive = rAdjoin[i];
-				cActive = cAdjoin[i];
-				if ((rActive <= Nr - 2) & (rActive >= 1) & (cActive <= Nc - 2) & (cActive >= 1))
+				if (frontierQuality.empty()) index = -1;
+				else
 				{
-					if ((inputBranchCuts(rActive + 1, cActive) == 0) & (unwrappedBinary(rActive + 1, cActive) == 1))
-					{
-						phaseRef = PhaseUnwrapped(rActive + 1, cActive);
-						PhaseUnwrapped(rActive, cActive) = unwrap(phaseRef, PhaseOriginal(rActive, cActive));
-						unwrappedBinary(rActive, cActive) = 1;
-						adjoin(rActive, cActive) = 0;
-						if ((unwrappedBinary(rActive - 1, cActive) == 0) & (inputBranchCuts(rActive - 1, cActive) == 0))
-						{
-							adjoin(rActive - 1, cActive) = 1;
-						}
-						if ((unwrappedBinary(rActive, cActive-1) == 0) & (inputBranchCuts(rActive, cActive-1) == 0))
-						{
-							adjoin(rActive, cActive-1) = 1;
-						}
-						if ((unwrappedBinary(rActive, cActive+1) == 0) & (inputBranchCuts(rActive, cActive+1) == 0))
-						{
-							adjoin(rActive, cActive+1) = 1;
-						}
-					}
-					if ((inputBranchCuts(rActive - 1, cActive) == 0) & (unwrappedBinary(rActive - 1, cActive) == 1))
-					{
-						phaseRef = PhaseUnwrapped(rActive - 1, cActive);
-						PhaseUnwrapped(rActive, cActive) = unwrap(phaseRef, PhaseOriginal(rActive, cActive));
-						unwrappedBinary(rActive, cActive) = 1;
-						adjoin(rActive, cActive) = 0;
-						if ((unwrappedBinary(rActive + 1, cActive) == 0) & (inputBranchCuts(rActive + 1, cActive) == 0))
-						{
-							adjoin(rActive + 1, cActive) = 1;
-						}
-						if ((unwrappedBinary(rActive, cActive - 1) == 0) & (inputBranchCuts(rActive, cActive - 1) == 0))
-						{
-							adjoin(rActive, cActive - 1) = 1;
-						}
-						if ((unwrappedBinary(rActive, cActive + 1) == 0) & (inputBranchCuts(rActive, cActive + 1) == 0))
-						{
-							adjoin(rActive, cActive + 1) = 1;
-						}
-					}
-					if ((inputBranchCuts(rActive, cActive +1) == 0) & (unwrappedBinary(rActive, cActive+1) == 1))
-					{
-						phaseRef = PhaseUnwrapped(rActive, cActive+1);
-						PhaseUnwrapped(rActive, cActive) = unwrap(phaseRef, PhaseOriginal(rActive, cActive));
-						unwrappedBinary(rActive, cActive) = 1;
-						adjoin(rActive, cActive) = 0;
-						if ((unwrappedBinary(rActive + 1, cActive) == 0) & (inputBranchCuts(rActive + 1, cActive) == 0))
-						{
-							adjoin(rActive + 1, cActive) = 1;
-						}
-						if ((unwrappedBinary(rActive, cActive - 1) == 0) & (inputBranchCuts(rActive, cActive - 1) == 0))
-						{
-							adjoin(rActive, cActive - 1) = 1;
-						}
-						if ((unwrappedBinary(rActive -1 , cActive) == 0) & (inputBranchCuts(rActive-1, cActive) == 0))
-						{
-							adjoin(rActive-1, cActive) = 1;
-						}
-					}
-					if ((inputBranchCuts(rActive, cActive-1) == 0) & (unwrappedBinary(rActive, cActive-1) == 1))
-					{
-						phaseRef = PhaseUnwrapped(rActive, cActive-1);
-						PhaseUnwrapped(rActive, cActive) = unwrap(phaseRef, PhaseOriginal(rActive, cActive));
-						unwrappedBinary(rActive, cActive) = 1;
-						adjoin(rActive, cActive) = 0;
-						if ((unwrappedBinary(rActive + 1, cActive) == 0) & (inputBranchCuts(rActive + 1, cActive) == 0))
-						{
-							adjoin(rActive + 1, cActive) = 1;
-						}
-						if ((unwrappedBinary(rActive -1, cActive) == 0) & (inputBranchCuts(rActive-1, cActive) == 0))
-						{
-							adjoin(rActive-1, cActive) = 1;
-						}
-						if ((unwrappedBinary(rActive, cActive + 1) == 0) & (inputBranchCuts(rActive, cActive + 1) == 0))
-						{
-							adjoin(rActive, cActive + 1) = 1;
-						}
-					}
-
+					index = frontierQuality.top().second;
+					frontierQuality.pop();
 				}
-
 			}
-		//}
+			else
+			{
+				index = (frontierHead < frontier.size()) ? frontier[frontierHead++] : -1;
+			}
+		}
 	}
+	LOG("Floodfill : %d pixels unwrapped\n", unwrappedCount);
+
+	matrix<int> adjoin(Nr, Nc);
+	vector<int> rAdjoin;
+	vector<int> cAdjoin;
+	int rActive = 0;
+	int cActive = 0;
+	double phaseRef = 0;
 
 	adjoin.zeros();
 	for (int i = 1; i <= Nr - 2; i++)
@@ -717,6 +652,32 @@ void ophSigPU::floodFill(matrix<Real>& inputBranchCuts)
 	LOG("Floodfill completed\n");
 }
 
+void ophSigPU::phaseQuality(matrix<Real>& outputQuality)
+{
+	// squared second differences of the wrapped phase (lower is more reliable)
+	int i;
+#ifdef _OPENMP
+#pragma omp parallel for private(i)
+#endif
+	for (i = 0; i < Nr; i++)
+	{
+		for (int j = 0; j < Nc; j++)
+		{
+			if ((i < 1) | (i > Nr - 2) | (j < 1) | (j > Nc - 2))
+			{
+				outputQuality(i, j) = MAX_DOUBLE;
+				continue;
+			}
+			double p = PhaseOriginal(i, j);
+			double h = mod2pi(PhaseOriginal(i, j - 1) - p) - mod2pi(p - PhaseOriginal(i, j + 1));
+			double v = mod2pi(PhaseOriginal(i - 1, j) - p) - mod2pi(p - PhaseOriginal(i + 1, j));
+			double d1 = mod2pi(PhaseOriginal(i - 1, j - 1) - p) - mod2pi(p - PhaseOriginal(i + 1, j + 1));
+			double d2 = mod2pi(PhaseOriginal(i - 1, j + 1) - p) - mod2pi(p - PhaseOriginal(i + 1, j - 1));
+			outputQuality(i, j) = h*h + v*v + d1*d1 + d2*d2;
+		}
+	}
+}
+
 double ophSigPU::unwrap(double phaseRef, double phaseInput)
 {
 	double diff = phaseInput - phaseRef;
@@ -756,15 +717,26 @@ void ophSigPU::findNZ(matrix<int>& inputMatrix, vector<int>& row, vector<int>& c
 	}
 }
 
-int ophSigPU::matrixPartialSum(matrix<int>& inputMatrix, int r1, int c1, int r2, int c2)
+void ophSigPU::summedAreaTable(matrix<int>& inputMatrix, matrix<int>& outputTable)
 {
-	int outputsum = 0;
-	for (int i = r1; i <= r2; i++)
+	// outputTable(i + 1, j + 1) = sum of inputMatrix over [0, i] x [0, j]
+	int nr = inputMatrix.size(_X);
+	int nc = inputMatrix.size(_Y);
+	outputTable.resize(nr + 1, nc + 1);
+	outputTable.zeros();
+	for (int i = 0; i < nr; i++)
 	{
-		for (int j = c1; j <= c2; j++)
+		int rowsum = 0;
+		for (int j = 0; j < nc; j++)
 		{
-			outputsum += inputMatrix(i, j);
+			rowsum += inputMatrix(i, j);
+			outputTable(i + 1, j + 1) = outputTable(i, j + 1) + rowsum;
 		}
 	}
-	return outputsum;
+}
+
+int ophSigPU::boxSum(const matrix<int>& summedTable, int r1, int c1, int r2, int c2)
+{
+	// sum over [r1, r2] x [c1, c2] from a table built by summedAreaTable
+	return summedTable(r2 + 1, c2 + 1) - summedTable(r1, c2 + 1) - summedTable(r2 + 1, c1) + summedTable(r1, c1);
 }
@@ -18,6 +18,14 @@ https://kr.mathworks.com/matlabcentral/fileexchange/22504-2d-phase-unwrapping-al
 */
 //! @} PU
 
+/**
+* @brief	Order in which floodFill unwraps the pixels outside the branch cuts
+*			PU_FILL_BFS		: breadth first from the reference pixel
+*			PU_FILL_QUALITY	: most reliable pixel first (second difference quality map of M.A. Herraez et al., Appl. Opt. 41, pp. 7437 (2002))
+*/
+#define PU_FILL_BFS		0
+#define PU_FILL_QUALITY	1
+
 /**
 * @ingroup PU
 * @brief
@@ -34,6 +42,12 @@ public:
 	*/
 	bool setPUparam(int maxBoxRadius);
 
+	/**
+	* @brief Set the unwrapping order of the flood fill
+	* @param mode : PU_FILL_BFS (default) or PU_FILL_QUALITY
+	*/
+	void setPUFill(uint mode) { FillMode = mode; }
+
 	/**
 	* @brief Load original wrapped phase data
 	* @param fname : image file name of wrapped phase data
@@ -68,8 +82,10 @@ protected:
 	void floodFill(matrix<Real> &inputBranchCuts);
 	double unwrap(double phaseRef, double phaseInput);
 	double mod2pi(double phase);
+	void phaseQuality(matrix<Real> &outputQuality);
 	void findNZ(matrix<int> &inputMatrix, vector<int> &row, vector<int> &col);
-	int matrixPartialSum(matrix<int> &inputMatrix, int r1, int c1, int r2, int c2);
+	void summedAreaTable(matrix<int> &inputMatrix, matrix<int> &outputTable);
+	int boxSum(const matrix<int> &summedTable, int r1, int c1, int r2, int c2);
 public:
 
 
@@ -78,6 +94,7 @@ protected:
 	int MaxBoxRadius;
 	int Nr;
 	int Nc;
+	uint FillMode;
 	matrix<Real> PhaseOriginal;
 	matrix<Real> PhaseUnwrapped;
 };